@@ -7,6 +7,9 @@ enum {
     ID_Timer = 1000,
     ID_UpdateUI,
     ID_DownloadList,
+    ID_StatusFilter,
+    ID_HostFilter,
+    ID_SearchBox,
     
     // Menu and toolbar events
     ID_AddDownload,
@@ -20,7 +23,10 @@ enum {
     ID_OpenFolder,
     ID_CopyURL,
     ID_Settings,
-    ID_SpeedLimit
+    ID_SpeedLimit,
+    ID_PriorityHigh,
+    ID_PriorityNormal,
+    ID_PriorityLow
 };
 
 #endif // EVENTIDS_H
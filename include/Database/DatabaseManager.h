@@ -18,12 +18,27 @@ public:
     std::vector<DownloadItem> GetAllDownloads();
     DownloadItem GetDownloadById(int id);
     
+    // أفضل عدد اتصالات تم قياسه لكل خادم
+    int GetHostConnections(const wxString& host);
+    bool SaveHostConnections(const wxString& host, int connections);
+    
+    // معرفات التنزيلات التي يحتوي اسمها أو رابطها على النص، مرتبة تصاعديًا.
+    // يستخدم اتصال قراءة خاصًا به، فيمكن استدعاؤه من خيط الواجهة دون قفل التنزيلات
+    std::vector<int> SearchDownloads(const wxString& text, int limit);
+    
 private:
     // طرق مساعدة
     bool OpenDatabase();
+    bool OpenSearchConnection();
     bool CreateTables();
+    bool CreateSearchIndex();
+    bool AddColumnIfMissing(const char* table, const char* column, const char* definition);
+    DownloadItem ReadDownloadRow(sqlite3_stmt* stmt);
+    static wxString JoinList(const std::vector<wxString>& values, const wxString& separator);
     
     // متغيرات عضو
     wxString m_dbPath;
     sqlite3* m_db;
+    sqlite3* m_searchDb;    // اتصال للقراءة فقط خاص بالبحث
+    bool m_hasSearchIndex;  // فهرس FTS5 بالمقاطع الثلاثية متاح، وإلا يتم البحث بـ LIKE
 };
@@ -0,0 +1,62 @@
+#ifndef BANDWIDTHLIMITER_H
+#define BANDWIDTHLIMITER_H
+
+#include <chrono>
+#include <map>
+#include <mutex>
+
+// Hierarchical token bucket shared by every transfer. The global rate is
+// divided between weighted classes; each class can have a guaranteed
+// minimum and a cap. Share left unused by idle classes goes to the active
+// ones on the next refill. Configuration can be changed from any thread.
+class BandwidthLimiter {
+public:
+    // Constructor
+    BandwidthLimiter();
+    
+    // Set the global rate in bytes per second (0 = unlimited) and the burst size in bytes
+    void SetRate(long long bytesPerSecond, long long burstBytes);
+    long long GetRate() const;
+    
+    // Configure a class; rates in bytes per second, 0 = no minimum or no cap
+    void SetClass(int classId, int weight, long long minRate, long long maxRate);
+    
+    // Take tokens for received data; false means the transfer has to wait
+    bool TryConsume(int classId, long long bytes);
+    
+    // Give back tokens taken for data that was refused and will be delivered again
+    void Refund(int classId, long long bytes);
+    
+    // Milliseconds until the class has tokens again, -1 if it has no share at all.
+    // Asking marks the class as waiting so it keeps its share.
+    long GetDelayMs(int classId);
+
+private:
+    typedef std::chrono::steady_clock Clock;
+    
+    // State of one class
+    struct BandwidthClass {
+        int weight;
+        long long minRate;
+        long long maxRate;
+        double rate;              // Current share, negative when unlimited
+        double tokens;            // May drop below zero after a large write
+        Clock::time_point lastActive;
+        
+        BandwidthClass() : weight(1), minRate(0), maxRate(0), rate(0), tokens(0) {}
+    };
+    
+    // Private methods
+    BandwidthClass& GetClass(int classId);
+    void Refill(Clock::time_point now);
+    void Allocate(Clock::time_point now);
+    
+    // Member variables
+    mutable std::mutex m_mutex;
+    long long m_rate;
+    long long m_burst;
+    std::map<int, BandwidthClass> m_classes;
+    Clock::time_point m_lastRefill;
+};
+
+#endif // BANDWIDTHLIMITER_H
@@ -0,0 +1,43 @@
+#ifndef CONCURRENCYCONTROLLER_H
+#define CONCURRENCYCONTROLLER_H
+
+// AIMD tuning of the number of connections of one download. A connection
+// is added while the measured throughput keeps rising, the last one is
+// taken back when the gain levels off, and the count is halved after
+// errors or when the server asks to slow down (HTTP 429/503). Used from
+// the transfer engine thread only.
+class ConcurrencyController {
+public:
+    // Constructor
+    ConcurrencyController(int initial, int minimum, int maximum);
+    
+    // Feed the throughput of the last interval in bytes per second
+    void OnSample(long long bytesPerSecond, int activeConnections);
+    
+    // Report a failed connection, throttled when the server answered 429 or 503
+    void OnError(bool throttled);
+    
+    // Connections the download should use now
+    int GetTarget() const { return m_target; }
+    
+    // Connection count that gave the best throughput, 0 until enough samples were taken
+    int GetBestConnections() const;
+
+private:
+    // Private methods
+    void SetTarget(int target);
+    
+    // Member variables
+    int m_target;
+    int m_minimum;
+    int m_maximum;
+    int m_samples;
+    int m_holdSamples;       // Samples to wait before probing upwards again
+    bool m_increased;        // The last sample added a connection
+    bool m_failed;           // Errors reported since the last sample
+    long long m_lastRate;
+    long long m_bestRate;
+    int m_bestConnections;
+};
+
+#endif // CONCURRENCYCONTROLLER_H
@@ -0,0 +1,35 @@
+#ifndef CURLHANDLEPOOL_H
+#define CURLHANDLEPOOL_H
+
+#include <curl/curl.h>
+#include <mutex>
+#include <vector>
+
+// Reusable easy handles tied to one share object. Handles handed out by
+// Acquire share the DNS cache, TLS sessions, cookies and connections, so
+// requests to a host that was used before skip the lookup and handshakes.
+class CurlHandlePool {
+public:
+    // Constructor and destructor
+    CurlHandlePool();
+    ~CurlHandlePool();
+    
+    // Get a handle with default options and the share object attached
+    CURL* Acquire();
+    
+    // Give a handle back once its transfer has left the multi handle
+    void Release(CURL* curl);
+
+private:
+    // libcurl callbacks
+    static void LockCallback(CURL* curl, curl_lock_data data, curl_lock_access access, void* userptr);
+    static void UnlockCallback(CURL* curl, curl_lock_data data, void* userptr);
+    
+    // Member variables
+    CURLSH* m_share;
+    std::mutex m_shareMutexes[CURL_LOCK_DATA_LAST];
+    std::mutex m_poolMutex;
+    std::vector<CURL*> m_idleHandles;
+};
+
+#endif // CURLHANDLEPOOL_H
@@ -0,0 +1,90 @@
+#ifndef DISKWRITER_H
+#define DISKWRITER_H
+
+#include "Managers/FileWriter.h"
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// Writes received data to disk on its own thread, so a slow disk doesn't
+// stall the transfer engine. Data is copied into buffers from a fixed
+// arena; consecutive blocks of a file fill the same buffer, and buffers
+// end on aligned file offsets. When the arena is used up, Submit refuses
+// the data and the caller pauses until the space handler is called.
+class DiskWriter {
+public:
+    // Called on the writer thread when buffers are free again after a refused Submit
+    typedef std::function<void()> SpaceHandler;
+    
+    // Called once flushed data is on disk; false if a write of the file failed
+    typedef std::function<void(bool)> FlushHandler;
+    
+    // Constructor and destructor
+    DiskWriter(size_t bufferSize, size_t bufferCount);
+    ~DiskWriter();
+    
+    // Start and stop the writer thread; stopping writes out everything queued
+    void Start();
+    void Stop();
+    
+    void SetSpaceHandler(SpaceHandler handler);
+    
+    // Copy a block for writing at the given offset; false when there is no buffer space
+    bool Submit(const std::shared_ptr<FileWriter>& file, long long offset, const void* data, size_t length);
+    
+    // Call the handler once the data submitted for the file so far is on disk, without waiting for it.
+    // The handler runs on the writer thread, or right away when nothing of the file is buffered.
+    void FlushAsync(const std::shared_ptr<FileWriter>& file, FlushHandler onFlushed);
+    
+    // Blocks of the file not written yet, as (offset, length)
+    std::vector<std::pair<long long, long long>> GetPendingRanges(const std::shared_ptr<FileWriter>& file);
+
+private:
+    // One buffer of the arena
+    struct WriteBuffer {
+        std::shared_ptr<FileWriter> file;
+        long long offset;
+        size_t length;
+        size_t capacity;
+        char* data;
+    };
+    
+    // Flush waiting for the buffers that held data of its file when it was asked for
+    struct FlushWaiter {
+        std::shared_ptr<FileWriter> file;
+        std::vector<WriteBuffer*> buffers;
+        FlushHandler handler;
+    };
+    
+    // Private methods
+    void Run();
+    WriteBuffer* FindOpenBuffer(const FileWriter* file, long long offset);
+    size_t CountNeededBuffers(WriteBuffer* open, long long offset, size_t length) const;
+    void SealBuffers(const FileWriter* file);
+    
+    // Member variables
+    size_t m_bufferSize;
+    std::vector<char> m_arena;
+    std::vector<WriteBuffer> m_buffers;
+    std::vector<WriteBuffer*> m_freeBuffers;
+    std::vector<WriteBuffer*> m_openBuffers;   // Partly filled, still taking data
+    std::deque<WriteBuffer*> m_readyBuffers;   // Waiting for the writer thread
+    std::vector<WriteBuffer*> m_writingBuffers; // Being written
+    std::map<const FileWriter*, size_t> m_pending; // Buffers of each file not yet on disk
+    std::vector<FlushWaiter> m_flushWaiters;
+    bool m_spaceRequested;
+    bool m_running;
+    SpaceHandler m_spaceHandler;
+    
+    std::mutex m_mutex;
+    std::condition_variable m_workCondition;
+    std::thread m_thread;
+};
+
+#endif // DISKWRITER_H
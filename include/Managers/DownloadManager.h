@@ -4,7 +4,23 @@
 #include "Models/DownloadItem.h"
 #include "Models/AppSettings.h"
 #include "Database/DatabaseManager.h"
+#include "Managers/TransferEngine.h"
+#include "Managers/CurlHandlePool.h"
+#include "Managers/DiskWriter.h"
+#include "Managers/HashWorker.h"
+#include "Managers/DownloadTask.h"
+#include "Managers/MetadataProber.h"
+#include "Managers/Metalink.h"
+#include "Managers/ProgressBoard.h"
 #include <vector>
+#include <map>
+#include <set>
+#include <deque>
+#include <condition_variable>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <atomic>
 #include <wx/event.h>
 
 // Custom event for download operations
@@ -28,7 +44,8 @@ public:
     ~DownloadManager();
     
     // Public methods
-    int AddDownload(const wxString& url, const wxString& savePath);
+    int AddDownload(const wxString& url, const wxString& savePath, int connections = 0, const wxString& checksum = wxEmptyString,
+                    const std::vector<wxString>& mirrors = std::vector<wxString>());
     int AddYouTubeDownload(const wxString& url, const wxString& savePath, const wxString& title, const wxString& format);
     void StartDownload(int id);
     void StartDownloads(const std::vector<int>& ids);
@@ -40,23 +57,60 @@ public:
     void CancelDownloads(const std::vector<int>& ids);
     void DeleteDownload(int id);
     void DeleteDownloads(const std::vector<int>& ids);
+    void SetDownloadPriority(int id, DownloadPriority priority);
+    void SetDownloadsPriority(const std::vector<int>& ids, DownloadPriority priority);
     DownloadItem* GetDownloadById(int id);
-    const std::vector<DownloadItem>& GetDownloads() const;
+    std::vector<DownloadItem> GetDownloads() const;
+    
+    // Ids of the downloads whose name or URL contains the text, sorted
+    std::vector<int> SearchDownloads(const wxString& text);
+    
+    // Progress for the UI, sampled at its own frame rate without taking g_downloadMutex
+    bool GetProgress(int id, ProgressSnapshot& snapshot) const { return m_progress.Read(id, snapshot); }
+    
+    // True once after downloads were added, removed or changed state since the last call
+    bool TakeListChanged() { return m_listChanged.exchange(false); }
+    
+    // Lower-case host of a URL, as downloads are grouped per host
+    static wxString GetHostName(const wxString& url);
     
     // Speed limit methods
     void SetSpeedLimit(long limit);
     long GetSpeedLimit() const;
     
+    // Share of the speed limit for each priority (rates in KB/s, 0 = no minimum or no cap)
+    void SetPriorityBandwidth(DownloadPriority priority, int weight, long minRate, long maxRate);
+    
     // Settings methods
     void SaveSettings(const AppSettings& settings);
     const AppSettings& GetSettings() const;
     
 private:
     // Private methods
+    void InitEngine();
+    void ApplySpeedLimit();
+    void ApplyPriorityBandwidth();
     void Start();
     void Stop();
     void LoadDownloads();
+    int AddMetalinkDownloads(const wxString& source, const wxString& savePath, int connections);
+    void FetchMetalink(const wxString& source, const wxString& savePath, int connections);
+    int AddMetalinkFiles(const std::vector<MetalinkFile>& files, const wxString& savePath, int connections);
+    static wxString MakeValidFileName(const wxString& name);
+    int FindCompletedDownload(const wxString& url, const wxString& savePath);
+    void QueueDownload(DownloadItem* item);
+    long ScheduleDownloads();
+    std::deque<int>::iterator PickQueuedDownload(std::deque<int>& queue);
+    int CountActiveDownloads() const;
+    int CountHostConnections(const wxString& host) const;
+    int GetConnectionCount(const DownloadItem& item) const;
     void ProcessDownload(DownloadItem* item);
+    void ProcessYouTubeDownload(int id, const wxString& url, const wxString& filePath);
+    void OnTaskFinished(DownloadTask* task);
+    void OnProbeResult(const ProbeResult& result);
+    void AbortTask(int id, bool discard);
+    void SyncProgress();
+    void NotifyListChanged() { m_listChanged = true; }
     wxString TransformTvQuranUrl(const wxString& originalUrl);
     wxString EncodeURL(const wxString& url);
     
@@ -66,8 +120,29 @@ private:
     DatabaseManager* m_databaseManager;
     std::vector<DownloadItem> m_downloads;
     int m_nextId;
-    bool m_isRunning;
+    std::atomic<bool> m_isRunning;
+    std::thread m_dispatcherThread;
+    std::condition_variable m_schedulerCondition; // Signaled on every change that can admit a download
     long m_speedLimit; // in KB/s
+    
+    // Ready queue of QUEUED download ids per host, guarded by g_downloadMutex
+    std::map<wxString, std::deque<int>> m_hostQueues;
+    std::map<wxString, std::chrono::steady_clock::time_point> m_hostLastStart;
+    wxString m_lastScheduledHost; // Round-robin position
+    
+    // Transfers driven by the engine thread, guarded by g_downloadMutex
+    TransferEngine* m_transferEngine;
+    CurlHandlePool* m_handlePool;
+    DiskWriter* m_diskWriter;
+    HashWorker* m_hashWorker;
+    MetadataProber* m_prober;
+    RedirectCache* m_redirectCache;
+    std::map<int, std::shared_ptr<DownloadTask>> m_tasks;
+    std::set<int> m_youtubeDownloads;
+    
+    // Running progress published by the engine thread and the flag the UI polls for list changes
+    ProgressBoard m_progress;
+    std::atomic<bool> m_listChanged;
 };
 
 #endif // DOWNLOADMANAGER_H
@@ -0,0 +1,298 @@
+#ifndef DOWNLOADTASK_H
+#define DOWNLOADTASK_H
+
+#include "Models/DownloadItem.h"
+#include "Models/AppSettings.h"
+#include "Managers/ConcurrencyController.h"
+#include "Managers/FileWriter.h"
+#include "Managers/PieceJournal.h"
+#include "Managers/StreamHasher.h"
+#include "Managers/RedirectCache.h"
+#include "Managers/ProgressBoard.h"
+#include "Managers/RateEstimator.h"
+#include <curl/curl.h>
+#include <functional>
+#include <memory>
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <algorithm>
+
+// Forward declarations
+class TransferEngine;
+class CurlHandlePool;
+class DiskWriter;
+class HashWorker;
+class DownloadTask;
+
+// Server capabilities and validators taken from the last response headers
+struct RemoteFileInfo {
+    bool acceptRanges;
+    curl_off_t contentLength;
+    wxString etag;
+    wxString lastModified;
+    RedirectChain redirects;    // Redirects followed before this response
+    
+    RemoteFileInfo() : acceptRanges(false), contentLength(-1) {}
+};
+
+// One source of the file and how well it serves its ranges
+struct MirrorSource {
+    wxString url;           // As given by the user or the Metalink document
+    wxString requestUrl;    // Prepared for libcurl
+    wxString etag;          // First ETag the mirror sent; another one means its copy changed
+    int connections;        // Ranges being fetched from it
+    long long speed;        // Bytes per second of one connection, -1 until measured
+    bool dropped;           // Stalled or sent another file; not used again by this task
+    bool mismatched;        // Sent another file; left out of the saved mirror list
+    
+    MirrorSource() : connections(0), speed(-1), dropped(false), mismatched(false) {}
+};
+
+// Byte range fetched over its own connection in segmented mode.
+// The end moves down when another connection takes over part of the range.
+struct DownloadSegment {
+    DownloadTask* task;
+    curl_off_t start;                    // First byte of the range
+    std::atomic<curl_off_t> end;         // Last byte of the range (inclusive)
+    std::atomic<curl_off_t> downloaded;  // Bytes already written for this range
+    int retries;
+    bool verified;          // Server answered the range request with 206
+    size_t mirror;          // Index of the mirror the range is fetched from
+    bool changeMirror;      // The next attempt avoids the mirror of the last one
+    RemoteFileInfo info;    // Headers of the range response
+    curl_off_t sampleBytes; // Bytes written at the last mirror speed sample
+    std::chrono::steady_clock::time_point lastData; // Last time the server delivered data
+    StreamHasher pieceHasher{true}; // SHA-256 of the piece being received
+    bool pieceFailed;       // The connection was stopped by a piece that failed its hash
+    bool flushing;          // Parked until the bad piece is on disk, so the new bytes land after it
+    int pieceFailures;
+    CURL* curl;
+    char errorBuffer[CURL_ERROR_SIZE];
+};
+
+// Transfer state of one HTTP download. All methods except the progress
+// getters run on the TransferEngine thread.
+class DownloadTask : public std::enable_shared_from_this<DownloadTask> {
+public:
+    // Called on the engine thread when the task succeeds, fails or is aborted
+    typedef std::function<void(DownloadTask*)> FinishedHandler;
+    
+    // Constructor and destructor
+    DownloadTask(TransferEngine* engine, CurlHandlePool* pool, DiskWriter* diskWriter, const DownloadItem& item, const wxString& filePath,
+                 int connections, int maxConnections, FinishedHandler onFinished);
+    ~DownloadTask();
+    
+    // Control; an aborted task with discard drops its pieces, so the next start begins from zero
+    void Start();
+    void Abort(bool discard);
+    
+    // Thread-safe: move the transfers of the task to another bandwidth class
+    void SetBandwidthClass(int classId) { m_bandwidthClass = classId; }
+    
+    // Disk write backend for segmented transfers, set before Start
+    void SetWriteMode(WriteMode mode) { m_writeMode = mode; }
+    
+    // Redirects shared with other transfers, set before Start
+    void SetRedirectCache(RedirectCache* cache) { m_redirects = cache; }
+    
+    // Thread the file is read back on for the checksums, set before Start
+    void SetHashWorker(HashWorker* worker) { m_hashWorker = worker; }
+    
+    // Slot the progress is published into for the UI, set before Start
+    void SetProgressSlot(const std::shared_ptr<ProgressSlot>& slot) { m_progressSlot = slot; }
+    
+    // Results
+    int GetId() const { return m_id; }
+    bool IsSucceeded() const { return m_succeeded; }
+    bool IsAborted() const { return m_aborted; }
+    bool IsNotModified() const { return m_notModified; }
+    
+    // Validators of the file on the server, engine thread only
+    const wxString& GetETag() const { return m_etag; }
+    const wxString& GetLastModified() const { return m_lastModified; }
+    
+    // Digest of the downloaded file once it succeeded, empty if it couldn't be computed; engine thread only
+    wxString GetDigest(ChecksumType type) const { return m_hasher.GetDigest(type); }
+    
+    // Mirrors besides the main URL worth keeping for the next attempt; engine thread only
+    std::vector<wxString> GetMirrors() const;
+    
+    // Connection count with the best throughput, 0 when unknown; engine thread only
+    int GetBestConnections() const { return m_controller.GetBestConnections(); }
+    
+    // Open connections, safe to read from any thread
+    int GetConnectionCount() const { return std::max(m_activeSegments.load(), 1); }
+    
+    // Progress, safe to read from any thread
+    curl_off_t GetDownloaded() const { return m_downloaded; }
+    curl_off_t GetTotalSize() const { return m_totalSize; }
+    curl_off_t GetSpeed() const { return m_speed; }
+    long long GetEta() const { return m_eta; }
+    std::vector<SegmentProgress> GetSegmentProgress() const;
+    
+    // Request setup shared with the metadata probes
+    static struct curl_slist* BuildRequestHeaders(const wxString& originalUrl, const wxString& processedUrl);
+    static wxString PrepareUrl(const wxString& url);
+
+private:
+    // Transfer phases
+    enum class Phase {
+        IDLE,
+        PROBING,
+        SINGLE,
+        SEGMENTED,
+        FINISHED
+    };
+    
+    // Probe
+    void StartProbe();
+    void OnProbeDone(CURLcode result);
+    
+    // Single connection
+    void StartSingleStream();
+    void OnSingleStreamDone(CURLcode result);
+    
+    // Several connections
+    bool StartSegments();
+    bool StartSegment(DownloadSegment* segment);
+    void StopSegment(DownloadSegment* segment);
+    void OnSegmentDone(DownloadSegment* segment, CURLcode result);
+    bool StealWork();
+    DownloadSegment* AddSegment(curl_off_t start, curl_off_t end);
+    
+    // Mirror selection
+    size_t PickMirror(size_t avoid) const;
+    bool DropMirror(size_t index, bool mismatched);
+    bool CheckMirror(DownloadSegment* segment);
+    void SampleMirrors(long long elapsed);
+    
+    // Connection count tuning
+    void ScheduleControl();
+    void OnControlTimer();
+    void ApplyConnectionTarget();
+    bool ResumeParkedSegment();
+    void ParkSegment();
+    
+    // Journal
+    void ScheduleJournal();
+    void SaveJournal();
+    
+    // Checksums
+    void HashBlock(curl_off_t offset, const void* data, size_t length);
+    void CatchUpHash(curl_off_t budget);
+    void OnHashCaughtUp(const StreamHasher& hasher, const std::shared_ptr<std::atomic<bool>>& cancel, bool success);
+    void DropHash(curl_off_t offset);
+    curl_off_t GetHashLimit() const;
+    static bool ReadBackHash(const wxString& filePath, StreamHasher& hasher, curl_off_t limit, const std::atomic<bool>& cancel);
+    bool CheckPieces(DownloadSegment* segment, curl_off_t offset, const void* data, size_t length);
+    curl_off_t AlignToPiece(curl_off_t offset) const;
+    
+    // Resume
+    curl_off_t GetResumeOffset() const;
+    bool IsCompleteOnDisk() const;
+    wxString GetIfRangeValidator() const;
+    bool ValidatorsMatch(const RemoteFileInfo& info) const;
+    void AdoptValidators(const RemoteFileInfo& info);
+    curl_off_t GetContiguousBytes() const;
+    bool TruncateFile(curl_off_t length);
+    
+    // Helpers
+    void FlushFile(std::function<void(bool)> then);
+    bool HasFlushingSegments() const;
+    void Finish(bool success);
+    void OnFinishFlushed(bool success);
+    void OnFinishHashed(bool success);
+    void AddDownloaded(curl_off_t bytes);
+    void UpdateRate();
+    void PublishProgress();
+    CURL* CreateHandle(char* errorBuffer);
+    wxString GetRequestUrl(size_t mirror) const;
+    void RecordRedirect(CURL* curl, size_t mirror, const RemoteFileInfo& info, long responseCode);
+    
+    // libcurl callbacks
+    static size_t OnWrite(void* contents, size_t size, size_t nmemb, void* userp);
+    static size_t OnSegmentWrite(void* contents, size_t size, size_t nmemb, void* userp);
+    static size_t OnHeader(char* buffer, size_t size, size_t nitems, void* userdata);
+    static size_t OnProbeWrite(void* contents, size_t size, size_t nmemb, void* userp);
+    static int OnProgress(void* clientp, curl_off_t dltotal, curl_off_t dlnow, curl_off_t ultotal, curl_off_t ulnow);
+    
+    // Member variables
+    TransferEngine* m_engine;
+    CurlHandlePool* m_pool;
+    DiskWriter* m_diskWriter;
+    FinishedHandler m_onFinished;
+    int m_id;
+    wxString m_url;
+    wxString m_processedUrl;
+    wxString m_filePath;
+    int m_connections;
+    std::atomic<int> m_bandwidthClass;
+    struct curl_slist* m_headers;
+    RedirectCache* m_redirects;
+    
+    Phase m_phase;
+    bool m_succeeded;
+    bool m_aborted;
+    bool m_discard;            // Aborted by a cancel: the journal and the file's data are dropped
+    RemoteFileInfo m_info;
+    
+    // Resume
+    wxString m_etag;
+    wxString m_lastModified;
+    curl_off_t m_keptBytes;    // Bytes at the start of the file known to hold data
+    curl_off_t m_resumeFrom;   // Offset the current request starts at
+    bool m_rangeChecked;       // Response status checked before the first write
+    curl_off_t m_knownSize;    // Size recorded when the item last completed
+    bool m_conditional;        // The probe asks for the file only if it changed
+    bool m_notModified;        // The server answered 304; the file was left untouched
+    struct curl_slist* m_resumeHeaders;
+    
+    // Target file shared by all connections
+    std::shared_ptr<FileWriter> m_writer;
+    WriteMode m_writeMode;
+    
+    // Probe or single-connection transfer
+    CURL* m_curl;
+    int m_retries;
+    char m_errorBuffer[CURL_ERROR_SIZE];
+    
+    // Segmented transfer
+    std::vector<std::unique_ptr<DownloadSegment>> m_segments;
+    mutable std::mutex m_segmentMutex; // Guards m_segments against progress readers
+    std::atomic<int> m_activeSegments;
+    
+    // Adaptive connection count
+    ConcurrencyController m_controller;
+    std::chrono::steady_clock::time_point m_controlTime;
+    curl_off_t m_controlBytes;
+    
+    // Pieces on disk, engine thread only
+    PieceJournal m_journal;
+    bool m_journalScheduled;
+    
+    // Checksums of the file in order, engine thread only
+    StreamHasher m_hasher;
+    HashWorker* m_hashWorker;
+    std::shared_ptr<std::atomic<bool>> m_hashCancel; // Set while a read-back runs on the worker
+    curl_off_t m_hashTarget;           // Offset the running read-back hashes up to
+    std::function<void()> m_hashDone; // Continues Finish once the whole file is hashed
+    
+    // Mirrors, the main URL first, engine thread only
+    std::vector<MirrorSource> m_mirrors;
+    
+    // Piece hashes of Metalink downloads
+    curl_off_t m_pieceLength;         // 0 when pieces are not checked
+    std::vector<wxString> m_pieceHashes;
+    
+    // Progress
+    std::atomic<curl_off_t> m_downloaded;
+    std::atomic<curl_off_t> m_totalSize;
+    std::atomic<curl_off_t> m_speed;
+    std::atomic<long long> m_eta;  // Seconds left, -1 while unknown
+    RateEstimator m_rate;          // Engine thread only
+    std::shared_ptr<ProgressSlot> m_progressSlot; // Published on the engine thread only
+};
+
+#endif // DOWNLOADTASK_H
@@ -0,0 +1,61 @@
+#ifndef FILEWRITER_H
+#define FILEWRITER_H
+
+#include <wx/string.h>
+#include <cstddef>
+#include <atomic>
+#include <mutex>
+
+// Target file of a download, written at explicit offsets through one
+// descriptor shared by all connections. Space is reserved up front when
+// the size is known so large files are not grown piece by piece. A fully
+// allocated file can also be mapped into memory, so writes become plain
+// copies without a system call per block.
+class FileWriter {
+public:
+    // Constructor and destructor
+    FileWriter();
+    ~FileWriter();
+    
+    // Open or create the file; truncate drops its current content
+    bool Open(const wxString& path, bool truncate);
+    void Close();
+    bool IsOpen() const { return m_fd >= 0; }
+    
+    // Reserve space for the whole file; sparse when the file system can't allocate
+    bool Preallocate(long long size);
+    
+    // Map the whole file; only possible after Preallocate reserved real blocks
+    bool Map(long long size);
+    bool IsMapped() const { return m_map != nullptr; }
+    void Unmap();
+    
+    // Start writing back a finished range of the mapping and drop its pages
+    void ReleaseRange(long long offset, long long length);
+    
+    // Write a block at an absolute offset
+    bool Write(long long offset, const void* data, size_t length);
+    
+    // Read back a block that is already in the file; false on a short read
+    bool Read(long long offset, void* data, size_t length);
+    
+    // Cut the file to the given length
+    bool Truncate(long long length);
+    
+    // A write failed since the file was opened
+    bool HasFailed() const { return m_failed; }
+
+private:
+    // Member variables
+    int m_fd;
+    wxString m_path;
+    std::atomic<bool> m_failed;
+    bool m_allocated;   // Preallocate reserved blocks instead of leaving the file sparse
+    char* m_map;
+    long long m_mapSize;
+#ifdef _WIN32
+    std::mutex m_mutex; // Guards the shared file position used by _write
+#endif
+};
+
+#endif // FILEWRITER_H
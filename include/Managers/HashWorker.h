@@ -0,0 +1,41 @@
+#ifndef HASHWORKER_H
+#define HASHWORKER_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+// Runs jobs that read files back from disk, such as checksum catch-ups,
+// one at a time on its own thread so they don't stall the transfer
+// engine or the disk writer. Jobs post their results back themselves.
+class HashWorker {
+public:
+    typedef std::function<void()> Job;
+    
+    // Constructor and destructor
+    HashWorker();
+    ~HashWorker();
+    
+    // Start and stop the worker thread; stopping drops the jobs not started yet
+    void Start();
+    void Stop();
+    
+    // Queue a job for the worker thread
+    void Post(Job job);
+
+private:
+    // Private methods
+    void Run();
+    
+    // Member variables
+    std::deque<Job> m_jobs;
+    bool m_running;
+    
+    std::mutex m_mutex;
+    std::condition_variable m_condition;
+    std::thread m_thread;
+};
+
+#endif // HASHWORKER_H
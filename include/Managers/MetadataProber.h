@@ -0,0 +1,83 @@
+#ifndef METADATAPROBER_H
+#define METADATAPROBER_H
+
+#include "Managers/RedirectCache.h"
+#include <wx/string.h>
+#include <curl/curl.h>
+#include <functional>
+#include <deque>
+#include <map>
+#include <memory>
+
+// Forward declarations
+class TransferEngine;
+class CurlHandlePool;
+
+// What the headers of a URL tell before its download starts
+struct ProbeResult {
+    int id;
+    bool succeeded;
+    long long size;         // -1 when the server doesn't say
+    bool acceptRanges;
+    wxString fileName;      // From Content-Disposition, empty when not sent
+    wxString finalUrl;      // Where the redirects ended
+    
+    ProbeResult() : id(0), succeeded(false), size(-1), acceptRanges(false) {}
+};
+
+// Fetches the headers of many URLs at once through the transfer engine,
+// with HEAD or, for servers that refuse it, a one-byte ranged GET.
+class MetadataProber {
+public:
+    // Called on the engine thread once for every probed URL
+    typedef std::function<void(const ProbeResult&)> ResultHandler;
+    
+    // Constructor and destructor; the engine must be stopped before the prober is destroyed
+    MetadataProber(TransferEngine* engine, CurlHandlePool* pool, RedirectCache* redirects, ResultHandler onResult);
+    ~MetadataProber();
+    
+    // Thread-safe: queue a URL
+    void Probe(int id, const wxString& url);
+    
+    // Thread-safe: drop the probe of a download that started or was deleted
+    void Cancel(int id);
+
+private:
+    // One URL being probed
+    struct Request {
+        int id;
+        wxString url;
+        bool useGet;        // The server refused HEAD
+        CURL* curl;
+        struct curl_slist* headers;
+        ProbeResult result;
+        wxString contentLength;
+        wxString contentRange;
+        wxString disposition;
+        RedirectChain redirects;
+        char errorBuffer[CURL_ERROR_SIZE];
+    };
+    
+    // Private methods, engine thread only
+    void StartRequests();
+    bool StartRequest(Request* request);
+    void OnRequestDone(int id, CURLcode result);
+    void ReleaseRequest(Request* request);
+    static wxString ParseFileName(const wxString& disposition);
+    
+    // libcurl callbacks
+    static size_t OnHeader(char* buffer, size_t size, size_t nitems, void* userdata);
+    static size_t OnWrite(void* contents, size_t size, size_t nmemb, void* userp);
+    
+    // Member variables
+    TransferEngine* m_engine;
+    CurlHandlePool* m_pool;
+    RedirectCache* m_redirects;
+    ResultHandler m_onResult;
+    
+    // Probes waiting for a free slot and probes in the engine, engine thread only
+    std::deque<std::unique_ptr<Request>> m_waiting;
+    std::map<int, std::unique_ptr<Request>> m_running;
+};
+
+#endif // METADATAPROBER_H
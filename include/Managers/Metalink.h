@@ -0,0 +1,52 @@
+#ifndef METALINK_H
+#define METALINK_H
+
+#include <wx/string.h>
+#include <curl/curl.h>
+#include <vector>
+
+class wxXmlNode;
+class wxXmlDocument;
+
+// One file described by a Metalink document
+struct MetalinkFile {
+    wxString name;
+    long long size;
+    std::vector<wxString> urls;         // Mirrors, most preferred first
+    wxString checksum;                  // Whole-file digest as "sha256:<hex>" or "md5:<hex>"
+    long long pieceLength;              // 0 when there are no usable piece hashes
+    std::vector<wxString> pieceHashes;  // SHA-256 of each piece in hex
+    
+    MetalinkFile() : size(-1), pieceLength(0) {}
+};
+
+// Reader for Metalink 4 (.meta4, RFC 5854) and Metalink 3 (.metalink)
+// documents, from a local file or from the data of an HTTP URL the
+// caller downloaded with a handle set up by PrepareFetch.
+class Metalink {
+public:
+    // The source names a Metalink document by its extension
+    static bool IsMetalink(const wxString& source);
+    
+    // The source is an HTTP URL rather than a local file
+    static bool IsRemote(const wxString& source);
+    
+    // Read the files of a local document; false when it can't be loaded or lists no usable file
+    static bool Load(const wxString& source, std::vector<MetalinkFile>& files);
+    
+    // Read the files of a downloaded document, the same way
+    static bool Parse(const wxString& source, const std::vector<char>& data, std::vector<MetalinkFile>& files);
+    
+    // Configure an easy handle to download a document into data
+    static void PrepareFetch(CURL* curl, const wxString& url, std::vector<char>* data);
+
+private:
+    // Private methods
+    static bool ReadDocument(const wxXmlDocument& document, const wxString& source, std::vector<MetalinkFile>& files);
+    static bool ReadFile(wxXmlNode* node, MetalinkFile& file);
+    static void ReadHashes(wxXmlNode* node, MetalinkFile& file);
+    static void ReadUrls(wxXmlNode* node, std::vector<std::pair<long, wxString>>& urls, bool version3);
+    static wxString GetHashType(const wxString& type);
+};
+
+#endif // METALINK_H
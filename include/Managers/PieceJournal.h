@@ -0,0 +1,67 @@
+#ifndef PIECEJOURNAL_H
+#define PIECEJOURNAL_H
+
+#include "Models/DownloadItem.h"
+#include <wx/string.h>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+// Bitmap of the fixed-size pieces of a download that are on disk, kept in
+// a sidecar file next to the target (<file>.admj). It is saved on a timer
+// while the download runs, so after a stop or a crash only the missing
+// pieces have to be fetched again. Not thread-safe.
+class PieceJournal {
+public:
+    // Constructor
+    PieceJournal();
+    
+    // Sidecar path of a target file
+    static wxString GetPath(const wxString& filePath);
+    
+    // Read the sidecar of a target file; false if there is none or it is damaged
+    bool Load(const wxString& filePath);
+    
+    // Write the sidecar through a temporary file, so a crash keeps the old copy
+    bool Save(const wxString& filePath) const;
+    
+    // Forget all pieces and delete the sidecar
+    void Discard(const wxString& filePath);
+    
+    // Start an empty bitmap for a file of the given size and version
+    void Reset(long long totalSize, const wxString& etag, const wxString& lastModified);
+    
+    // Mark the pieces fully inside the written ranges ([start, start + downloaded)),
+    // except those touching a range still waiting to be written (offset, length)
+    void MarkWritten(const std::vector<SegmentProgress>& ranges, const std::vector<std::pair<long long, long long>>& pending);
+    
+    // State
+    bool IsValid() const { return m_totalSize > 0; }
+    long long GetTotalSize() const { return m_totalSize; }
+    const wxString& GetETag() const { return m_etag; }
+    const wxString& GetLastModified() const { return m_lastModified; }
+    long long GetCompletedBytes() const;
+    long long GetContiguousBytes() const;
+    bool IsComplete() const { return IsValid() && GetCompletedBytes() == m_totalSize; }
+    
+    // Runs of finished or missing pieces as ranges with inclusive ends
+    std::vector<SegmentProgress> GetCompletedRanges() const;
+    std::vector<SegmentProgress> GetMissingRanges() const;
+
+private:
+    // Private methods
+    size_t GetPieceCount() const;
+    long long GetPieceLength(size_t piece) const;
+    bool HasPiece(size_t piece) const;
+    void SetPiece(size_t piece);
+    std::vector<SegmentProgress> GetRanges(bool completed) const;
+    
+    // Member variables
+    long long m_totalSize;
+    long long m_pieceSize;
+    wxString m_etag;
+    wxString m_lastModified;
+    std::vector<uint8_t> m_bitmap;
+};
+
+#endif // PIECEJOURNAL_H
@@ -0,0 +1,64 @@
+#ifndef PROGRESSBOARD_H
+#define PROGRESSBOARD_H
+
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+
+// Live progress of one download, read as one consistent set of values
+struct ProgressSnapshot {
+    long long downloaded;
+    long long totalSize;
+    long long speed;
+    long long eta;          // Seconds left, -1 while unknown
+    int connections;
+    
+    ProgressSnapshot() : downloaded(0), totalSize(0), speed(0), eta(-1), connections(0) {}
+};
+
+// Progress of one download behind a sequence lock. One thread publishes,
+// any thread reads; a reader that overlaps a publish reads again instead
+// of blocking the publisher.
+class ProgressSlot {
+public:
+    // Constructor
+    ProgressSlot();
+    
+    // Single publisher: replace the values
+    void Publish(const ProgressSnapshot& snapshot);
+    
+    // Any thread: the last published values
+    ProgressSnapshot Read() const;
+
+private:
+    // Member variables
+    std::atomic<unsigned> m_sequence;  // Odd while a publish is in progress
+    std::atomic<long long> m_downloaded;
+    std::atomic<long long> m_totalSize;
+    std::atomic<long long> m_speed;
+    std::atomic<long long> m_eta;
+    std::atomic<int> m_connections;
+};
+
+// Slots of the running downloads. Transfers publish into their slot as often
+// as they like; the UI samples the slots at its own frame rate, so the cost
+// on both sides doesn't grow with the number of progress callbacks.
+class ProgressBoard {
+public:
+    // Fresh slot for a starting download, replacing the one of an earlier run
+    std::shared_ptr<ProgressSlot> Open(int id);
+    
+    // Forget the slot of a finished download
+    void Close(int id);
+    
+    // Last values of a running download; false when it has no slot
+    bool Read(int id, ProgressSnapshot& snapshot) const;
+
+private:
+    // Member variables
+    mutable std::mutex m_mutex;  // Guards the map only, never held while publishing
+    std::map<int, std::shared_ptr<ProgressSlot>> m_slots;
+};
+
+#endif // PROGRESSBOARD_H
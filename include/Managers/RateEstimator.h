@@ -0,0 +1,56 @@
+#ifndef RATEESTIMATOR_H
+#define RATEESTIMATOR_H
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+
+// Speed and time left of one download, fed with its byte count as data
+// arrives. The speed is an EWMA of the rate over a short sliding window;
+// a history of older samples, thinned out as the transfer goes on, keeps
+// the ETA from following every dip. Memory is fixed whatever the length
+// of the transfer. Not thread-safe.
+class RateEstimator {
+public:
+    typedef std::chrono::steady_clock Clock;
+    
+    // Constructor
+    RateEstimator();
+    
+    // Start over from a byte count, e.g. when a transfer restarts
+    void Reset(long long bytes, Clock::time_point now = Clock::now());
+    
+    // Record the byte count; only takes a sample once per tick
+    void AddSample(long long bytes, Clock::time_point now = Clock::now());
+    
+    // Smoothed bytes per second, 0 before the first tick
+    long long GetRate() const;
+    
+    // Seconds until the remaining bytes are in, -1 while unknown
+    long long GetEta(long long remaining) const;
+
+private:
+    // Byte count at a point in time
+    struct Sample {
+        Clock::time_point time;
+        long long bytes;
+    };
+    
+    static constexpr size_t WINDOW_SIZE = 6;    // Ticks in the sliding window, plus its start
+    static constexpr size_t HISTORY_SIZE = 64;
+    
+    // Private methods
+    void AddToHistory(const Sample& sample);
+    
+    // Member variables
+    std::array<Sample, WINDOW_SIZE> m_window;   // Ring of the last ticks
+    size_t m_windowStart;
+    size_t m_windowCount;
+    std::array<Sample, HISTORY_SIZE> m_history; // Oldest first, every m_historyStep ticks
+    size_t m_historyCount;
+    long long m_historyStep;
+    long long m_ticks;
+    double m_rate;                              // EWMA, -1 before the first tick
+};
+
+#endif // RATEESTIMATOR_H
@@ -0,0 +1,66 @@
+#ifndef REDIRECTCACHE_H
+#define REDIRECTCACHE_H
+
+#include <wx/string.h>
+#include <chrono>
+#include <map>
+#include <mutex>
+
+// Freshness of the redirects in one response, fed with its header lines
+// as libcurl follows them.
+class RedirectChain {
+public:
+    // Constructor
+    RedirectChain();
+    
+    // Take the next header line; status lines start a new hop
+    void AddHeader(const wxString& header);
+    
+    // Redirects followed so far
+    int GetHops() const { return m_hops; }
+    
+    // Seconds the whole chain may be reused, 0 when any hop forbids it
+    long long GetTtl() const;
+
+private:
+    // Member variables
+    int m_hops;
+    long long m_ttl;        // Shortest lifetime of the finished hops, -1 before the first
+    bool m_inRedirect;      // The headers belong to a redirect response
+    long long m_hopTtl;     // Lifetime of the current redirect
+    bool m_hopNoStore;      // The current redirect must not be reused
+};
+
+// Original URL to final URL after redirects, shared by every transfer.
+// Permanent redirects live longer than temporary ones, Cache-Control on a
+// redirect overrides both, and an entry is dropped once its endpoint fails.
+// Safe to use from any thread.
+class RedirectCache {
+public:
+    // Final URL of a URL, or the URL itself when no fresh entry exists
+    wxString Resolve(const wxString& url);
+    
+    // Remember where a request ended after the given chain of redirects
+    void Store(const wxString& url, const wxString& finalUrl, const RedirectChain& chain);
+    
+    // Forget a URL whose endpoint returned an error
+    void Invalidate(const wxString& url);
+
+private:
+    typedef std::chrono::steady_clock Clock;
+    
+    // One resolved URL
+    struct Entry {
+        wxString finalUrl;
+        Clock::time_point expires;
+    };
+    
+    // Private methods
+    void RemoveExpired(Clock::time_point now);
+    
+    // Member variables
+    std::mutex m_mutex;
+    std::map<wxString, Entry> m_entries;
+};
+
+#endif // REDIRECTCACHE_H
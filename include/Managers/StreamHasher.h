@@ -0,0 +1,67 @@
+#ifndef STREAMHASHER_H
+#define STREAMHASHER_H
+
+#include <wx/string.h>
+#include <cstddef>
+#include <cstdint>
+
+// Checksum algorithms a download can be verified with
+enum class ChecksumType {
+    NONE,
+    SHA256,
+    MD5,
+    CRC32C
+};
+
+// SHA-256, MD5 and CRC32C of a file computed while it is downloaded.
+// Data must be fed in file order. SHA-256 uses the SHA extensions and
+// CRC32C the SSE4.2 CRC instruction when the processor has them.
+class StreamHasher {
+public:
+    // Constructor; piece checks only need SHA-256
+    explicit StreamHasher(bool sha256Only = false);
+    
+    // Start again from the first byte
+    void Reset();
+    
+    // Hash the next block of the file
+    void Update(const void* data, size_t length);
+    
+    // Complete the digests; Update must not be called afterwards
+    void Finish();
+    
+    // Bytes hashed so far
+    long long GetLength() const { return m_length; }
+    
+    // Lower-case hex digest, empty until Finish
+    wxString GetDigest(ChecksumType type) const;
+    
+    // Read "sha256:<hex>", "md5:<hex>", "crc32c:<hex>" or a bare hex digest recognized by its length
+    static bool ParseChecksum(const wxString& text, ChecksumType& type, wxString& digest);
+
+private:
+    // Private methods
+    void UpdateSha256(const uint8_t* data, size_t length);
+    void UpdateMd5(const uint8_t* data, size_t length);
+    
+    // Member variables
+    long long m_length;
+    bool m_finished;
+    bool m_sha256Only;
+    
+    uint32_t m_sha256[8];
+    uint8_t m_sha256Block[64];
+    size_t m_sha256Used;
+    
+    uint32_t m_md5[4];
+    uint8_t m_md5Block[64];
+    size_t m_md5Used;
+    
+    uint32_t m_crc32c;
+    
+    wxString m_sha256Digest;
+    wxString m_md5Digest;
+    wxString m_crc32cDigest;
+};
+
+#endif // STREAMHASHER_H
@@ -0,0 +1,114 @@
+#ifndef TRANSFERENGINE_H
+#define TRANSFERENGINE_H
+
+#include "Managers/BandwidthLimiter.h"
+#include <curl/curl.h>
+#include <functional>
+#include <map>
+#include <set>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <vector>
+#include <chrono>
+
+// Event loop that drives every active transfer from a single thread.
+// Easy handles are added to one curl multi handle and serviced through
+// curl_multi_socket_action, with socket readiness reported by epoll on
+// Linux and by curl_multi_poll elsewhere.
+class TransferEngine {
+public:
+    // Called on the engine thread once a transfer has left the multi handle
+    typedef std::function<void(CURL*, CURLcode)> CompletionHandler;
+    
+    // Constructor and destructor
+    TransferEngine();
+    ~TransferEngine();
+    
+    // Start and stop the engine thread
+    void Start();
+    void Stop();
+    
+    // Thread-safe: add a configured easy handle to the loop, immediately when called on the engine thread
+    void AddTransfer(CURL* curl, CompletionHandler onDone);
+    
+    // Thread-safe: run a function on the engine thread
+    void Post(std::function<void()> task);
+    void PostDelayed(long delayMs, std::function<void()> task);
+    
+    // Engine thread only: take a transfer out of the loop without running its handler
+    void RemoveTransfer(CURL* curl);
+    
+    // Thread-safe: limit the combined receive rate of all transfers (0 = unlimited)
+    void SetRateLimit(long long bytesPerSecond, long long burstBytes);
+    
+    // Thread-safe: cap the connections libcurl opens to one host; extra transfers wait in the multi handle
+    void SetMaxHostConnections(long maxConnections);
+    
+    // Thread-safe: configure a bandwidth class (rates in bytes per second, 0 = none)
+    void SetBandwidthClass(int classId, int weight, long long minRate, long long maxRate);
+    
+    // Engine thread only, from a write callback: false means return CURL_WRITEFUNC_PAUSE,
+    // the engine resumes the transfer once its class has tokens again
+    bool AcquireBandwidth(CURL* curl, int classId, size_t bytes);
+    
+    // Engine thread only: return bandwidth taken for data the write callback then refused,
+    // so it isn't charged twice when libcurl delivers it again
+    void ReturnBandwidth(int classId, size_t bytes);
+    
+    // Engine thread only, from a write callback that returns CURL_WRITEFUNC_PAUSE because
+    // the disk writer is full; the transfer waits for ResumeBufferWaiters
+    void WaitForBuffers(CURL* curl);
+    
+    // Thread-safe: continue the transfers waiting for disk writer space
+    void ResumeBufferWaiters();
+    
+    // Engine thread only: the transfer waits for bandwidth or disk writer space, not for its server
+    bool IsPaused(CURL* curl) const;
+    
+    // True when called from the engine thread
+    bool IsEngineThread() const;
+
+private:
+    typedef std::chrono::steady_clock Clock;
+    
+    // Private methods
+    void Run();
+    void Wakeup();
+    void RunPendingTasks();
+    void RunDueTimers();
+    void CheckCompleted();
+    void ResumePausedTransfers();
+    long GetWaitTimeout();
+    
+    // libcurl callbacks
+    static int SocketCallback(CURL* curl, curl_socket_t socket, int what, void* userp, void* socketp);
+    static int TimerCallback(CURLM* multi, long timeoutMs, void* userp);
+    
+    // Member variables
+    CURLM* m_multi;
+    std::thread m_thread;
+    std::atomic<bool> m_running;
+    int m_epollFd;
+    int m_wakeFd;
+    
+    // Transfers owned by the loop, engine thread only
+    std::map<CURL*, CompletionHandler> m_handlers;
+    std::set<CURL*> m_failedAdds; // Refused by the multi handle, failure not reported yet
+    
+    // Bandwidth shared by all transfers; paused handles are engine thread only
+    BandwidthLimiter m_limiter;
+    std::map<CURL*, int> m_pausedHandles; // Class of each paused transfer
+    std::set<CURL*> m_bufferWaiters;      // Transfers paused by a full disk writer
+    
+    // libcurl timeout, engine thread only
+    bool m_curlTimerArmed;
+    Clock::time_point m_curlDeadline;
+    
+    // Work queued from other threads
+    std::mutex m_taskMutex;
+    std::vector<std::function<void()>> m_pendingTasks;
+    std::multimap<Clock::time_point, std::function<void()>> m_timers;
+};
+
+#endif // TRANSFERENGINE_H
@@ -3,6 +3,19 @@
 
 #include <wx/string.h>
 
+// How segmented downloads write to disk
+enum class WriteMode {
+    BUFFERED,   // Copies handed to the disk writer thread
+    MAPPED      // Copies straight into a memory mapping of the file
+};
+
+// Share of the speed limit given to one download priority
+struct PriorityBandwidth {
+    int weight;
+    int minRate;    // Guaranteed KB/s, 0 = none
+    int maxRate;    // Cap in KB/s, 0 = none
+};
+
 class AppSettings {
 public:
     // Constructor and destructor
@@ -15,6 +28,14 @@ public:
     // Settings
     wxString defaultSavePath;
     int maxSimultaneousDownloads;
+    int maxConnectionsPerDownload;
+    int maxConnectionsPerHost;
+    int hostRequestInterval;    // Minimum milliseconds between downloads started on one host
+    WriteMode writeMode;
+    int speedLimitBurst;        // Data allowed above the speed limit after an idle period, in milliseconds of the limit
+    PriorityBandwidth highPriority;
+    PriorityBandwidth normalPriority;
+    PriorityBandwidth lowPriority;
     bool showNotifications;
     bool minimizeToTray;
     bool startWithWindows;
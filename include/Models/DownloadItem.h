@@ -1,6 +1,7 @@
 #pragma once
 
 #include <wx/wx.h>
+#include <vector>
 
 // إعلان مسبق للفئات
 class MainFrame;
@@ -12,7 +13,22 @@ enum class DownloadStatus {
     PAUSED,
     COMPLETED,
     ERROR,
-    CANCELED
+    CANCELED,
+    QUEUED      // بانتظار مكان شاغر ضمن الحد الأقصى للتنزيلات المتزامنة
+};
+
+// أولوية التنزيل، وكل أولوية فئة مستقلة في توزيع عرض النطاق
+enum class DownloadPriority {
+    LOW,
+    NORMAL,
+    HIGH
+};
+
+// تقدم جزء واحد من تنزيل متعدد الاتصالات
+struct SegmentProgress {
+    long long start;        // أول بايت في الجزء
+    long long end;          // آخر بايت في الجزء
+    long long downloaded;   // عدد البايتات التي تم تنزيلها من الجزء
 };
 
 struct DownloadItem {
@@ -32,6 +48,29 @@ struct DownloadItem {
     double downloadedSize;  // حجم ما تم تنزيله
     double speed;
     wxString dateAdded;
+    int connections;        // عدد الاتصالات المتوازية (0 = القيمة الافتراضية من الإعدادات)
+    DownloadPriority priority;
+    
+    // محددات نسخة الملف على الخادم للتحقق قبل الاستئناف
+    wxString etag;
+    wxString lastModified;
+    
+    // المجموع الاختباري المتوقع بصيغة "sha256:<hex>" أو ما يشابهها، وملخصات الملف بعد اكتماله
+    wxString expectedChecksum;
+    wxString sha256;
+    wxString md5;
+    wxString crc32c;
+    
+    // روابط بديلة للملف نفسه، وبصمات SHA-256 لأجزائه إن وُجدت (من ملفات Metalink)
+    std::vector<wxString> mirrors;
+    long long pieceLength;
+    std::vector<wxString> pieceHashes;
+    
+    // هل يقبل الخادم طلبات النطاقات؛ لا تصبح false إلا بعد فحص ترويسات الرابط
+    bool acceptRanges;
+    
+    // أجزاء التنزيل الجارية (فارغة عند استخدام اتصال واحد)
+    std::vector<SegmentProgress> segments;
     
     // بيانات إضافية لتنزيلات يوتيوب
     bool isYouTube;         // هل هذا تنزيل من يوتيوب
@@ -2,24 +2,30 @@
 #define DOWNLOADDIALOG_H
 
 #include <wx/dialog.h>
+#include <vector>
 
 // Forward declarations
 class wxTextCtrl;
 class wxButton;
+class wxSpinCtrl;
 
 // Download dialog class
 class DownloadDialog : public wxDialog {
 public:
     // Constructor and destructor
-    DownloadDialog(wxWindow* parent);
+    DownloadDialog(wxWindow* parent, int defaultConnections = 1);
     
-    // Get URL and save path
-    wxString GetURL() const;
+    // Get URLs, save path, connection count, expected checksum and mirrors
+    std::vector<wxString> GetURLs() const;
     wxString GetSavePath() const;
+    int GetConnections() const;
+    wxString GetChecksum() const;
+    std::vector<wxString> GetMirrors() const;
     
 private:
     // Private methods
     void CreateUI();
+    static std::vector<wxString> SplitLines(const wxString& text);
     
     // Event handlers
     void OnBrowse(wxCommandEvent& event);
@@ -28,6 +34,10 @@ private:
     // Member variables
     wxTextCtrl* m_urlCtrl;
     wxTextCtrl* m_savePathCtrl;
+    wxSpinCtrl* m_connectionsCtrl;
+    wxTextCtrl* m_checksumCtrl;
+    wxTextCtrl* m_mirrorsCtrl;
+    int m_defaultConnections;
 };
 
 #endif // DOWNLOADDIALOG_H
@@ -0,0 +1,57 @@
+#ifndef DOWNLOADLISTCTRL_H
+#define DOWNLOADLISTCTRL_H
+
+#include <wx/listctrl.h>
+#include "UI/DownloadListModel.h"
+#include <vector>
+
+// Forward declarations
+class DownloadManager;
+
+// Virtual report list of the downloads. Rows live in a DownloadListModel and
+// are formatted only when the control paints them; an update repaints just
+// the rows that differ, and selection and scroll position stay with the control.
+class DownloadListCtrl : public wxListCtrl {
+public:
+    // Constructor
+    DownloadListCtrl(wxWindow* parent, wxWindowID id, DownloadManager* downloadManager);
+    
+    // Show the downloads, repainting only the rows that changed
+    void SetDownloads(const std::vector<DownloadItem>& downloads);
+    
+    // Update the running downloads from their published progress
+    void RefreshProgress();
+    
+    // Show only some of the downloads
+    void SetFilter(const DownloadFilter& filter);
+    
+    // Hosts of all downloads, for the host filter
+    std::vector<wxString> GetHosts() const { return m_model.GetHosts(); }
+    
+    // Download id of a row, -1 when out of range
+    int GetDownloadId(long row) const;
+    
+    // Ids of the selected rows
+    std::vector<int> GetSelectedIds() const;
+
+protected:
+    // Text of a cell, asked for by the control when it paints the row
+    wxString OnGetItemText(long item, long column) const override;
+
+private:
+    // Private methods
+    DownloadRow MakeRow(const DownloadItem& item) const;
+    void ApplyChange(DownloadListModel::Change change, const std::vector<long>& changedRows,
+                     const std::vector<int>& selectedIds, int focusedId);
+    void RestoreSelection(const std::vector<int>& selectedIds, int focusedId);
+    
+    // Event handlers
+    void OnColumnClick(wxListEvent& event);
+    
+    // Member variables
+    DownloadManager* m_downloadManager;
+    DownloadListModel m_model;
+    std::vector<int> m_activeIds;  // Downloads with a running transfer
+};
+
+#endif // DOWNLOADLISTCTRL_H
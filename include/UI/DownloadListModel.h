@@ -0,0 +1,124 @@
+#ifndef DOWNLOADLISTMODEL_H
+#define DOWNLOADLISTMODEL_H
+
+#include "Models/DownloadItem.h"
+#include <map>
+#include <vector>
+
+// What the download list shows for one download, unformatted
+struct DownloadRow {
+    int id;
+    wxString name;
+    DownloadStatus status;
+    int progress;
+    long long size;
+    long long speed;
+    long long eta;          // Seconds left, -1 while unknown
+    wxString url;
+    wxString host;
+    wxString dateAdded;     // %Y-%m-%d %H:%M:%S, so it sorts as text
+    DownloadPriority priority;
+    
+    bool operator==(const DownloadRow& other) const;
+};
+
+// Orders of the list, one per column
+enum class DownloadSortKey {
+    ID,
+    NAME,
+    STATUS,
+    PROGRESS,
+    SIZE,
+    SPEED,
+    ETA,
+    HOST,
+    DATE_ADDED,
+    PRIORITY
+};
+
+// Downloads the list shows
+struct DownloadFilter {
+    enum class Status {
+        ALL,
+        ACTIVE,     // Downloading or queued
+        PAUSED,
+        COMPLETED,
+        FAILED
+    };
+    
+    Status status;
+    wxString host;          // Empty for every host
+    bool searching;         // Show only the downloads in ids
+    std::vector<int> ids;   // Search results, sorted
+    
+    DownloadFilter() : status(Status::ALL), searching(false) {}
+};
+
+// Rows behind the download list: every row in sort order, and the rows that
+// pass the filter in the same order. A changed row is moved within both with
+// a binary search instead of sorting again; only changing the order or the
+// filter, or loading many rows at once, walks every row.
+class DownloadListModel {
+public:
+    // What an update did to the view
+    enum class Change {
+        NONE,       // Nothing visible changed
+        ROWS,       // Visible rows changed in place
+        LAYOUT      // Rows were added, removed or moved
+    };
+    
+    // Constructor
+    DownloadListModel();
+    
+    // Make the rows match the given ones; positions of rows changed in place are added to changedRows
+    Change Assign(const std::vector<DownloadRow>& rows, std::vector<long>& changedRows);
+    
+    // Insert or update one row
+    Change Update(const DownloadRow& row);
+    
+    // Order and filter of the view
+    void SetSort(DownloadSortKey key, bool ascending);
+    DownloadSortKey GetSortKey() const { return m_sortKey; }
+    bool IsAscending() const { return m_ascending; }
+    void SetFilter(const DownloadFilter& filter);
+    const DownloadFilter& GetFilter() const { return m_filter; }
+    
+    // Rows of the view
+    long GetCount() const { return static_cast<long>(m_view.size()); }
+    const DownloadRow* GetRow(long position) const;
+    
+    // Position of a download in the view, -1 when it is filtered out or unknown
+    long FindPosition(int id) const;
+    
+    // Row of a download whether or not it is in the view
+    const DownloadRow* FindRow(int id) const;
+    
+    // Hosts of all rows, sorted
+    std::vector<wxString> GetHosts() const;
+
+private:
+    typedef std::vector<const DownloadRow*> Order;
+    
+    // Private methods
+    int CompareKeys(const DownloadRow& a, const DownloadRow& b) const;
+    bool Less(const DownloadRow* a, const DownloadRow* b) const;
+    bool Matches(const DownloadRow& row) const;
+    void Insert(Order& order, const DownloadRow* row);
+    long Erase(Order& order, const DownloadRow* row);
+    long Find(const Order& order, const DownloadRow* row) const;
+    void AddHost(const wxString& host);
+    void RemoveHost(const wxString& host);
+    void Sort();
+    void Filter();
+    
+    // Member variables
+    std::map<int, DownloadRow> m_rows;  // Nodes never move, so the orders can point at them
+    Order m_sorted;                     // Every row
+    Order m_view;                       // Rows passing the filter
+    std::map<wxString, int> m_hosts;    // Rows per host
+    DownloadSortKey m_sortKey;
+    bool m_ascending;
+    DownloadFilter m_filter;
+};
+
+#endif // DOWNLOADLISTMODEL_H
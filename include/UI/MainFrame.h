@@ -7,6 +7,11 @@
 #include "Models/AppSettings.h"
 #include "Managers/DownloadManager.h"
 
+// Forward declarations
+class DownloadListCtrl;
+class wxChoice;
+class wxSearchCtrl;
+
 // Main frame class
 class MainFrame : public wxFrame {
 public:
@@ -26,6 +31,8 @@ public:
 private:
   // Private methods
   void CreateUI();
+  void UpdateHostFilter();
+  void ApplyFilter();
   std::vector<int> GetSelectedDownloadIds();
   
   // Event handlers
@@ -41,16 +48,23 @@ private:
   void OnCopyURL(wxCommandEvent& event);
   void OnSettings(wxCommandEvent& event);
   void OnSpeedLimit(wxCommandEvent& event);
+  void OnSetPriority(wxCommandEvent& event);
   void OnExit(wxCommandEvent& event);
   void OnAbout(wxCommandEvent& event);
   void OnUpdateUI(wxCommandEvent& event);
   void OnTimer(wxTimerEvent& event);
+  void OnFilterChanged(wxCommandEvent& event);
+  void OnSearchCancel(wxCommandEvent& event);
   void OnClose(wxCloseEvent& event);
   void OnDownloadListItemActivated(wxListEvent& event);
   void OnDownloadListItemRightClick(wxListEvent& event);
   
   // Member variables
-  wxListCtrl* m_downloadList;
+  DownloadListCtrl* m_downloadList;
+  wxChoice* m_statusFilter;
+  wxChoice* m_hostFilter;
+  std::vector<wxString> m_filterHosts;  // Hosts listed in m_hostFilter after "All hosts"
+  wxSearchCtrl* m_searchBox;
   wxTimer* m_timer;
   DownloadManager* m_downloadManager;
   AppSettings m_settings;
@@ -21,6 +21,9 @@ public:
     const AppSettings& GetSettings() const;
     
 private:
+    // Rows of the bandwidth page: high, normal and low priority
+    static const int PRIORITY_ROWS = 3;
+    
     // Private methods
     void CreateUI();
     
@@ -33,6 +36,14 @@ private:
     AppSettings m_settings;
     wxTextCtrl* m_savePathCtrl;
     wxSpinCtrl* m_maxDownloadsCtrl;
+    wxSpinCtrl* m_connectionsCtrl;
+    wxSpinCtrl* m_hostConnectionsCtrl;
+    wxSpinCtrl* m_hostIntervalCtrl;
+    wxChoice* m_writeModeCtrl;
+    wxSpinCtrl* m_priorityWeightCtrl[PRIORITY_ROWS];
+    wxSpinCtrl* m_priorityMinRateCtrl[PRIORITY_ROWS];
+    wxSpinCtrl* m_priorityMaxRateCtrl[PRIORITY_ROWS];
+    wxSpinCtrl* m_speedLimitBurstCtrl;
     wxCheckBox* m_showNotificationsCheck;
     wxCheckBox* m_startWithWindowsCheck;
     wxCheckBox* m_minimizeToTrayCheck;
@@ -1,6 +1,4 @@
 #include "Common/CurlCallbacks.h"
-#include "Common/EventIDs.h"
-#include "UI/MainFrame.h"
 
 // دالة رد النداء للكتابة
 size_t WriteCallback(void* contents, size_t size, size_t nmemb, void* userp) {
@@ -23,11 +21,7 @@ int ProgressCallback(void* clientp, curl_off_t dltotal, curl_off_t dlnow, curl_o
         // حساب السرعة
         // (يمكن تنفيذ هذا لاحقًا)
         
-        // إرسال حدث تحديث واجهة المستخدم
-        if (item->mainFrame) {
-            wxCommandEvent event(wxEVT_COMMAND_MENU_SELECTED, ID_UpdateUI);
-            wxPostEvent((wxEvtHandler*)item->mainFrame, event);
-        }
+        // لا يتم إرسال حدث لكل استدعاء؛ واجهة المستخدم تقرأ التقدم بمعدل ثابت
     }
     
     return 0;  // 0 للاستمرار، غير 0 للإلغاء
@@ -1,9 +1,11 @@
 #include "Database/DatabaseManager.h"
 #include <wx/log.h>
 #include <wx/filename.h>
+#include <cstring>
+#include <algorithm>
 
 DatabaseManager::DatabaseManager(const wxString& dbPath)
-    : m_dbPath(dbPath), m_db(nullptr) {
+    : m_dbPath(dbPath), m_db(nullptr), m_searchDb(nullptr), m_hasSearchIndex(false) {
     // فتح قاعدة البيانات
     if (!OpenDatabase()) {
         wxLogError("Failed to open database: %s", dbPath);
@@ -16,11 +18,20 @@ DatabaseManager::DatabaseManager(const wxString& dbPath)
         return;
     }
     
+    // البحث يعمل على اتصاله الخاص حتى لا ينتظر عمليات الكتابة ولا تنتظره
+    if (!OpenSearchConnection()) {
+        wxLogError("Failed to open search connection, searching on the main connection");
+    }
+    
     wxLogMessage("Database initialized: %s", dbPath);
 }
 
 DatabaseManager::~DatabaseManager() {
     // إغلاق قاعدة البيانات
+    if (m_searchDb) {
+        sqlite3_close(m_searchDb);
+        m_searchDb = nullptr;
+    }
     if (m_db) {
         sqlite3_close(m_db);
         m_db = nullptr;
@@ -46,6 +57,23 @@ bool DatabaseManager::OpenDatabase() {
         return false;
     }
     
+    // سجل WAL يسمح بالقراءة من اتصال آخر أثناء الكتابة
+    sqlite3_exec(m_db, "PRAGMA journal_mode=WAL;", nullptr, nullptr, nullptr);
+    
+    return true;
+}
+
+bool DatabaseManager::OpenSearchConnection() {
+    int result = sqlite3_open_v2(m_dbPath.c_str(), &m_searchDb, SQLITE_OPEN_READONLY, nullptr);
+    if (result != SQLITE_OK) {
+        wxLogError("Failed to open database for search: %s", sqlite3_errmsg(m_searchDb));
+        sqlite3_close(m_searchDb);
+        m_searchDb = nullptr;
+        return false;
+    }
+    
+    // انتظار قصير إذا صادف البحث نقطة حفظ السجل
+    sqlite3_busy_timeout(m_searchDb, 100);
     return true;
 }
 
@@ -72,13 +100,163 @@ bool DatabaseManager::CreateTables() {
         return false;
     }
     
+    // ترقية قواعد البيانات القديمة بإضافة الأعمدة الجديدة
+    if (!AddColumnIfMissing("downloads", "connections", "INTEGER NOT NULL DEFAULT 0")) {
+        return false;
+    }
+    if (!AddColumnIfMissing("downloads", "etag", "TEXT")) {
+        return false;
+    }
+    if (!AddColumnIfMissing("downloads", "last_modified", "TEXT")) {
+        return false;
+    }
+    if (!AddColumnIfMissing("downloads", "priority", "INTEGER NOT NULL DEFAULT 1")) {
+        return false;
+    }
+    if (!AddColumnIfMissing("downloads", "expected_checksum", "TEXT")) {
+        return false;
+    }
+    if (!AddColumnIfMissing("downloads", "sha256", "TEXT")) {
+        return false;
+    }
+    if (!AddColumnIfMissing("downloads", "md5", "TEXT")) {
+        return false;
+    }
+    if (!AddColumnIfMissing("downloads", "crc32c", "TEXT")) {
+        return false;
+    }
+    if (!AddColumnIfMissing("downloads", "mirrors", "TEXT")) {
+        return false;
+    }
+    if (!AddColumnIfMissing("downloads", "piece_length", "INTEGER NOT NULL DEFAULT 0")) {
+        return false;
+    }
+    if (!AddColumnIfMissing("downloads", "piece_hashes", "TEXT")) {
+        return false;
+    }
+    
+    // إنشاء جدول الخوادم لحفظ أفضل عدد اتصالات لكل منها
+    const char* hostsSql = "CREATE TABLE IF NOT EXISTS hosts ("
+                           "host TEXT PRIMARY KEY,"
+                           "connections INTEGER NOT NULL"
+                           ");";
+    
+    result = sqlite3_exec(m_db, hostsSql, nullptr, nullptr, &errMsg);
+    if (result != SQLITE_OK) {
+        wxLogError("Failed to create tables: %s", errMsg);
+        sqlite3_free(errMsg);
+        return false;
+    }
+    
+    // فهرس البحث اختياري، فلا يمنع فشله فتح قاعدة البيانات
+    m_hasSearchIndex = CreateSearchIndex();
+    
+    return true;
+}
+
+bool DatabaseManager::CreateSearchIndex() {
+    // هل الفهرس موجود من قبل؟ وإلا يجب ملؤه من الجدول بعد إنشائه
+    bool exists = false;
+    sqlite3_stmt* stmt = nullptr;
+    if (sqlite3_prepare_v2(m_db, "SELECT 1 FROM sqlite_master WHERE name = 'downloads_search';", -1, &stmt, nullptr) == SQLITE_OK) {
+        exists = sqlite3_step(stmt) == SQLITE_ROW;
+        sqlite3_finalize(stmt);
+    }
+    
+    // جدول FTS5 يقرأ محتواه من جدول التنزيلات، ومقسم المقاطع الثلاثية يسمح بالبحث عن أي جزء من الاسم أو الرابط
+    const char* tableSql = "CREATE VIRTUAL TABLE IF NOT EXISTS downloads_search USING fts5("
+                           "name, url, content='downloads', content_rowid='id', tokenize='trigram');";
+    
+    char* errMsg = nullptr;
+    int result = sqlite3_exec(m_db, tableSql, nullptr, nullptr, &errMsg);
+    if (result != SQLITE_OK) {
+        // مكتبة SQLite بدون FTS5 أو أقدم من 3.34؛ تُحذف المشغلات حتى لا تفشل الكتابة في الجدول
+        wxLogMessage("Full-text search not available (%s), searching with LIKE", errMsg);
+        sqlite3_free(errMsg);
+        sqlite3_exec(m_db, "DROP TRIGGER IF EXISTS downloads_search_insert;"
+                           "DROP TRIGGER IF EXISTS downloads_search_delete;"
+                           "DROP TRIGGER IF EXISTS downloads_search_update;", nullptr, nullptr, nullptr);
+        return false;
+    }
+    
+    // مشغلات تبقي الفهرس مطابقًا للجدول؛ تحديث التقدم لا يغير الاسم أو الرابط فلا يعيد الفهرسة
+    const char* triggersSql = "CREATE TRIGGER IF NOT EXISTS downloads_search_insert AFTER INSERT ON downloads BEGIN "
+                              "INSERT INTO downloads_search (rowid, name, url) VALUES (new.id, new.name, new.url); "
+                              "END;"
+                              "CREATE TRIGGER IF NOT EXISTS downloads_search_delete AFTER DELETE ON downloads BEGIN "
+                              "INSERT INTO downloads_search (downloads_search, rowid, name, url) VALUES ('delete', old.id, old.name, old.url); "
+                              "END;"
+                              "CREATE TRIGGER IF NOT EXISTS downloads_search_update AFTER UPDATE OF name, url ON downloads "
+                              "WHEN old.name IS NOT new.name OR old.url IS NOT new.url BEGIN "
+                              "INSERT INTO downloads_search (downloads_search, rowid, name, url) VALUES ('delete', old.id, old.name, old.url); "
+                              "INSERT INTO downloads_search (rowid, name, url) VALUES (new.id, new.name, new.url); "
+                              "END;";
+    
+    result = sqlite3_exec(m_db, triggersSql, nullptr, nullptr, &errMsg);
+    if (result != SQLITE_OK) {
+        wxLogError("Failed to create search triggers: %s", errMsg);
+        sqlite3_free(errMsg);
+        return false;
+    }
+    
+    // فهرسة التنزيلات الموجودة مرة واحدة عند إنشاء الفهرس
+    if (!exists) {
+        result = sqlite3_exec(m_db, "INSERT INTO downloads_search (downloads_search) VALUES ('rebuild');", nullptr, nullptr, &errMsg);
+        if (result != SQLITE_OK) {
+            wxLogError("Failed to build search index: %s", errMsg);
+            sqlite3_free(errMsg);
+            return false;
+        }
+        wxLogMessage("Search index built");
+    }
+    
+    return true;
+}
+
+bool DatabaseManager::AddColumnIfMissing(const char* table, const char* column, const char* definition) {
+    // البحث عن العمود في مخطط الجدول
+    wxString pragma = wxString::Format("PRAGMA table_info(%s);", table);
+    
+    sqlite3_stmt* stmt = nullptr;
+    int result = sqlite3_prepare_v2(m_db, pragma.c_str(), -1, &stmt, nullptr);
+    if (result != SQLITE_OK) {
+        wxLogError("Failed to prepare statement: %s", sqlite3_errmsg(m_db));
+        return false;
+    }
+    
+    bool found = false;
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        const char* name = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1));
+        if (name && strcmp(name, column) == 0) {
+            found = true;
+            break;
+        }
+    }
+    sqlite3_finalize(stmt);
+    
+    if (found) {
+        return true;
+    }
+    
+    // إضافة العمود المفقود
+    wxString sql = wxString::Format("ALTER TABLE %s ADD COLUMN %s %s;", table, column, definition);
+    
+    char* errMsg = nullptr;
+    result = sqlite3_exec(m_db, sql.c_str(), nullptr, nullptr, &errMsg);
+    if (result != SQLITE_OK) {
+        wxLogError("Failed to add column %s: %s", column, errMsg);
+        sqlite3_free(errMsg);
+        return false;
+    }
+    
+    wxLogMessage("Added column %s to table %s", column, table);
     return true;
 }
 
 bool DatabaseManager::AddDownload(const DownloadItem& item) {
     // إعداد الاستعلام
-    const char* sql = "INSERT INTO downloads (name, url, save_path, status, size, downloaded, date_added, is_youtube, youtube_format) "
-                      "VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?);";
+    const char* sql = "INSERT INTO downloads (name, url, save_path, status, size, downloaded, date_added, is_youtube, youtube_format, connections, etag, last_modified, priority, expected_checksum, sha256, md5, crc32c, "
+                      "mirrors, piece_length, piece_hashes) VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?);";
     
     sqlite3_stmt* stmt = nullptr;
     int result = sqlite3_prepare_v2(m_db, sql, -1, &stmt, nullptr);
@@ -97,6 +275,20 @@ bool DatabaseManager::AddDownload(const DownloadItem& item) {
     sqlite3_bind_text(stmt, 7, item.dateAdded.c_str(), -1, SQLITE_STATIC);
     sqlite3_bind_int(stmt, 8, item.isYouTube ? 1 : 0);
     sqlite3_bind_text(stmt, 9, item.youtubeFormat.c_str(), -1, SQLITE_STATIC);
+    sqlite3_bind_int(stmt, 10, item.connections);
+    sqlite3_bind_text(stmt, 11, item.etag.c_str(), -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 12, item.lastModified.c_str(), -1, SQLITE_STATIC);
+    sqlite3_bind_int(stmt, 13, static_cast<int>(item.priority));
+    sqlite3_bind_text(stmt, 14, item.expectedChecksum.c_str(), -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 15, item.sha256.c_str(), -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 16, item.md5.c_str(), -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 17, item.crc32c.c_str(), -1, SQLITE_STATIC);
+    
+    wxString mirrors = JoinList(item.mirrors, "\n");
+    wxString pieceHashes = JoinList(item.pieceHashes, "");
+    sqlite3_bind_text(stmt, 18, mirrors.c_str(), -1, SQLITE_STATIC);
+    sqlite3_bind_int64(stmt, 19, static_cast<sqlite3_int64>(item.pieceLength));
+    sqlite3_bind_text(stmt, 20, pieceHashes.c_str(), -1, SQLITE_STATIC);
     
     // تنفيذ الاستعلام
     result = sqlite3_step(stmt);
@@ -113,7 +305,8 @@ bool DatabaseManager::AddDownload(const DownloadItem& item) {
 
 bool DatabaseManager::UpdateDownload(const DownloadItem& item) {
     // إعداد الاستعلام
-    const char* sql = "UPDATE downloads SET name = ?, url = ?, save_path = ?, status = ?, size = ?, downloaded = ?, is_youtube = ?, youtube_format = ? "
+    const char* sql = "UPDATE downloads SET name = ?, url = ?, save_path = ?, status = ?, size = ?, downloaded = ?, is_youtube = ?, youtube_format = ?, connections = ?, etag = ?, last_modified = ?, priority = ?, "
+                      "expected_checksum = ?, sha256 = ?, md5 = ?, crc32c = ?, mirrors = ?, piece_length = ?, piece_hashes = ? "
                       "WHERE id = ?;";
     
     sqlite3_stmt* stmt = nullptr;
@@ -132,7 +325,21 @@ bool DatabaseManager::UpdateDownload(const DownloadItem& item) {
     sqlite3_bind_int64(stmt, 6, static_cast<sqlite3_int64>(item.downloadedSize));
     sqlite3_bind_int(stmt, 7, item.isYouTube ? 1 : 0);
     sqlite3_bind_text(stmt, 8, item.youtubeFormat.c_str(), -1, SQLITE_STATIC);
-    sqlite3_bind_int(stmt, 9, item.id);
+    sqlite3_bind_int(stmt, 9, item.connections);
+    sqlite3_bind_text(stmt, 10, item.etag.c_str(), -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 11, item.lastModified.c_str(), -1, SQLITE_STATIC);
+    sqlite3_bind_int(stmt, 12, static_cast<int>(item.priority));
+    sqlite3_bind_text(stmt, 13, item.expectedChecksum.c_str(), -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 14, item.sha256.c_str(), -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 15, item.md5.c_str(), -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 16, item.crc32c.c_str(), -1, SQLITE_STATIC);
+    
+    wxString mirrors = JoinList(item.mirrors, "\n");
+    wxString pieceHashes = JoinList(item.pieceHashes, "");
+    sqlite3_bind_text(stmt, 17, mirrors.c_str(), -1, SQLITE_STATIC);
+    sqlite3_bind_int64(stmt, 18, static_cast<sqlite3_int64>(item.pieceLength));
+    sqlite3_bind_text(stmt, 19, pieceHashes.c_str(), -1, SQLITE_STATIC);
+    sqlite3_bind_int(stmt, 20, item.id);
     
     // تنفيذ الاستعلام
     result = sqlite3_step(stmt);
@@ -178,7 +385,8 @@ std::vector<DownloadItem> DatabaseManager::GetAllDownloads() {
     std::vector<DownloadItem> downloads;
     
     // إعداد الاستعلام
-    const char* sql = "SELECT id, name, url, save_path, status, size, downloaded, date_added, is_youtube, youtube_format FROM downloads;";
+    const char* sql = "SELECT id, name, url, save_path, status, size, downloaded, date_added, is_youtube, youtube_format, connections, etag, last_modified, priority, "
+                      "expected_checksum, sha256, md5, crc32c, mirrors, piece_length, piece_hashes FROM downloads;";
     
     sqlite3_stmt* stmt = nullptr;
     int result = sqlite3_prepare_v2(m_db, sql, -1, &stmt, nullptr);
@@ -189,42 +397,7 @@ std::vector<DownloadItem> DatabaseManager::GetAllDownloads() {
     
     // تنفيذ الاستعلام وقراءة النتائج
     while (sqlite3_step(stmt) == SQLITE_ROW) {
-        DownloadItem item;
-        
-        item.id = sqlite3_column_int(stmt, 0);
-        
-        const char* name = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1));
-        if (name) {
-            item.name = wxString::FromUTF8(name);
-        }
-        
-        const char* url = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 2));
-        if (url) {
-            item.url = wxString::FromUTF8(url);
-        }
-        
-        const char* savePath = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 3));
-        if (savePath) {
-            item.savePath = wxString::FromUTF8(savePath);
-        }
-        
-        item.status = static_cast<DownloadStatus>(sqlite3_column_int(stmt, 4));
-        item.size = sqlite3_column_int64(stmt, 5);
-        item.downloadedSize = sqlite3_column_int64(stmt, 6);
-        
-        const char* dateAdded = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 7));
-        if (dateAdded) {
-            item.dateAdded = wxString::FromUTF8(dateAdded);
-        }
-        
-        item.isYouTube = sqlite3_column_int(stmt, 8) != 0;
-        
-        const char* youtubeFormat = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 9));
-        if (youtubeFormat) {
-            item.youtubeFormat = wxString::FromUTF8(youtubeFormat);
-        }
-        
-        downloads.push_back(item);
+        downloads.push_back(ReadDownloadRow(stmt));
     }
     
     sqlite3_finalize(stmt);
@@ -237,7 +410,8 @@ DownloadItem DatabaseManager::GetDownloadById(int id) {
     DownloadItem item;
     
     // إعداد الاستعلام
-    const char* sql = "SELECT id, name, url, save_path, status, size, downloaded, date_added, is_youtube, youtube_format FROM downloads WHERE id = ?;";
+    const char* sql = "SELECT id, name, url, save_path, status, size, downloaded, date_added, is_youtube, youtube_format, connections, etag, last_modified, priority, "
+                      "expected_checksum, sha256, md5, crc32c, mirrors, piece_length, piece_hashes FROM downloads WHERE id = ?;";
     
     sqlite3_stmt* stmt = nullptr;
     int result = sqlite3_prepare_v2(m_db, sql, -1, &stmt, nullptr);
@@ -251,42 +425,227 @@ DownloadItem DatabaseManager::GetDownloadById(int id) {
     
     // تنفيذ الاستعلام وقراءة النتائج
     if (sqlite3_step(stmt) == SQLITE_ROW) {
-        item.id = sqlite3_column_int(stmt, 0);
-        
-        const char* name = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1));
-        if (name) {
-            item.name = wxString::FromUTF8(name);
-        }
-        
-        const char* url = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 2));
-        if (url) {
-            item.url = wxString::FromUTF8(url);
-        }
+        item = ReadDownloadRow(stmt);
+    }
+    
+    sqlite3_finalize(stmt);
+    
+    wxLogMessage("Retrieved download from database, id: %d", id);
+    return item;
+}
+
+int DatabaseManager::GetHostConnections(const wxString& host) {
+    // إعداد الاستعلام
+    const char* sql = "SELECT connections FROM hosts WHERE host = ?;";
+    
+    sqlite3_stmt* stmt = nullptr;
+    int result = sqlite3_prepare_v2(m_db, sql, -1, &stmt, nullptr);
+    if (result != SQLITE_OK) {
+        wxLogError("Failed to prepare statement: %s", sqlite3_errmsg(m_db));
+        return 0;
+    }
+    
+    // ربط القيم
+    sqlite3_bind_text(stmt, 1, host.c_str(), -1, SQLITE_STATIC);
+    
+    // صفر يعني أن الخادم غير معروف بعد
+    int connections = 0;
+    if (sqlite3_step(stmt) == SQLITE_ROW) {
+        connections = sqlite3_column_int(stmt, 0);
+    }
+    
+    sqlite3_finalize(stmt);
+    return connections;
+}
+
+bool DatabaseManager::SaveHostConnections(const wxString& host, int connections) {
+    // إعداد الاستعلام
+    const char* sql = "INSERT OR REPLACE INTO hosts (host, connections) VALUES (?, ?);";
+    
+    sqlite3_stmt* stmt = nullptr;
+    int result = sqlite3_prepare_v2(m_db, sql, -1, &stmt, nullptr);
+    if (result != SQLITE_OK) {
+        wxLogError("Failed to prepare statement: %s", sqlite3_errmsg(m_db));
+        return false;
+    }
+    
+    // ربط القيم
+    sqlite3_bind_text(stmt, 1, host.c_str(), -1, SQLITE_STATIC);
+    sqlite3_bind_int(stmt, 2, connections);
+    
+    // تنفيذ الاستعلام
+    result = sqlite3_step(stmt);
+    sqlite3_finalize(stmt);
+    
+    if (result != SQLITE_DONE) {
+        wxLogError("Failed to save host connections: %s", sqlite3_errmsg(m_db));
+        return false;
+    }
+    
+    wxLogMessage("Best connection count for %s: %d", host, connections);
+    return true;
+}
+
+std::vector<int> DatabaseManager::SearchDownloads(const wxString& text, int limit) {
+    std::vector<int> ids;
+    sqlite3* db = m_searchDb ? m_searchDb : m_db;
+    
+    wxString query = text;
+    query.Trim(true).Trim(false);
+    if (query.IsEmpty()) {
+        return ids;
+    }
+    
+    // فهرس المقاطع الثلاثية يجيب عن النصوص من ثلاثة أحرف فأكثر
+    if (m_hasSearchIndex && query.length() >= 3) {
+        // النص كعبارة واحدة بين علامتي تنصيص حتى لا تُفسر رموزه كصيغة استعلام
+        wxString phrase = query;
+        phrase.Replace("\"", "\"\"");
+        phrase = "\"" + phrase + "\"";
         
-        const char* savePath = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 3));
-        if (savePath) {
-            item.savePath = wxString::FromUTF8(savePath);
+        sqlite3_stmt* stmt = nullptr;
+        const char* sql = "SELECT rowid FROM downloads_search WHERE downloads_search MATCH ? LIMIT ?;";
+        if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) == SQLITE_OK) {
+            sqlite3_bind_text(stmt, 1, phrase.c_str(), -1, SQLITE_TRANSIENT);
+            sqlite3_bind_int(stmt, 2, limit);
+            while (sqlite3_step(stmt) == SQLITE_ROW) {
+                ids.push_back(sqlite3_column_int(stmt, 0));
+            }
+            sqlite3_finalize(stmt);
+            std::sort(ids.begin(), ids.end());
+            return ids;
         }
-        
-        item.status = static_cast<DownloadStatus>(sqlite3_column_int(stmt, 4));
-        item.size = sqlite3_column_int64(stmt, 5);
-        item.downloadedSize = sqlite3_column_int64(stmt, 6);
-        
-        const char* dateAdded = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 7));
-        if (dateAdded) {
-            item.dateAdded = wxString::FromUTF8(dateAdded);
+        wxLogError("Failed to prepare search: %s", sqlite3_errmsg(db));
+    }
+    
+    // البحث بـ LIKE بعد تهريب رموزه الخاصة
+    wxString pattern = query;
+    pattern.Replace("\\", "\\\\");
+    pattern.Replace("%", "\\%");
+    pattern.Replace("_", "\\_");
+    pattern = "%" + pattern + "%";
+    
+    sqlite3_stmt* stmt = nullptr;
+    const char* sql = "SELECT id FROM downloads WHERE name LIKE ?1 ESCAPE '\\' OR url LIKE ?1 ESCAPE '\\' LIMIT ?2;";
+    int result = sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr);
+    if (result != SQLITE_OK) {
+        wxLogError("Failed to prepare statement: %s", sqlite3_errmsg(db));
+        return ids;
+    }
+    
+    sqlite3_bind_text(stmt, 1, pattern.c_str(), -1, SQLITE_TRANSIENT);
+    sqlite3_bind_int(stmt, 2, limit);
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        ids.push_back(sqlite3_column_int(stmt, 0));
+    }
+    sqlite3_finalize(stmt);
+    
+    std::sort(ids.begin(), ids.end());
+    return ids;
+}
+
+wxString DatabaseManager::JoinList(const std::vector<wxString>& values, const wxString& separator) {
+    // دمج قائمة في نص واحد لتخزينها في عمود
+    wxString joined;
+    for (size_t i = 0; i < values.size(); ++i) {
+        if (i > 0) {
+            joined += separator;
         }
-        
-        item.isYouTube = sqlite3_column_int(stmt, 8) != 0;
-        
-        const char* youtubeFormat = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 9));
-        if (youtubeFormat) {
-            item.youtubeFormat = wxString::FromUTF8(youtubeFormat);
+        joined += values[i];
+    }
+    return joined;
+}
+
+DownloadItem DatabaseManager::ReadDownloadRow(sqlite3_stmt* stmt) {
+    // قراءة صف واحد بترتيب الأعمدة المستخدم في استعلامات SELECT
+    DownloadItem item;
+    
+    item.id = sqlite3_column_int(stmt, 0);
+    
+    const char* name = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1));
+    if (name) {
+        item.name = wxString::FromUTF8(name);
+    }
+    
+    const char* url = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 2));
+    if (url) {
+        item.url = wxString::FromUTF8(url);
+    }
+    
+    const char* savePath = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 3));
+    if (savePath) {
+        item.savePath = wxString::FromUTF8(savePath);
+    }
+    
+    item.status = static_cast<DownloadStatus>(sqlite3_column_int(stmt, 4));
+    item.size = sqlite3_column_int64(stmt, 5);
+    item.downloadedSize = sqlite3_column_int64(stmt, 6);
+    
+    const char* dateAdded = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 7));
+    if (dateAdded) {
+        item.dateAdded = wxString::FromUTF8(dateAdded);
+    }
+    
+    item.isYouTube = sqlite3_column_int(stmt, 8) != 0;
+    
+    const char* youtubeFormat = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 9));
+    if (youtubeFormat) {
+        item.youtubeFormat = wxString::FromUTF8(youtubeFormat);
+    }
+    
+    item.connections = sqlite3_column_int(stmt, 10);
+    
+    const char* etag = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 11));
+    if (etag) {
+        item.etag = wxString::FromUTF8(etag);
+    }
+    
+    const char* lastModified = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 12));
+    if (lastModified) {
+        item.lastModified = wxString::FromUTF8(lastModified);
+    }
+    
+    item.priority = static_cast<DownloadPriority>(sqlite3_column_int(stmt, 13));
+    
+    const char* expectedChecksum = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 14));
+    if (expectedChecksum) {
+        item.expectedChecksum = wxString::FromUTF8(expectedChecksum);
+    }
+    
+    const char* sha256 = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 15));
+    if (sha256) {
+        item.sha256 = wxString::FromUTF8(sha256);
+    }
+    
+    const char* md5 = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 16));
+    if (md5) {
+        item.md5 = wxString::FromUTF8(md5);
+    }
+    
+    const char* crc32c = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 17));
+    if (crc32c) {
+        item.crc32c = wxString::FromUTF8(crc32c);
+    }
+    
+    // الروابط البديلة مفصولة بأسطر، وبصمات الأجزاء متتالية بطول 64 حرفًا لكل منها
+    const char* mirrors = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 18));
+    if (mirrors) {
+        wxString list = wxString::FromUTF8(mirrors);
+        while (!list.IsEmpty()) {
+            item.mirrors.push_back(list.BeforeFirst('\n'));
+            list = list.AfterFirst('\n');
         }
     }
     
-    sqlite3_finalize(stmt);
+    item.pieceLength = sqlite3_column_int64(stmt, 19);
+    
+    const char* pieceHashes = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 20));
+    if (pieceHashes) {
+        wxString list = wxString::FromUTF8(pieceHashes);
+        for (size_t offset = 0; offset + 64 <= list.length(); offset += 64) {
+            item.pieceHashes.push_back(list.Mid(offset, 64));
+        }
+    }
     
-    wxLogMessage("Retrieved download from database, id: %d", id);
     return item;
 }
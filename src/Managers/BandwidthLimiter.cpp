@@ -0,0 +1,204 @@
+#include "Managers/BandwidthLimiter.h"
+#include <algorithm>
+#include <vector>
+
+// A class counts as active this long after it last received or waited for data
+static const long ACTIVE_WINDOW_MS = 250;
+
+// Smallest bucket of a class, so one full write can always get through
+static const double MIN_BUCKET_BYTES = 16 * 1024;
+
+// Constructor
+BandwidthLimiter::BandwidthLimiter()
+    : m_rate(0), m_burst(0), m_lastRefill(Clock::now())
+{
+}
+
+// Set rate and burst
+void BandwidthLimiter::SetRate(long long bytesPerSecond, long long burstBytes)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_rate = std::max(bytesPerSecond, 0LL);
+    m_burst = std::max(burstBytes, 0LL);
+}
+
+// Get rate
+long long BandwidthLimiter::GetRate() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_rate;
+}
+
+// Configure a class
+void BandwidthLimiter::SetClass(int classId, int weight, long long minRate, long long maxRate)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    BandwidthClass& bandwidthClass = GetClass(classId);
+    bandwidthClass.weight = std::max(weight, 1);
+    bandwidthClass.minRate = std::max(minRate, 0LL);
+    bandwidthClass.maxRate = std::max(maxRate, 0LL);
+}
+
+// Take tokens
+bool BandwidthLimiter::TryConsume(int classId, long long bytes)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    Clock::time_point now = Clock::now();
+    
+    BandwidthClass& bandwidthClass = GetClass(classId);
+    bandwidthClass.lastActive = now;
+    
+    Refill(now);
+    if (bandwidthClass.rate < 0) {
+        return true;
+    }
+    if (bandwidthClass.tokens <= 0) {
+        return false;
+    }
+    
+    // Let the write through and carry any overdraft into the next refill
+    bandwidthClass.tokens -= bytes;
+    return true;
+}
+
+// Undo a TryConsume
+void BandwidthLimiter::Refund(int classId, long long bytes)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    
+    BandwidthClass& bandwidthClass = GetClass(classId);
+    if (bandwidthClass.rate >= 0) {
+        bandwidthClass.tokens += bytes;
+    }
+}
+
+// Time until a class has tokens again
+long BandwidthLimiter::GetDelayMs(int classId)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    Clock::time_point now = Clock::now();
+    
+    BandwidthClass& bandwidthClass = GetClass(classId);
+    bandwidthClass.lastActive = now;
+    
+    Refill(now);
+    if (bandwidthClass.rate < 0 || bandwidthClass.tokens > 0) {
+        return 0;
+    }
+    if (bandwidthClass.rate == 0) {
+        return -1;
+    }
+    
+    return static_cast<long>((-bandwidthClass.tokens * 1000) / bandwidthClass.rate) + 1;
+}
+
+// Find or create a class, called with m_mutex held
+BandwidthLimiter::BandwidthClass& BandwidthLimiter::GetClass(int classId)
+{
+    auto it = m_classes.find(classId);
+    if (it == m_classes.end()) {
+        it = m_classes.insert(std::make_pair(classId, BandwidthClass())).first;
+    }
+    
+    return it->second;
+}
+
+// Add the tokens earned since the last refill, called with m_mutex held
+void BandwidthLimiter::Refill(Clock::time_point now)
+{
+    double elapsed = std::chrono::duration<double>(now - m_lastRefill).count();
+    m_lastRefill = now;
+    
+    // Shares from the previous period pay for the time that passed
+    double burstSeconds = m_rate > 0 ? static_cast<double>(m_burst) / m_rate : 0.25;
+    for (auto& entry : m_classes) {
+        BandwidthClass& bandwidthClass = entry.second;
+        if (bandwidthClass.rate <= 0) {
+            continue;
+        }
+        
+        double bucket = std::max(bandwidthClass.rate * burstSeconds, MIN_BUCKET_BYTES);
+        bandwidthClass.tokens = std::min(bandwidthClass.tokens + elapsed * bandwidthClass.rate, bucket);
+    }
+    
+    Allocate(now);
+}
+
+// Divide the global rate between the active classes, called with m_mutex held
+void BandwidthLimiter::Allocate(Clock::time_point now)
+{
+    // Without a global limit only the class caps apply
+    if (m_rate <= 0) {
+        for (auto& entry : m_classes) {
+            entry.second.rate = entry.second.maxRate > 0 ? entry.second.maxRate : -1;
+        }
+        return;
+    }
+    
+    std::vector<BandwidthClass*> active;
+    for (auto& entry : m_classes) {
+        BandwidthClass& bandwidthClass = entry.second;
+        bandwidthClass.rate = 0;
+        if (now - bandwidthClass.lastActive <= std::chrono::milliseconds(ACTIVE_WINDOW_MS)) {
+            active.push_back(&bandwidthClass);
+        }
+    }
+    
+    double available = static_cast<double>(m_rate);
+    
+    // Minimum rates first, scaled down when they add up to more than the global rate
+    double minimumTotal = 0;
+    for (BandwidthClass* bandwidthClass : active) {
+        double minimum = bandwidthClass->minRate;
+        if (bandwidthClass->maxRate > 0) {
+            minimum = std::min(minimum, static_cast<double>(bandwidthClass->maxRate));
+        }
+        bandwidthClass->rate = minimum;
+        minimumTotal += minimum;
+    }
+    if (minimumTotal > available) {
+        for (BandwidthClass* bandwidthClass : active) {
+            bandwidthClass->rate *= available / minimumTotal;
+        }
+        return;
+    }
+    available -= minimumTotal;
+    
+    // Split the rest by weight; share above a class cap goes to the others
+    std::vector<BandwidthClass*> open;
+    for (BandwidthClass* bandwidthClass : active) {
+        if (bandwidthClass->maxRate <= 0 || bandwidthClass->rate < bandwidthClass->maxRate) {
+            open.push_back(bandwidthClass);
+        }
+    }
+    
+    while (available > 0 && !open.empty()) {
+        int totalWeight = 0;
+        for (BandwidthClass* bandwidthClass : open) {
+            totalWeight += bandwidthClass->weight;
+        }
+        
+        std::vector<BandwidthClass*> stillOpen;
+        double given = 0;
+        for (BandwidthClass* bandwidthClass : open) {
+            double share = available * bandwidthClass->weight / totalWeight;
+            if (bandwidthClass->maxRate > 0 && bandwidthClass->rate + share >= bandwidthClass->maxRate) {
+                given += bandwidthClass->maxRate - bandwidthClass->rate;
+                bandwidthClass->rate = bandwidthClass->maxRate;
+            } else {
+                stillOpen.push_back(bandwidthClass);
+            }
+        }
+        
+        // Nobody hit a cap: hand out the weighted shares and stop
+        if (stillOpen.size() == open.size()) {
+            for (BandwidthClass* bandwidthClass : open) {
+                bandwidthClass->rate += available * bandwidthClass->weight / totalWeight;
+            }
+            break;
+        }
+        
+        available -= given;
+        open.swap(stillOpen);
+    }
+}
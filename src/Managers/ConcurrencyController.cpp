@@ -0,0 +1,96 @@
+#include "Managers/ConcurrencyController.h"
+#include <algorithm>
+
+// Relative gain that counts as rising throughput, in percent
+static const long long MIN_GAIN_PERCENT = 10;
+
+// Samples to stay at a level after a plateau or an error
+static const int HOLD_SAMPLES = 3;
+
+// Samples needed before the best connection count is worth remembering
+static const int MIN_SAMPLES = 3;
+
+// Constructor
+ConcurrencyController::ConcurrencyController(int initial, int minimum, int maximum)
+    : m_target(1), m_minimum(std::max(minimum, 1)), m_maximum(std::max(maximum, 1)), m_samples(0), m_holdSamples(0),
+      m_increased(false), m_failed(false), m_lastRate(0), m_bestRate(0), m_bestConnections(0)
+{
+    m_maximum = std::max(m_maximum, m_minimum);
+    SetTarget(initial);
+}
+
+// Adjust the target from the throughput of the last interval
+void ConcurrencyController::OnSample(long long bytesPerSecond, int activeConnections)
+{
+    m_samples++;
+    
+    // Errors were already answered with a decrease
+    if (m_failed) {
+        m_failed = false;
+        m_increased = false;
+        m_lastRate = bytesPerSecond;
+        return;
+    }
+    
+    if (bytesPerSecond > m_bestRate) {
+        m_bestRate = bytesPerSecond;
+        m_bestConnections = activeConnections;
+    }
+    
+    bool rising = bytesPerSecond * 100 > m_lastRate * (100 + MIN_GAIN_PERCENT);
+    
+    if (m_increased && !rising) {
+        // The extra connection didn't pay off: take it back and stay there for a while
+        SetTarget(m_target - 1);
+        m_holdSamples = HOLD_SAMPLES;
+        m_increased = false;
+    } else if (m_holdSamples > 0) {
+        m_holdSamples--;
+        m_increased = false;
+    } else if (rising) {
+        // Additive increase while more connections keep helping
+        int previous = m_target;
+        SetTarget(m_target + 1);
+        m_increased = m_target != previous;
+    } else {
+        // Plateau: probe upwards again after the hold time
+        m_increased = false;
+        m_holdSamples = HOLD_SAMPLES;
+    }
+    
+    m_lastRate = bytesPerSecond;
+}
+
+// Multiplicative decrease after a failed connection
+void ConcurrencyController::OnError(bool throttled)
+{
+    // One decrease per interval, however many connections failed at once
+    if (!m_failed) {
+        SetTarget(m_target / 2);
+    }
+    
+    // A server that asked to slow down doesn't get more connections than it has now
+    if (throttled) {
+        m_maximum = std::max(m_target, m_minimum);
+    }
+    
+    m_failed = true;
+    m_increased = false;
+    m_holdSamples = HOLD_SAMPLES;
+}
+
+// Best connection count seen
+int ConcurrencyController::GetBestConnections() const
+{
+    if (m_samples < MIN_SAMPLES) {
+        return 0;
+    }
+    
+    return m_bestConnections;
+}
+
+// Keep the target within the limits
+void ConcurrencyController::SetTarget(int target)
+{
+    m_target = std::min(std::max(target, m_minimum), m_maximum);
+}
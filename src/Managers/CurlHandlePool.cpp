@@ -0,0 +1,101 @@
+#include "Managers/CurlHandlePool.h"
+#include <wx/log.h>
+
+// Idle handles kept for reuse; more are cleaned up on release
+static const size_t MAX_IDLE_HANDLES = 16;
+
+// Constructor
+CurlHandlePool::CurlHandlePool()
+    : m_share(nullptr)
+{
+    m_share = curl_share_init();
+    if (!m_share) {
+        wxLogError("Failed to initialize curl share");
+        return;
+    }
+    
+    curl_share_setopt(m_share, CURLSHOPT_LOCKFUNC, LockCallback);
+    curl_share_setopt(m_share, CURLSHOPT_UNLOCKFUNC, UnlockCallback);
+    curl_share_setopt(m_share, CURLSHOPT_USERDATA, this);
+    curl_share_setopt(m_share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+    curl_share_setopt(m_share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+    curl_share_setopt(m_share, CURLSHOPT_SHARE, CURL_LOCK_DATA_COOKIE);
+    curl_share_setopt(m_share, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT);
+}
+
+// Destructor
+CurlHandlePool::~CurlHandlePool()
+{
+    // Handles must be gone before the share object can be released
+    for (CURL* curl : m_idleHandles) {
+        curl_easy_cleanup(curl);
+    }
+    m_idleHandles.clear();
+    
+    if (m_share) {
+        curl_share_cleanup(m_share);
+        m_share = nullptr;
+    }
+}
+
+// Get a handle
+CURL* CurlHandlePool::Acquire()
+{
+    CURL* curl = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(m_poolMutex);
+        if (!m_idleHandles.empty()) {
+            curl = m_idleHandles.back();
+            m_idleHandles.pop_back();
+        }
+    }
+    
+    if (curl) {
+        // Forget the options of the last transfer; caches and connections stay
+        curl_easy_reset(curl);
+    } else {
+        curl = curl_easy_init();
+        if (!curl) {
+            wxLogError("Failed to initialize curl");
+            return nullptr;
+        }
+    }
+    
+    if (m_share) {
+        curl_easy_setopt(curl, CURLOPT_SHARE, m_share);
+    }
+    
+    return curl;
+}
+
+// Return a handle
+void CurlHandlePool::Release(CURL* curl)
+{
+    if (!curl) {
+        return;
+    }
+    
+    {
+        std::lock_guard<std::mutex> lock(m_poolMutex);
+        if (m_idleHandles.size() < MAX_IDLE_HANDLES) {
+            m_idleHandles.push_back(curl);
+            return;
+        }
+    }
+    
+    curl_easy_cleanup(curl);
+}
+
+// Lock shared data for a handle
+void CurlHandlePool::LockCallback(CURL* curl, curl_lock_data data, curl_lock_access access, void* userptr)
+{
+    CurlHandlePool* pool = static_cast<CurlHandlePool*>(userptr);
+    pool->m_shareMutexes[data].lock();
+}
+
+// Unlock shared data
+void CurlHandlePool::UnlockCallback(CURL* curl, curl_lock_data data, void* userptr)
+{
+    CurlHandlePool* pool = static_cast<CurlHandlePool*>(userptr);
+    pool->m_shareMutexes[data].unlock();
+}
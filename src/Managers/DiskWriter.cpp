@@ -0,0 +1,316 @@
+#include "Managers/DiskWriter.h"
+#include <wx/log.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+
+// Longest time data waits in a partly filled buffer
+static const long FLUSH_INTERVAL_MS = 200;
+
+// Alignment of the arena in memory
+static const size_t ARENA_ALIGNMENT = 4096;
+
+// Constructor
+DiskWriter::DiskWriter(size_t bufferSize, size_t bufferCount)
+    : m_bufferSize(std::max<size_t>(bufferSize, ARENA_ALIGNMENT)), m_spaceRequested(false), m_running(false)
+{
+    // One allocation for all buffers, aligned so every buffer starts on a page
+    m_bufferSize = (m_bufferSize + ARENA_ALIGNMENT - 1) / ARENA_ALIGNMENT * ARENA_ALIGNMENT;
+    bufferCount = std::max<size_t>(bufferCount, 2);
+    m_arena.resize(m_bufferSize * bufferCount + ARENA_ALIGNMENT);
+    
+    uintptr_t base = reinterpret_cast<uintptr_t>(m_arena.data());
+    char* aligned = m_arena.data() + (ARENA_ALIGNMENT - base % ARENA_ALIGNMENT) % ARENA_ALIGNMENT;
+    
+    m_buffers.resize(bufferCount);
+    for (size_t i = 0; i < bufferCount; i++) {
+        m_buffers[i].offset = 0;
+        m_buffers[i].length = 0;
+        m_buffers[i].capacity = 0;
+        m_buffers[i].data = aligned + i * m_bufferSize;
+        m_freeBuffers.push_back(&m_buffers[i]);
+    }
+}
+
+// Destructor
+DiskWriter::~DiskWriter()
+{
+    Stop();
+}
+
+// Start the writer thread
+void DiskWriter::Start()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_running) {
+        return;
+    }
+    
+    m_running = true;
+    m_thread = std::thread(&DiskWriter::Run, this);
+}
+
+// Stop the writer thread after the queued data is written
+void DiskWriter::Stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_running) {
+            return;
+        }
+        m_running = false;
+    }
+    m_workCondition.notify_one();
+    
+    if (m_thread.joinable()) {
+        m_thread.join();
+    }
+}
+
+// Set the space handler
+void DiskWriter::SetSpaceHandler(SpaceHandler handler)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_spaceHandler = handler;
+}
+
+// Copy a block into the arena
+bool DiskWriter::Submit(const std::shared_ptr<FileWriter>& file, long long offset, const void* data, size_t length)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    
+    // Write directly when the thread isn't running, e.g. while shutting down
+    if (!m_running) {
+        lock.unlock();
+        return file->Write(offset, data, length);
+    }
+    
+    // Take all or nothing, so a refused block is delivered again in full
+    WriteBuffer* buffer = FindOpenBuffer(file.get(), offset);
+    if (CountNeededBuffers(buffer, offset, length) > m_freeBuffers.size()) {
+        m_spaceRequested = true;
+        return false;
+    }
+    
+    const char* source = static_cast<const char*>(data);
+    bool sealed = false;
+    while (length > 0) {
+        if (!buffer) {
+            buffer = m_freeBuffers.back();
+            m_freeBuffers.pop_back();
+            
+            // End the buffer on an aligned file offset so later buffers of the range are aligned
+            buffer->file = file;
+            buffer->offset = offset;
+            buffer->length = 0;
+            buffer->capacity = m_bufferSize - static_cast<size_t>(offset % m_bufferSize);
+            m_openBuffers.push_back(buffer);
+            m_pending[file.get()]++;
+        }
+        
+        size_t chunk = std::min(length, buffer->capacity - buffer->length);
+        memcpy(buffer->data + buffer->length, source, chunk);
+        buffer->length += chunk;
+        source += chunk;
+        offset += chunk;
+        length -= chunk;
+        
+        // Full buffers go to the writer thread
+        if (buffer->length == buffer->capacity) {
+            m_openBuffers.erase(std::find(m_openBuffers.begin(), m_openBuffers.end(), buffer));
+            m_readyBuffers.push_back(buffer);
+            buffer = nullptr;
+            sealed = true;
+        }
+    }
+    
+    lock.unlock();
+    if (sealed) {
+        m_workCondition.notify_one();
+    }
+    
+    return true;
+}
+
+// Report when the data of one file is written
+void DiskWriter::FlushAsync(const std::shared_ptr<FileWriter>& file, FlushHandler onFlushed)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    
+    // Only the buffers holding data of the file now are waited for, so blocks submitted later don't delay the flush
+    SealBuffers(file.get());
+    FlushWaiter waiter;
+    for (WriteBuffer* buffer : m_readyBuffers) {
+        if (buffer->file == file) {
+            waiter.buffers.push_back(buffer);
+        }
+    }
+    for (WriteBuffer* buffer : m_writingBuffers) {
+        if (buffer->file == file) {
+            waiter.buffers.push_back(buffer);
+        }
+    }
+    
+    if (waiter.buffers.empty()) {
+        lock.unlock();
+        onFlushed(!file->HasFailed());
+        return;
+    }
+    
+    waiter.file = file;
+    waiter.handler = onFlushed;
+    m_flushWaiters.push_back(std::move(waiter));
+    lock.unlock();
+    m_workCondition.notify_one();
+}
+
+// Unwritten blocks of a file
+std::vector<std::pair<long long, long long>> DiskWriter::GetPendingRanges(const std::shared_ptr<FileWriter>& file)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    
+    std::vector<std::pair<long long, long long>> ranges;
+    auto collect = [&ranges, &file](const WriteBuffer* buffer) {
+        if (buffer->file == file) {
+            ranges.push_back(std::make_pair(buffer->offset, static_cast<long long>(buffer->length)));
+        }
+    };
+    std::for_each(m_openBuffers.begin(), m_openBuffers.end(), collect);
+    std::for_each(m_readyBuffers.begin(), m_readyBuffers.end(), collect);
+    std::for_each(m_writingBuffers.begin(), m_writingBuffers.end(), collect);
+    
+    return ranges;
+}
+
+// Writer thread loop
+void DiskWriter::Run()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    
+    while (true) {
+        m_workCondition.wait_for(lock, std::chrono::milliseconds(FLUSH_INTERVAL_MS), [this]() {
+            return !m_running || !m_readyBuffers.empty();
+        });
+        
+        // Don't let data sit in partly filled buffers when the disk is idle
+        if (m_readyBuffers.empty()) {
+            SealBuffers(nullptr);
+        }
+        if (m_readyBuffers.empty()) {
+            if (!m_running) {
+                break;
+            }
+            continue;
+        }
+        
+        // Write in file order, so adjacent buffers of a file hit the disk one after another
+        std::vector<WriteBuffer*> batch(m_readyBuffers.begin(), m_readyBuffers.end());
+        m_readyBuffers.clear();
+        std::sort(batch.begin(), batch.end(), [](const WriteBuffer* a, const WriteBuffer* b) {
+            if (a->file != b->file) {
+                return a->file < b->file;
+            }
+            return a->offset < b->offset;
+        });
+        
+        m_writingBuffers = batch;
+        lock.unlock();
+        for (WriteBuffer* buffer : batch) {
+            buffer->file->Write(buffer->offset, buffer->data, buffer->length);
+        }
+        lock.lock();
+        m_writingBuffers.clear();
+        
+        // Flushes whose buffers are all written are done
+        std::vector<FlushWaiter> flushed;
+        for (auto it = m_flushWaiters.begin(); it != m_flushWaiters.end();) {
+            std::vector<WriteBuffer*>& buffers = it->buffers;
+            buffers.erase(std::remove_if(buffers.begin(), buffers.end(), [&batch](WriteBuffer* buffer) {
+                return std::find(batch.begin(), batch.end(), buffer) != batch.end();
+            }), buffers.end());
+            if (buffers.empty()) {
+                flushed.push_back(std::move(*it));
+                it = m_flushWaiters.erase(it);
+            } else {
+                ++it;
+            }
+        }
+        
+        // Give the buffers back
+        for (WriteBuffer* buffer : batch) {
+            auto pending = m_pending.find(buffer->file.get());
+            if (pending != m_pending.end() && --pending->second == 0) {
+                m_pending.erase(pending);
+            }
+            buffer->file.reset();
+            m_freeBuffers.push_back(buffer);
+        }
+        
+        // Let paused transfers deliver their data again
+        SpaceHandler spaceHandler;
+        if (m_spaceRequested && m_spaceHandler) {
+            m_spaceRequested = false;
+            spaceHandler = m_spaceHandler;
+        }
+        if (spaceHandler || !flushed.empty()) {
+            lock.unlock();
+            for (const FlushWaiter& waiter : flushed) {
+                waiter.handler(!waiter.file->HasFailed());
+            }
+            if (spaceHandler) {
+                spaceHandler();
+            }
+            lock.lock();
+        }
+    }
+}
+
+// Partly filled buffer that the block continues
+DiskWriter::WriteBuffer* DiskWriter::FindOpenBuffer(const FileWriter* file, long long offset)
+{
+    for (WriteBuffer* buffer : m_openBuffers) {
+        if (buffer->file.get() == file && buffer->offset + static_cast<long long>(buffer->length) == offset) {
+            return buffer;
+        }
+    }
+    
+    return nullptr;
+}
+
+// Number of free buffers a block needs
+size_t DiskWriter::CountNeededBuffers(WriteBuffer* open, long long offset, size_t length) const
+{
+    if (open) {
+        size_t room = open->capacity - open->length;
+        if (length <= room) {
+            return 0;
+        }
+        offset += room;
+        length -= room;
+    }
+    
+    size_t needed = 0;
+    while (length > 0) {
+        size_t capacity = m_bufferSize - static_cast<size_t>(offset % m_bufferSize);
+        size_t chunk = std::min(length, capacity);
+        offset += chunk;
+        length -= chunk;
+        needed++;
+    }
+    
+    return needed;
+}
+
+// Hand partly filled buffers of a file, or of all files, to the writer thread
+void DiskWriter::SealBuffers(const FileWriter* file)
+{
+    for (auto it = m_openBuffers.begin(); it != m_openBuffers.end();) {
+        if (!file || (*it)->file.get() == file) {
+            m_readyBuffers.push_back(*it);
+            it = m_openBuffers.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
@@ -15,6 +15,7 @@
 #include <chrono>
 #include <mutex>
 #include <atomic>
+#include <algorithm>
 
 // Define custom event for download operations
 wxDEFINE_EVENT(wxEVT_DOWNLOAD_OPERATION, wxCommandEvent);
@@ -22,32 +23,39 @@ wxDEFINE_EVENT(wxEVT_DOWNLOAD_OPERATION, wxCommandEvent);
 // Global mutex for thread safety
 std::mutex g_downloadMutex;
 
+// How often running downloads copy their progress into the items
+static const long PROGRESS_SYNC_MS = 500;
+
+// Buffers shared by all downloads between the network and the disk (64 x 256 KB)
+static const size_t WRITE_BUFFER_SIZE = 256 * 1024;
+static const size_t WRITE_BUFFER_COUNT = 64;
+
+// Most search results shown; a broader query is narrowed by typing more
+static const int MAX_SEARCH_RESULTS = 50000;
+
 // Constructor
 DownloadManager::DownloadManager()
-    : m_mainFrame(nullptr), m_nextId(1), m_isRunning(false), m_speedLimit(0)
+    : m_mainFrame(nullptr), m_nextId(1), m_isRunning(false), m_speedLimit(0), m_transferEngine(nullptr), m_handlePool(nullptr), m_diskWriter(nullptr), m_hashWorker(nullptr), m_prober(nullptr), m_redirectCache(nullptr), m_listChanged(true)
 {
-    // Initialize curl
-    curl_global_init(CURL_GLOBAL_ALL);
-    
-    // Initialize database manager
-    m_databaseManager = new DatabaseManager("downloads.db");
+    InitEngine();
     
     wxLogMessage("DownloadManager initialized");
 }
 
 // Constructor with main frame
 DownloadManager::DownloadManager(MainFrame* mainFrame, const AppSettings& settings)
-    : m_mainFrame(mainFrame), m_settings(settings), m_nextId(1), m_isRunning(false), m_speedLimit(0)
+    : m_mainFrame(mainFrame), m_settings(settings), m_nextId(1), m_isRunning(false), m_speedLimit(0), m_transferEngine(nullptr), m_handlePool(nullptr), m_diskWriter(nullptr), m_hashWorker(nullptr), m_prober(nullptr), m_redirectCache(nullptr), m_listChanged(true)
 {
-    // Initialize curl
-    curl_global_init(CURL_GLOBAL_ALL);
-    
-    // Initialize database manager
-    m_databaseManager = new DatabaseManager("downloads.db");
+    InitEngine();
     
     // Load downloads from database
     LoadDownloads();
     
+    // Continue downloads that were running when the application closed
+    if (!m_hostQueues.empty()) {
+        Start();
+    }
+    
     // Connect event handler for download operations
     if (m_mainFrame) {
         m_mainFrame->Connect(wxEVT_DOWNLOAD_OPERATION, wxCommandEventHandler(MainFrame::OnDownloadOperation));
@@ -56,12 +64,90 @@ DownloadManager::DownloadManager(MainFrame* mainFrame, const AppSettings& settin
     wxLogMessage("DownloadManager initialized with main frame");
 }
 
+// Set up the transfer engine, its helpers and the database shared by both constructors
+void DownloadManager::InitEngine()
+{
+    // Initialize curl
+    curl_global_init(CURL_GLOBAL_ALL);
+    
+    // Reusable handles sharing DNS, TLS sessions, cookies and connections
+    m_handlePool = new CurlHandlePool();
+    
+    // Start the transfer engine
+    m_transferEngine = new TransferEngine();
+    m_transferEngine->Start();
+    
+    // Disk writes run on their own thread; transfers wait while its buffers are full
+    m_diskWriter = new DiskWriter(WRITE_BUFFER_SIZE, WRITE_BUFFER_COUNT);
+    m_diskWriter->SetSpaceHandler([this]() { m_transferEngine->ResumeBufferWaiters(); });
+    m_diskWriter->Start();
+    
+    // Checksums of data that arrived out of order are computed by reading the file back on their own thread
+    m_hashWorker = new HashWorker();
+    m_hashWorker->Start();
+    
+    // Redirects followed once are skipped by the next connections to the same URL
+    m_redirectCache = new RedirectCache();
+    
+    // Headers of new URLs are fetched in the background before their downloads start
+    m_prober = new MetadataProber(m_transferEngine, m_handlePool, m_redirectCache, [this](const ProbeResult& result) { OnProbeResult(result); });
+    
+    // Keep per-host connections below the configured limit
+    m_transferEngine->SetMaxHostConnections(m_settings.maxConnectionsPerHost);
+    
+    // Higher priorities get a larger share of the speed limit
+    ApplyPriorityBandwidth();
+    
+    // Initialize database manager
+    m_databaseManager = new DatabaseManager("downloads.db");
+}
+
 // Destructor
 DownloadManager::~DownloadManager()
 {
     // Stop download thread
     Stop();
     
+    // Write out the buffered data; transfers still running write directly from now on
+    if (m_diskWriter) {
+        m_diskWriter->Stop();
+    }
+    
+    // Read-backs post their results to the engine, so they stop first
+    if (m_hashWorker) {
+        m_hashWorker->Stop();
+    }
+    
+    // Stop the transfer engine before releasing the transfers it drives
+    if (m_transferEngine) {
+        delete m_transferEngine;
+        m_transferEngine = nullptr;
+    }
+    
+    if (m_diskWriter) {
+        delete m_diskWriter;
+        m_diskWriter = nullptr;
+    }
+    if (m_hashWorker) {
+        delete m_hashWorker;
+        m_hashWorker = nullptr;
+    }
+    if (m_prober) {
+        delete m_prober;
+        m_prober = nullptr;
+    }
+    if (m_redirectCache) {
+        delete m_redirectCache;
+        m_redirectCache = nullptr;
+    }
+    m_tasks.clear();
+    
+    // Release pooled handles once no task uses them
+    if (m_handlePool) {
+        delete m_handlePool;
+        m_handlePool = nullptr;
+    }
+    
     // Disconnect event handler
     if (m_mainFrame) {
         m_mainFrame->Disconnect(wxEVT_DOWNLOAD_OPERATION, wxCommandEventHandler(MainFrame::OnDownloadOperation));
@@ -80,8 +166,35 @@ DownloadManager::~DownloadManager()
 }
 
 // Add download
-int DownloadManager::AddDownload(const wxString& url, const wxString& savePath)
+int DownloadManager::AddDownload(const wxString& url, const wxString& savePath, int connections, const wxString& checksum,
+                                 const std::vector<wxString>& mirrors)
 {
+    // A Metalink document describes its files, mirrors and hashes itself
+    if (Metalink::IsMetalink(url)) {
+        return AddMetalinkDownloads(url, savePath, connections);
+    }
+    
+    // A URL downloaded before is fetched again only if the server has a newer version
+    int existing = FindCompletedDownload(url, savePath);
+    if (existing >= 0) {
+        wxLogMessage("Already downloaded, checking for changes, id: %d, url: %s", existing, url);
+        
+        // The new request's options replace those of the earlier download
+        {
+            std::lock_guard<std::mutex> lock(g_downloadMutex);
+            DownloadItem* item = GetDownloadById(existing);
+            if (item) {
+                item->connections = connections;
+                item->expectedChecksum = checksum;
+                item->mirrors = mirrors;
+                m_databaseManager->UpdateDownload(*item);
+            }
+        }
+        
+        StartDownload(existing);
+        return existing;
+    }
+    
     std::lock_guard<std::mutex> lock(g_downloadMutex);
     
     // Create download item
@@ -94,6 +207,9 @@ int DownloadManager::AddDownload(const wxString& url, const wxString& savePath)
     item.size = 0;
     item.downloadedSize = 0;
     item.speed = 0;
+    item.connections = connections;
+    item.expectedChecksum = checksum;
+    item.mirrors = mirrors;
     item.dateAdded = wxDateTime::Now().Format("%Y-%m-%d %H:%M:%S");
     
     // Extract filename from URL
@@ -107,18 +223,7 @@ int DownloadManager::AddDownload(const wxString& url, const wxString& savePath)
         filename = filename.BeforeFirst('?');
     }
     
-    // Ensure filename is valid
-    filename.Replace(":", "_");
-    filename.Replace("/", "_");
-    filename.Replace("\\", "_");
-    filename.Replace("*", "_");
-    filename.Replace("?", "_");
-    filename.Replace("\"", "_");
-    filename.Replace("<", "_");
-    filename.Replace(">", "_");
-    filename.Replace("|", "_");
-    
-    item.name = filename;
+    item.name = MakeValidFileName(filename);
     
     // Add to list
     m_downloads.push_back(item);
@@ -128,15 +233,127 @@ int DownloadManager::AddDownload(const wxString& url, const wxString& savePath)
     
     wxLogMessage("Download added, id: %d, url: %s, filename: %s", item.id, item.url, item.name);
     
-    // Update UI
-    if (m_mainFrame) {
-        wxCommandEvent event(wxEVT_COMMAND_MENU_SELECTED, ID_UpdateUI);
-        wxPostEvent(m_mainFrame, event);
+    // Real size and name arrive from the probe long before the queue reaches the download
+    if (!url.Contains("youtube.com") && !url.Contains("youtu.be")) {
+        m_prober->Probe(item.id, url);
     }
     
+    // Update UI
+    NotifyListChanged();
+    
     return item.id;
 }
 
+// Add one download per file of a Metalink document, returns the id of the first or -1.
+// A remote document is fetched by the transfer engine and its files are added once it arrives.
+int DownloadManager::AddMetalinkDownloads(const wxString& source, const wxString& savePath, int connections)
+{
+    if (Metalink::IsRemote(source)) {
+        FetchMetalink(source, savePath, connections);
+        return -1;
+    }
+    
+    std::vector<MetalinkFile> files;
+    if (!Metalink::Load(source, files)) {
+        return -1;
+    }
+    return AddMetalinkFiles(files, savePath, connections);
+}
+
+// Download a Metalink document without blocking the caller
+void DownloadManager::FetchMetalink(const wxString& source, const wxString& savePath, int connections)
+{
+    std::shared_ptr<std::vector<char>> data = std::make_shared<std::vector<char>>();
+    CURL* curl = m_handlePool->Acquire();
+    Metalink::PrepareFetch(curl, source, data.get());
+    
+    wxLogMessage("Fetching Metalink document %s", source);
+    m_transferEngine->AddTransfer(curl, [this, data, source, savePath, connections](CURL* curl, CURLcode result) {
+        long responseCode = 0;
+        curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &responseCode);
+        m_handlePool->Release(curl);
+        
+        if (result != CURLE_OK || responseCode >= 400) {
+            wxLogError("Failed to download Metalink document %s: %s (HTTP %ld)", source, curl_easy_strerror(result), responseCode);
+            return;
+        }
+        
+        std::vector<MetalinkFile> files;
+        if (Metalink::Parse(source, *data, files)) {
+            AddMetalinkFiles(files, savePath, connections);
+        }
+    });
+}
+
+// Add the files read from a Metalink document, returns the id of the first or -1
+int DownloadManager::AddMetalinkFiles(const std::vector<MetalinkFile>& files, const wxString& savePath, int connections)
+{
+    std::lock_guard<std::mutex> lock(g_downloadMutex);
+    
+    int firstId = -1;
+    for (const auto& file : files) {
+        DownloadItem item;
+        item.id = m_nextId++;
+        item.url = file.urls.front();
+        item.mirrors.assign(file.urls.begin() + 1, file.urls.end());
+        item.savePath = savePath;
+        item.name = MakeValidFileName(file.name);
+        item.status = DownloadStatus::PENDING;
+        item.progress = 0;
+        item.size = file.size > 0 ? file.size : 0;
+        item.downloadedSize = 0;
+        item.speed = 0;
+        item.connections = connections;
+        item.expectedChecksum = file.checksum;
+        item.pieceLength = file.pieceLength;
+        item.pieceHashes = file.pieceHashes;
+        item.dateAdded = wxDateTime::Now().Format("%Y-%m-%d %H:%M:%S");
+        
+        m_downloads.push_back(item);
+        m_databaseManager->AddDownload(item);
+        
+        wxLogMessage("Metalink download added, id: %d, file: %s, mirrors: %zu, pieces: %zu", item.id, item.name, file.urls.size(), item.pieceHashes.size());
+        if (firstId < 0) {
+            firstId = item.id;
+        }
+    }
+    
+    // Update UI
+    NotifyListChanged();
+    
+    return firstId;
+}
+
+// Replace characters that are not allowed in file names
+wxString DownloadManager::MakeValidFileName(const wxString& name)
+{
+    wxString filename = name;
+    filename.Replace(":", "_");
+    filename.Replace("/", "_");
+    filename.Replace("\\", "_");
+    filename.Replace("*", "_");
+    filename.Replace("?", "_");
+    filename.Replace("\"", "_");
+    filename.Replace("<", "_");
+    filename.Replace(">", "_");
+    filename.Replace("|", "_");
+    return filename;
+}
+
+// Completed download of a URL into a folder, or -1
+int DownloadManager::FindCompletedDownload(const wxString& url, const wxString& savePath)
+{
+    std::lock_guard<std::mutex> lock(g_downloadMutex);
+    
+    for (const auto& item : m_downloads) {
+        if (item.status == DownloadStatus::COMPLETED && item.url == url && item.savePath == savePath) {
+            return item.id;
+        }
+    }
+    
+    return -1;
+}
+
 // Add YouTube download
 int DownloadManager::AddYouTubeDownload(const wxString& url, const wxString& savePath, const wxString& title, const wxString& format)
 {
@@ -187,10 +404,7 @@ int DownloadManager::AddYouTubeDownload(const wxString& url, const wxString& sav
     wxLogMessage("YouTube download added, id: %d, url: %s", item.id, item.url);
     
     // Update UI
-    if (m_mainFrame) {
-        wxCommandEvent event(wxEVT_COMMAND_MENU_SELECTED, ID_UpdateUI);
-        wxPostEvent(m_mainFrame, event);
-    }
+    NotifyListChanged();
     
     return item.id;
 }
@@ -208,22 +422,19 @@ void DownloadManager::StartDownload(int id)
     }
     
     // Check if already downloading
-    if (item->status == DownloadStatus::DOWNLOADING) {
+    if (item->status == DownloadStatus::DOWNLOADING || item->status == DownloadStatus::QUEUED) {
         wxLogMessage("Download already in progress, id: %d", id);
         return;
     }
     
-    // Set status
-    item->status = DownloadStatus::DOWNLOADING;
+    // Wait for a free slot
+    QueueDownload(item);
     
     // Update database
     m_databaseManager->UpdateDownload(*item);
     
     // Update UI
-    if (m_mainFrame) {
-        wxCommandEvent event(wxEVT_COMMAND_MENU_SELECTED, ID_UpdateUI);
-        wxPostEvent(m_mainFrame, event);
-    }
+    NotifyListChanged();
     
     // Start download thread if not running
     if (!m_isRunning) {
@@ -254,7 +465,7 @@ void DownloadManager::PauseDownload(int id)
     }
     
     // Check if downloading
-    if (item->status != DownloadStatus::DOWNLOADING) {
+    if (item->status != DownloadStatus::DOWNLOADING && item->status != DownloadStatus::QUEUED) {
         wxLogMessage("Download not in progress, id: %d", id);
         return;
     }
@@ -262,14 +473,15 @@ void DownloadManager::PauseDownload(int id)
     // Set status
     item->status = DownloadStatus::PAUSED;
     
+    // Stop the transfer and give its slot to the next download
+    AbortTask(id, false);
+    m_schedulerCondition.notify_one();
+    
     // Update database
     m_databaseManager->UpdateDownload(*item);
     
     // Update UI
-    if (m_mainFrame) {
-        wxCommandEvent event(wxEVT_COMMAND_MENU_SELECTED, ID_UpdateUI);
-        wxPostEvent(m_mainFrame, event);
-    }
+    NotifyListChanged();
     
     wxLogMessage("Download paused, id: %d", id);
 }
@@ -300,17 +512,14 @@ void DownloadManager::ResumeDownload(int id)
         return;
     }
     
-    // Set status
-    item->status = DownloadStatus::DOWNLOADING;
+    // Wait for a free slot
+    QueueDownload(item);
     
     // Update database
     m_databaseManager->UpdateDownload(*item);
     
     // Update UI
-    if (m_mainFrame) {
-        wxCommandEvent event(wxEVT_COMMAND_MENU_SELECTED, ID_UpdateUI);
-        wxPostEvent(m_mainFrame, event);
-    }
+    NotifyListChanged();
     
     // Start download thread if not running
     if (!m_isRunning) {
@@ -341,25 +550,35 @@ void DownloadManager::CancelDownload(int id)
     }
     
     // Check if downloading or paused
-    if (item->status != DownloadStatus::DOWNLOADING && item->status != DownloadStatus::PAUSED) {
+    if (item->status != DownloadStatus::DOWNLOADING && item->status != DownloadStatus::PAUSED &&
+        item->status != DownloadStatus::QUEUED) {
         wxLogMessage("Download not in progress or paused, id: %d", id);
         return;
     }
     
+    // Stop the transfer and give its slot to the next download; it drops its pieces instead of journaling them
+    AbortTask(id, true);
+    m_schedulerCondition.notify_one();
+    
+    // A stopped download has no transfer to drop its journal
+    PieceJournal journal;
+    journal.Discard(item->savePath + wxFileName::GetPathSeparator() + item->name);
+    
     // Set status
     item->status = DownloadStatus::PENDING;
     item->progress = 0;
     item->downloadedSize = 0;
     item->speed = 0;
     
+    // Forget the validators so a restart doesn't resume the canceled file
+    item->etag.Clear();
+    item->lastModified.Clear();
+    
     // Update database
     m_databaseManager->UpdateDownload(*item);
     
     // Update UI
-    if (m_mainFrame) {
-        wxCommandEvent event(wxEVT_COMMAND_MENU_SELECTED, ID_UpdateUI);
-        wxPostEvent(m_mainFrame, event);
-    }
+    NotifyListChanged();
     
     wxLogMessage("Download canceled, id: %d", id);
 }
@@ -384,6 +603,14 @@ void DownloadManager::DeleteDownload(int id)
         return;
     }
     
+    // Stop the transfer and give its slot to the next download, leaving no journal behind
+    AbortTask(id, true);
+    m_prober->Cancel(id);
+    m_schedulerCondition.notify_one();
+    
+    PieceJournal journal;
+    journal.Discard(item->savePath + wxFileName::GetPathSeparator() + item->name);
+    
     // Delete from database
     m_databaseManager->DeleteDownload(id);
     
@@ -396,10 +623,7 @@ void DownloadManager::DeleteDownload(int id)
     }
     
     // Update UI
-    if (m_mainFrame) {
-        wxCommandEvent event(wxEVT_COMMAND_MENU_SELECTED, ID_UpdateUI);
-        wxPostEvent(m_mainFrame, event);
-    }
+    NotifyListChanged();
     
     wxLogMessage("Download deleted, id: %d", id);
 }
@@ -412,6 +636,44 @@ void DownloadManager::DeleteDownloads(const std::vector<int>& ids)
     }
 }
 
+// Set download priority
+void DownloadManager::SetDownloadPriority(int id, DownloadPriority priority)
+{
+    std::lock_guard<std::mutex> lock(g_downloadMutex);
+    
+    // Find download
+    DownloadItem* item = GetDownloadById(id);
+    if (!item) {
+        wxLogError("Download not found, id: %d", id);
+        return;
+    }
+    
+    // Set priority
+    item->priority = priority;
+    
+    // Move a running transfer to the new class
+    auto it = m_tasks.find(id);
+    if (it != m_tasks.end()) {
+        it->second->SetBandwidthClass(static_cast<int>(priority));
+    }
+    
+    // Update database
+    m_databaseManager->UpdateDownload(*item);
+    
+    // Update UI
+    NotifyListChanged();
+    
+    wxLogMessage("Download priority set, id: %d", id);
+}
+
+// Set priority of multiple downloads
+void DownloadManager::SetDownloadsPriority(const std::vector<int>& ids, DownloadPriority priority)
+{
+    for (int id : ids) {
+        SetDownloadPriority(id, priority);
+    }
+}
+
 // Get download by ID
 DownloadItem* DownloadManager::GetDownloadById(int id)
 {
@@ -424,19 +686,56 @@ DownloadItem* DownloadManager::GetDownloadById(int id)
     return nullptr;
 }
 
-// Get downloads
-const std::vector<DownloadItem>& DownloadManager::GetDownloads() const
+// Get a copy of the downloads; the dispatcher and engine threads change the items under the lock
+std::vector<DownloadItem> DownloadManager::GetDownloads() const
 {
+    std::lock_guard<std::mutex> lock(g_downloadMutex);
     return m_downloads;
 }
 
+// Search the download history, called on the UI thread for every keystroke
+std::vector<int> DownloadManager::SearchDownloads(const wxString& text)
+{
+    // The database searches on its own connection, so transfers don't wait for the query
+    return m_databaseManager->SearchDownloads(text, MAX_SEARCH_RESULTS);
+}
+
 // Set speed limit
 void DownloadManager::SetSpeedLimit(long limit)
 {
     m_speedLimit = limit;
+    ApplySpeedLimit();
+    
     wxLogMessage("Speed limit set to %ld KB/s", limit);
 }
 
+// Hand the speed limit and its configured burst to the transfer engine
+void DownloadManager::ApplySpeedLimit()
+{
+    // Running transfers share one bucket and pick up the new rate immediately
+    long long bytesPerSecond = static_cast<long long>(m_speedLimit) * 1024;
+    long long burstMs = std::max(m_settings.speedLimitBurst, 1);
+    m_transferEngine->SetRateLimit(bytesPerSecond, bytesPerSecond * burstMs / 1000);
+}
+
+// Set the share of a priority class
+void DownloadManager::SetPriorityBandwidth(DownloadPriority priority, int weight, long minRate, long maxRate)
+{
+    m_transferEngine->SetBandwidthClass(static_cast<int>(priority), weight,
+                                        static_cast<long long>(minRate) * 1024, static_cast<long long>(maxRate) * 1024);
+}
+
+// Share the speed limit between the priorities as configured
+void DownloadManager::ApplyPriorityBandwidth()
+{
+    const PriorityBandwidth& high = m_settings.highPriority;
+    const PriorityBandwidth& normal = m_settings.normalPriority;
+    const PriorityBandwidth& low = m_settings.lowPriority;
+    SetPriorityBandwidth(DownloadPriority::HIGH, std::max(high.weight, 1), high.minRate, high.maxRate);
+    SetPriorityBandwidth(DownloadPriority::NORMAL, std::max(normal.weight, 1), normal.minRate, normal.maxRate);
+    SetPriorityBandwidth(DownloadPriority::LOW, std::max(low.weight, 1), low.minRate, low.maxRate);
+}
+
 // Get speed limit
 long DownloadManager::GetSpeedLimit() const
 {
@@ -447,72 +746,48 @@ long DownloadManager::GetSpeedLimit() const
 void DownloadManager::Start()
 {
     if (m_isRunning) {
-        wxLogMessage("Download thread is already running");
         return;
     }
     
     wxLogMessage("Starting download thread");
     m_isRunning = true;
     
+    if (m_dispatcherThread.joinable()) {
+        m_dispatcherThread.join();
+    }
+    
     // Start thread
-    std::thread([this]() {
+    m_dispatcherThread = std::thread([this]() {
         wxLogMessage("Download thread started");
         
+        std::unique_lock<std::mutex> lock(g_downloadMutex);
         while (m_isRunning) {
-            // Check for downloads to process
-            bool hasActiveDownloads = false;
+            // Admit queued downloads while there are free slots
+            long waitMs = ScheduleDownloads();
             
-            {
-                std::lock_guard<std::mutex> lock(g_downloadMutex);
-                
-                for (auto& item : m_downloads) {
-                    if (item.status == DownloadStatus::DOWNLOADING) {
-                        hasActiveDownloads = true;
-                        
-                        wxLogMessage("Processing download ID: %d, URL: %s", item.id, item.url);
-                        
-                        // Process download outside the lock
-                        std::thread downloadThread([this, &item]() {
-                            ProcessDownload(&item);
-                            
-                            // Update database and UI after download completes
-                            std::lock_guard<std::mutex> updateLock(g_downloadMutex);
-                            m_databaseManager->UpdateDownload(item);
-                            
-                            if (m_mainFrame) {
-                                wxCommandEvent event(wxEVT_COMMAND_MENU_SELECTED, ID_UpdateUI);
-                                wxPostEvent(m_mainFrame, event);
-                            }
-                        });
-                        
-                        // Detach the thread to let it run independently
-                        downloadThread.detach();
-                        
-                        // Only process one download at a time
-                        break;
-                    }
-                }
-            }
+            // Copy transfer progress into the download items
+            SyncProgress();
             
-            // If no active downloads, sleep for a while
-            if (!hasActiveDownloads) {
-                std::this_thread::sleep_for(std::chrono::milliseconds(500));
-            } else {
-                // If we started a download, wait a bit before checking again
-                std::this_thread::sleep_for(std::chrono::seconds(1));
-            }
+            // Sleep until a download changes state, a host may be used again or progress is due
+            m_schedulerCondition.wait_for(lock, std::chrono::milliseconds(waitMs));
         }
         
         wxLogMessage("Download thread stopped");
-    }).detach();
-    
-    wxLogMessage("Download thread detached");
+    });
 }
 
 // Stop download thread
 void DownloadManager::Stop()
 {
-    m_isRunning = false;
+    {
+        std::lock_guard<std::mutex> lock(g_downloadMutex);
+        m_isRunning = false;
+    }
+    m_schedulerCondition.notify_all();
+    
+    if (m_dispatcherThread.joinable()) {
+        m_dispatcherThread.join();
+    }
 }
 
 // Load downloads from database
@@ -529,46 +804,231 @@ void DownloadManager::LoadDownloads()
         }
     }
     
+    // The piece journal is saved more often than the database, so it knows best how much is on disk.
+    // Only started downloads have one that counts; a canceled download starts over.
+    for (auto& item : m_downloads) {
+        bool started = item.status == DownloadStatus::DOWNLOADING || item.status == DownloadStatus::QUEUED ||
+                       item.status == DownloadStatus::PAUSED || item.status == DownloadStatus::ERROR;
+        if (!started || item.isYouTube) {
+            continue;
+        }
+        
+        PieceJournal journal;
+        if (!journal.Load(item.savePath + wxFileName::GetPathSeparator() + item.name)) {
+            continue;
+        }
+        item.size = journal.GetTotalSize();
+        item.downloadedSize = journal.GetCompletedBytes();
+        item.progress = item.GetProgress();
+        item.etag = journal.GetETag();
+        item.lastModified = journal.GetLastModified();
+        m_databaseManager->UpdateDownload(item);
+    }
+    
+    // Downloads that were running or waiting go back into the queue
+    for (auto& item : m_downloads) {
+        if (item.status == DownloadStatus::DOWNLOADING || item.status == DownloadStatus::QUEUED) {
+            QueueDownload(&item);
+        }
+    }
+    
+    // Probe the new downloads whose probe didn't finish before the application closed
+    for (const auto& item : m_downloads) {
+        if (item.status == DownloadStatus::PENDING && !item.isYouTube && item.size <= 0) {
+            m_prober->Probe(item.id, item.url);
+        }
+    }
+    
     wxLogMessage("Loaded %zu downloads from database", m_downloads.size());
 }
 
-// Custom write callback for libcurl
-static size_t CustomWriteCallback(void* contents, size_t size, size_t nmemb, void* userp)
+// Put a download in the ready queue of its host, called with g_downloadMutex held
+void DownloadManager::QueueDownload(DownloadItem* item)
 {
-    FILE* fp = (FILE*)userp;
-    size_t written = fwrite(contents, size, nmemb, fp);
-    return written;
+    item->status = DownloadStatus::QUEUED;
+    m_hostQueues[GetHostName(item->url)].push_back(item->id);
+    m_schedulerCondition.notify_one();
 }
 
-// Custom progress callback for libcurl
-static int CustomProgressCallback(void* clientp, curl_off_t dltotal, curl_off_t dlnow, curl_off_t ultotal, curl_off_t ulnow)
+// Start queued downloads within the global and per-host limits, called with g_downloadMutex held.
+// Returns the longest time the scheduler may sleep.
+long DownloadManager::ScheduleDownloads()
 {
-    DownloadItem* item = (DownloadItem*)clientp;
+    int limit = std::max(m_settings.maxSimultaneousDownloads, 1);
+    int hostLimit = std::max(m_settings.maxConnectionsPerHost, 1);
+    std::chrono::milliseconds interval(std::max(m_settings.hostRequestInterval, 0));
+    long waitMs = PROGRESS_SYNC_MS;
+    bool started = false;
+    
+    while (CountActiveDownloads() < limit) {
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        
+        // Best waiting download of every host that may start one now
+        std::vector<std::pair<wxString, std::deque<int>::iterator>> candidates;
+        for (auto hostIt = m_hostQueues.begin(); hostIt != m_hostQueues.end();) {
+            const wxString& host = hostIt->first;
+            auto next = PickQueuedDownload(hostIt->second);
+            if (hostIt->second.empty()) {
+                hostIt = m_hostQueues.erase(hostIt);
+                continue;
+            }
+            if (next == hostIt->second.end()) {
+                ++hostIt;
+                continue;
+            }
+            
+            // Space out the downloads started on one host
+            auto lastStart = m_hostLastStart.find(host);
+            if (lastStart != m_hostLastStart.end() && now - lastStart->second < interval) {
+                auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(interval - (now - lastStart->second));
+                waitMs = std::min(waitMs, static_cast<long>(remaining.count()) + 1);
+                ++hostIt;
+                continue;
+            }
+            
+            // A host always gets one download, more only while its connections fit the limit
+            int hostConnections = CountHostConnections(host);
+            if (hostConnections > 0 && hostConnections + GetConnectionCount(*GetDownloadById(*next)) > hostLimit) {
+                ++hostIt;
+                continue;
+            }
+            
+            candidates.push_back(std::make_pair(host, next));
+            ++hostIt;
+        }
+        
+        if (candidates.empty()) {
+            break;
+        }
+        
+        // Round-robin over the hosts whose next download has the highest priority
+        DownloadPriority best = DownloadPriority::LOW;
+        for (const auto& candidate : candidates) {
+            best = std::max(best, GetDownloadById(*candidate.second)->priority);
+        }
+        
+        const std::pair<wxString, std::deque<int>::iterator>* chosen = nullptr;
+        for (const auto& candidate : candidates) {
+            if (GetDownloadById(*candidate.second)->priority != best) {
+                continue;
+            }
+            if (!chosen) {
+                chosen = &candidate;
+            }
+            if (candidate.first > m_lastScheduledHost) {
+                chosen = &candidate;
+                break;
+            }
+        }
+        
+        wxString host = chosen->first;
+        DownloadItem* item = GetDownloadById(*chosen->second);
+        m_hostQueues[host].erase(chosen->second);
+        m_hostLastStart[host] = now;
+        m_lastScheduledHost = host;
+        
+        wxLogMessage("Processing download ID: %d, URL: %s", item->id, item->url);
+        item->status = DownloadStatus::DOWNLOADING;
+        ProcessDownload(item);
+        m_databaseManager->UpdateDownload(*item);
+        started = true;
+    }
     
-    // Update progress
-    if (dltotal > 0) {
-        item->progress = static_cast<int>((dlnow * 100) / dltotal);
-        item->size = dltotal;
-        item->downloadedSize = dlnow;
-    } else {
-        // If total size is unknown, just show downloaded size
-        item->downloadedSize = dlnow;
+    if (started) {
+        NotifyListChanged();
     }
     
-    // Calculate speed (bytes per second)
-    static auto lastTime = std::chrono::steady_clock::now();
-    static curl_off_t lastBytes = 0;
+    return waitMs;
+}
+
+// Drop stale ids from a host queue and find its highest-priority download
+std::deque<int>::iterator DownloadManager::PickQueuedDownload(std::deque<int>& queue)
+{
+    auto next = queue.end();
+    for (auto it = queue.begin(); it != queue.end();) {
+        DownloadItem* item = GetDownloadById(*it);
+        if (!item || item->status != DownloadStatus::QUEUED) {
+            // Deleted, paused or already started since it was queued
+            it = queue.erase(it);
+            continue;
+        }
+        
+        // The previous transfer of a restarted download is still writing out and closing its file
+        if (m_tasks.count(item->id)) {
+            ++it;
+            continue;
+        }
+        if (next == queue.end() || item->priority > GetDownloadById(*next)->priority) {
+            next = it;
+        }
+        ++it;
+    }
     
-    auto now = std::chrono::steady_clock::now();
-    auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(now - lastTime).count();
+    return next;
+}
+
+// Number of downloads holding a slot, called with g_downloadMutex held
+int DownloadManager::CountActiveDownloads() const
+{
+    int active = 0;
+    for (const auto& item : m_downloads) {
+        if (item.status == DownloadStatus::DOWNLOADING) {
+            active++;
+        }
+    }
+    
+    return active;
+}
+
+// Connections held by the running downloads of a host, called with g_downloadMutex held
+int DownloadManager::CountHostConnections(const wxString& host) const
+{
+    int connections = 0;
+    for (const auto& item : m_downloads) {
+        if (item.status == DownloadStatus::DOWNLOADING && GetHostName(item.url) == host) {
+            connections += GetConnectionCount(item);
+        }
+    }
+    
+    return connections;
+}
+
+// Connections a download uses or may open
+int DownloadManager::GetConnectionCount(const DownloadItem& item) const
+{
+    if (item.url.Contains("youtube.com") || item.url.Contains("youtu.be")) {
+        return 1;
+    }
+    
+    // Running transfers tune their own count
+    auto it = m_tasks.find(item.id);
+    if (it != m_tasks.end()) {
+        return it->second->GetConnectionCount();
+    }
+    
+    // A server without ranges is downloaded over one connection
+    if (!item.acceptRanges) {
+        return 1;
+    }
     
-    if (duration > 1000) {  // Update speed every second
-        item->speed = static_cast<long long>((dlnow - lastBytes) * 1000 / duration);
-        lastTime = now;
-        lastBytes = dlnow;
+    return std::max(item.connections > 0 ? item.connections : m_settings.maxConnectionsPerDownload, 1);
+}
+
+// Lower-case host and port of a URL, used as the key of the host queues
+wxString DownloadManager::GetHostName(const wxString& url)
+{
+    wxString host = url;
+    int schemeEnd = host.Find("://");
+    if (schemeEnd != wxNOT_FOUND) {
+        host = host.Mid(schemeEnd + 3);
     }
     
-    return 0;  // Return 0 to continue download
+    host = host.BeforeFirst('/').BeforeFirst('?').BeforeFirst('#');
+    if (host.Contains("@")) {
+        host = host.AfterLast('@');
+    }
+    
+    return host.Lower();
 }
 
 // Process download
@@ -596,257 +1056,254 @@ void DownloadManager::ProcessDownload(DownloadItem* item)
     wxString filePath = item->savePath + wxFileName::GetPathSeparator() + item->name;
     wxLogMessage("File path: %s", filePath);
     
-    // Check if this is a YouTube URL
+    // YouTube downloads run an external process and keep their own thread
     if (item->url.Contains("youtube.com") || item->url.Contains("youtu.be")) {
         wxLogMessage("Detected YouTube URL");
-        if (!m_settings.youtubeExecutablePath.IsEmpty()) {
-            wxLogMessage("Using YouTube-DL: %s", m_settings.youtubeExecutablePath);
-            
-            // Create a temporary file to store the output
-            wxString tempFile = wxFileName::CreateTempFileName("yt_dl_output");
-            
-            // Build the command
-            wxString command = wxString::Format("\"%s\" -o \"%s\" -f \"%s\" \"%s\" > \"%s\" 2>&1", 
-                                              m_settings.youtubeExecutablePath,
-                                              filePath,
-                                              m_settings.youtubeDefaultFormat,
-                                              item->url,
-                                              tempFile);
-            
-            wxLogMessage("Executing command: %s", command);
-            
-            // Execute the command
-            long exitCode = wxExecute(command, wxEXEC_SYNC);
-            
-            // Read the output
-            wxTextFile outputFile;
-            if (outputFile.Open(tempFile)) {
-                for (wxString line = outputFile.GetFirstLine(); !outputFile.Eof(); line = outputFile.GetNextLine()) {
-                    wxLogMessage("youtube-dl: %s", line);
-                }
-                outputFile.Close();
+        m_youtubeDownloads.insert(item->id);
+        std::thread(&DownloadManager::ProcessYouTubeDownload, this, item->id, item->url, filePath).detach();
+        return;
+    }
+    
+    // A fixed connection count is an upper bound; otherwise start from what worked best for the host
+    int connections = item->connections;
+    int maxConnections = item->connections;
+    if (connections <= 0) {
+        maxConnections = std::max(m_settings.maxConnectionsPerHost, 1);
+        connections = m_databaseManager->GetHostConnections(GetHostName(item->url));
+        if (connections <= 0) {
+            connections = std::min(m_settings.maxConnectionsPerDownload, maxConnections);
+        }
+    }
+    
+    // Regular downloads are driven by the transfer engine, which probes the URL itself from here on
+    m_prober->Cancel(item->id);
+    std::shared_ptr<DownloadTask> task = std::make_shared<DownloadTask>(m_transferEngine, m_handlePool, m_diskWriter, *item, filePath, connections, maxConnections,
+        [this](DownloadTask* finished) { OnTaskFinished(finished); });
+    task->SetWriteMode(m_settings.writeMode);
+    task->SetRedirectCache(m_redirectCache);
+    task->SetHashWorker(m_hashWorker);
+    task->SetProgressSlot(m_progress.Open(item->id));
+    m_tasks[item->id] = task;
+    
+    m_transferEngine->Post([task]() { task->Start(); });
+}
+
+// Run youtube-dl for a download
+void DownloadManager::ProcessYouTubeDownload(int id, const wxString& url, const wxString& filePath)
+{
+    DownloadStatus status = DownloadStatus::ERROR;
+    double size = 0;
+    
+    if (!m_settings.youtubeExecutablePath.IsEmpty()) {
+        wxLogMessage("Using YouTube-DL: %s", m_settings.youtubeExecutablePath);
+        
+        // Create a temporary file to store the output
+        wxString tempFile = wxFileName::CreateTempFileName("yt_dl_output");
+        
+        // Build the command
+        wxString command = wxString::Format("\"%s\" -o \"%s\" -f \"%s\" \"%s\" > \"%s\" 2>&1", 
+                                          m_settings.youtubeExecutablePath,
+                                          filePath,
+                                          m_settings.youtubeDefaultFormat,
+                                          url,
+                                          tempFile);
+        
+        wxLogMessage("Executing command: %s", command);
+        
+        // Execute the command
+        long exitCode = wxExecute(command, wxEXEC_SYNC);
+        
+        // Read the output
+        wxTextFile outputFile;
+        if (outputFile.Open(tempFile)) {
+            for (wxString line = outputFile.GetFirstLine(); !outputFile.Eof(); line = outputFile.GetNextLine()) {
+                wxLogMessage("youtube-dl: %s", line);
             }
+            outputFile.Close();
+        }
+        
+        // Delete the temporary file
+        wxRemoveFile(tempFile);
+        
+        if (exitCode == 0) {
+            wxLogMessage("YouTube download completed successfully");
+            status = DownloadStatus::COMPLETED;
             
-            // Delete the temporary file
-            wxRemoveFile(tempFile);
-            
-            if (exitCode == 0) {
-                wxLogMessage("YouTube download completed successfully");
-                item->status = DownloadStatus::COMPLETED;
-                item->progress = 100;
-                
-                // Get file size
-                wxFileName fn(filePath);
-                if (fn.FileExists()) {
-                    item->size = fn.GetSize().ToULong();
-                    item->downloadedSize = item->size;
-                }
-                
-                return;
-            } else {
-                wxLogError("YouTube download failed with exit code: %ld", exitCode);
-                item->status = DownloadStatus::ERROR;
-                return;
+            // Get file size
+            wxFileName fn(filePath);
+            if (fn.FileExists()) {
+                size = fn.GetSize().ToULong();
             }
         } else {
-            wxLogError("YouTube-DL path not set in settings");
-            item->status = DownloadStatus::ERROR;
-            return;
+            wxLogError("YouTube download failed with exit code: %ld", exitCode);
         }
+    } else {
+        wxLogError("YouTube-DL path not set in settings");
     }
     
-    // Regular download process using libcurl
-    wxLogMessage("Using libcurl for download: %s", item->url);
+    // Update database and UI after download completes
+    std::lock_guard<std::mutex> lock(g_downloadMutex);
+    m_youtubeDownloads.erase(id);
+    m_schedulerCondition.notify_one();
     
-    // Initialize error buffer
-    char errorBuffer[CURL_ERROR_SIZE];
-    memset(errorBuffer, 0, CURL_ERROR_SIZE);
+    DownloadItem* item = GetDownloadById(id);
+    if (!item) {
+        return;
+    }
     
-    // Maximum number of retries
-    const int MAX_RETRIES = 3;
-    bool downloadSuccess = false;
+    item->status = status;
+    if (status == DownloadStatus::COMPLETED) {
+        item->progress = 100;
+        item->size = size;
+        item->downloadedSize = size;
+    }
+    m_databaseManager->UpdateDownload(*item);
     
-    for (int retryCount = 0; retryCount < MAX_RETRIES && !downloadSuccess; retryCount++) {
-        if (retryCount > 0) {
-            wxLogMessage("Retry attempt %d of %d for URL: %s", retryCount + 1, MAX_RETRIES, item->url);
-            std::this_thread::sleep_for(std::chrono::seconds(2));
-        }
-        
-        CURL* curl = curl_easy_init();
-        if (!curl) {
-            wxLogError("Failed to initialize curl");
-            continue;
+    NotifyListChanged();
+}
+
+// Record the result of a transfer, called on the engine thread
+void DownloadManager::OnTaskFinished(DownloadTask* task)
+{
+    std::lock_guard<std::mutex> lock(g_downloadMutex);
+    int id = task->GetId();
+    
+    DownloadItem* item = GetDownloadById(id);
+    if (item && item->status != DownloadStatus::PENDING) {
+        // Bytes kept on disk and the validators needed to resume after them
+        item->downloadedSize = task->GetDownloaded();
+        if (task->GetTotalSize() > 0) {
+            item->size = task->GetTotalSize();
+            item->progress = static_cast<int>((task->GetDownloaded() * 100) / task->GetTotalSize());
         }
+        item->speed = 0;
+        item->segments.clear();
+        item->etag = task->GetETag();
+        item->lastModified = task->GetLastModified();
         
-        // Open file for writing
-        FILE* fp = fopen(filePath.c_str(), "wb");
-        if (!fp) {
-            wxLogError("Failed to open file for writing: %s", filePath);
-            curl_easy_cleanup(curl);
-            continue;
+        // Mirrors that sent another file are not tried again
+        if (!item->mirrors.empty()) {
+            item->mirrors = task->GetMirrors();
         }
         
-        // Process URL - encode spaces and special characters
-        wxString processedUrl = item->url;
-        
-        // Check for spaces or special characters and encode them properly
-        if (processedUrl.Contains(" ") || processedUrl.Contains("\"") || processedUrl.Contains("'") || 
-            processedUrl.Contains("<") || processedUrl.Contains(">") || processedUrl.Contains("[") || 
-            processedUrl.Contains("]")) {
-            wxLogMessage("URL contains spaces or special characters, encoding it");
-            
-            // Use curl's URL encoding function
-            char* output = curl_easy_escape(curl, processedUrl.c_str(), processedUrl.length());
-            if (output) {
-                // We need to preserve the http:// or https:// part
-                wxString protocol;
-                if (processedUrl.StartsWith("http://")) {
-                    protocol = "http://";
-                } else if (processedUrl.StartsWith("https://")) {
-                    protocol = "https://";
-                }
+        // Paused downloads keep the status set by the user
+        if (!task->IsAborted()) {
+            if (task->IsSucceeded() && task->IsNotModified()) {
+                // The file on disk is still current and keeps its digests
+                item->status = DownloadStatus::COMPLETED;
+                item->progress = 100;
+                wxLogMessage("Download not modified: %s", item->name);
+            } else if (task->IsSucceeded()) {
+                item->status = DownloadStatus::COMPLETED;
+                item->progress = 100;
+                item->sha256 = task->GetDigest(ChecksumType::SHA256);
+                item->md5 = task->GetDigest(ChecksumType::MD5);
+                item->crc32c = task->GetDigest(ChecksumType::CRC32C);
+                wxLogMessage("Download completed: %s", item->name);
                 
-                // Combine protocol with encoded URL, but be careful not to double-encode
-                if (!protocol.IsEmpty()) {
-                    wxString encodedPart = wxString(output);
-                    // Remove the protocol part from the encoded string if it's there
-                    if (encodedPart.StartsWith("http%3A%2F%2F")) {
-                        encodedPart = encodedPart.Mid(13);
-                        processedUrl = protocol + encodedPart;
-                    } else if (encodedPart.StartsWith("https%3A%2F%2F")) {
-                        encodedPart = encodedPart.Mid(14);
-                        processedUrl = protocol + encodedPart;
+                // The digests were computed while downloading, so the result is known right away
+                ChecksumType type = ChecksumType::NONE;
+                wxString expected;
+                if (!item->expectedChecksum.IsEmpty()) {
+                    if (StreamHasher::ParseChecksum(item->expectedChecksum, type, expected) && task->GetDigest(type) == expected) {
+                        wxLogMessage("Checksum verified: %s", item->name);
                     } else {
-                        // If the protocol wasn't encoded, just use the encoded string
-                        processedUrl = encodedPart;
+                        item->status = DownloadStatus::ERROR;
+                        wxLogError("Checksum mismatch for %s: expected %s, got %s", item->name, item->expectedChecksum, task->GetDigest(type));
                     }
-                } else {
-                    processedUrl = wxString(output);
                 }
-                
-                curl_free(output);
             } else {
-                // Manual encoding for basic cases
-                processedUrl.Replace(" ", "%20");
-                processedUrl.Replace("\"", "%22");
-                processedUrl.Replace("'", "%27");
-                processedUrl.Replace("<", "%3C");
-                processedUrl.Replace(">", "%3E");
-                processedUrl.Replace("[", "%5B");
-                processedUrl.Replace("]", "%5D");
+                item->status = DownloadStatus::ERROR;
+                wxLogError("All download attempts failed for URL: %s", item->url);
             }
-            
-            wxLogMessage("Encoded URL: %s", processedUrl);
-        }
-        
-        // Set up headers to mimic a browser
-        struct curl_slist *headers = NULL;
-        headers = curl_slist_append(headers, "User-Agent: Mozilla/5.0 (Windows NT 10.0; Win64; x64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/120.0.0.0 Safari/537.36");
-        headers = curl_slist_append(headers, "Accept: */*");
-        headers = curl_slist_append(headers, "Accept-Language: en-US,en;q=0.9,ar;q=0.8");
-        headers = curl_slist_append(headers, "Connection: keep-alive");
-        
-        // Extract the domain from the URL to use as the Referer
-        wxString domain;
-        if (processedUrl.StartsWith("http://")) {
-            domain = processedUrl.Mid(7).BeforeFirst('/');
-        } else if (processedUrl.StartsWith("https://")) {
-            domain = processedUrl.Mid(8).BeforeFirst('/');
         }
         
-        if (!domain.IsEmpty()) {
-            wxString referer = "Referer: http://" + domain + "/";
-            headers = curl_slist_append(headers, referer.c_str());
+        m_databaseManager->UpdateDownload(*item);
+    }
+    
+    // Start the next download from this host with the connection count that worked best
+    if (item && item->connections <= 0 && task->GetBestConnections() > 0) {
+        m_databaseManager->SaveHostConnections(GetHostName(item->url), task->GetBestConnections());
+    }
+    
+    // A slot is free for the next queued download
+    m_schedulerCondition.notify_one();
+    
+    // Release the task once its callback has returned
+    m_transferEngine->Post([this, id, task]() {
+        std::lock_guard<std::mutex> lock(g_downloadMutex);
+        auto it = m_tasks.find(id);
+        if (it != m_tasks.end() && it->second.get() == task) {
+            m_tasks.erase(it);
+            m_progress.Close(id);
             
-            wxString origin = "Origin: http://" + domain;
-            headers = curl_slist_append(headers, origin.c_str());
-        }
-        
-        // Special handling for mp3quran.net
-        if (item->url.Contains("mp3quran.net")) {
-            wxLogMessage("Adding special headers for mp3quran.net");
-            headers = curl_slist_append(headers, "Referer: https://mp3quran.net/");
-            headers = curl_slist_append(headers, "Origin: https://mp3quran.net");
-            headers = curl_slist_append(headers, "Accept: audio/webm,audio/ogg,audio/mp3,audio/*;q=0.9");
+            // A restart of the download may have waited for the file to be closed
+            m_schedulerCondition.notify_one();
         }
-        
-        // Set up libcurl options
-        curl_easy_setopt(curl, CURLOPT_URL, processedUrl.c_str());
-        curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, CustomWriteCallback);
-        curl_easy_setopt(curl, CURLOPT_WRITEDATA, fp);
-        curl_easy_setopt(curl, CURLOPT_NOPROGRESS, 0L);
-        curl_easy_setopt(curl, CURLOPT_XFERINFOFUNCTION, CustomProgressCallback);
-        curl_easy_setopt(curl, CURLOPT_XFERINFODATA, item);
-        curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
-        curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
-        curl_easy_setopt(curl, CURLOPT_COOKIEFILE, ""); // Enable cookies
-        curl_easy_setopt(curl, CURLOPT_VERBOSE, 1L); // Enable verbose output for debugging
-        curl_easy_setopt(curl, CURLOPT_ERRORBUFFER, errorBuffer); // Set error buffer
-        curl_easy_setopt(curl, CURLOPT_TIMEOUT, 300L); // 5 minute timeout
-        curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT, 30L); // 30 second connect timeout
-        curl_easy_setopt(curl, CURLOPT_SSL_VERIFYPEER, 0L); // Don't verify SSL certificates
-        curl_easy_setopt(curl, CURLOPT_SSL_VERIFYHOST, 0L); // Don't verify host
-        
-        // Apply speed limit if set
-        if (m_speedLimit > 0) {
-            curl_easy_setopt(curl, CURLOPT_MAX_RECV_SPEED_LARGE, (curl_off_t)m_speedLimit * 1024);
+    });
+    
+    NotifyListChanged();
+}
+
+// Fill in what the headers of a new URL tell, called on the engine thread
+void DownloadManager::OnProbeResult(const ProbeResult& result)
+{
+    std::lock_guard<std::mutex> lock(g_downloadMutex);
+    
+    // Downloads that started meanwhile learn the same from their own requests
+    DownloadItem* item = GetDownloadById(result.id);
+    if (!item || !result.succeeded || m_tasks.count(result.id) || item->downloadedSize > 0) {
+        return;
+    }
+    
+    if (result.size > 0) {
+        item->size = result.size;
+    }
+    item->acceptRanges = result.acceptRanges;
+    
+    // The server's name beats the last part of the URL
+    if (!result.fileName.IsEmpty()) {
+        item->name = MakeValidFileName(result.fileName);
+    }
+    if (!result.finalUrl.IsEmpty() && result.finalUrl != item->url) {
+        wxLogMessage("Download id %d redirects to %s", item->id, result.finalUrl);
+    }
+    
+    m_databaseManager->UpdateDownload(*item);
+    
+    NotifyListChanged();
+}
+
+// Stop the transfer of a download, called with g_downloadMutex held
+void DownloadManager::AbortTask(int id, bool discard)
+{
+    auto it = m_tasks.find(id);
+    if (it == m_tasks.end()) {
+        return;
+    }
+    
+    std::shared_ptr<DownloadTask> task = it->second;
+    m_transferEngine->Post([task, discard]() { task->Abort(discard); });
+}
+
+// Copy progress of running transfers into the items, called with g_downloadMutex held
+void DownloadManager::SyncProgress()
+{
+    for (auto& entry : m_tasks) {
+        DownloadItem* item = GetDownloadById(entry.first);
+        if (!item || item->status != DownloadStatus::DOWNLOADING) {
+            continue;
         }
         
-        // Execute the request
-        wxLogMessage("Executing curl request");
-        CURLcode res = curl_easy_perform(curl);
-        
-        // Close the file
-        fclose(fp);
-        
-        // Free the headers
-        curl_slist_free_all(headers);
-        
-        // Check the result
-        if (res != CURLE_OK) {
-            wxLogError("curl_easy_perform() failed: %s", curl_easy_strerror(res));
-            
-            // Get more detailed error information
-            long response_code = 0;
-            curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &response_code);
-            
-            if (response_code > 0) {
-                wxLogError("HTTP response code: %ld", response_code);
-            }
-            
-            // Log the error buffer content
-            wxLogError("Error details: %s", errorBuffer);
-            
-            // Clean up libcurl
-            curl_easy_cleanup(curl);
-            
-            // Continue to next retry
-            continue;
-        } else {
-            // Get download information
-            curl_off_t downloadedSize;
-            curl_easy_getinfo(curl, CURLINFO_SIZE_DOWNLOAD_T, &downloadedSize);
-            item->downloadedSize = static_cast<long long>(downloadedSize);
-            item->size = item->downloadedSize;
-            item->status = DownloadStatus::COMPLETED;
-            item->progress = 100;
-            
-            wxLogMessage("Download completed: %s", item->name);
-            downloadSuccess = true;
-            
-            // Clean up libcurl
-            curl_easy_cleanup(curl);
-            
-            // Break out of retry loop
-            break;
+        const std::shared_ptr<DownloadTask>& task = entry.second;
+        item->downloadedSize = task->GetDownloaded();
+        item->speed = task->GetSpeed();
+        item->segments = task->GetSegmentProgress();
+        if (task->GetTotalSize() > 0) {
+            item->size = task->GetTotalSize();
+            item->progress = static_cast<int>((task->GetDownloaded() * 100) / task->GetTotalSize());
         }
     }
-    
-    // If all retries failed, set status to ERROR
-    if (!downloadSuccess) {
-        item->status = DownloadStatus::ERROR;
-        wxLogError("All download attempts failed for URL: %s", item->url);
-    }
 }
 
 // Transform tvquran.com URL to a more direct format
@@ -891,8 +1348,15 @@ wxString DownloadManager::EncodeURL(const wxString& url) {
 // Save settings
 void DownloadManager::SaveSettings(const AppSettings& settings)
 {
+    std::lock_guard<std::mutex> lock(g_downloadMutex);
     m_settings = settings;
     m_settings.Save();
+    
+    // New limits apply to running transfers and admit queued downloads right away
+    m_transferEngine->SetMaxHostConnections(m_settings.maxConnectionsPerHost);
+    ApplySpeedLimit();
+    ApplyPriorityBandwidth();
+    m_schedulerCondition.notify_one();
     wxLogMessage("Settings saved");
 }
 
@@ -0,0 +1,1828 @@
+#include "Managers/DownloadTask.h"
+#include "Managers/TransferEngine.h"
+#include "Managers/CurlHandlePool.h"
+#include "Managers/DiskWriter.h"
+#include "Managers/HashWorker.h"
+#include <wx/log.h>
+#include <wx/filename.h>
+#include <cstring>
+#include <algorithm>
+
+#ifdef _WIN32
+#include <io.h>
+#include <fcntl.h>
+#else
+#include <unistd.h>
+#endif
+
+// Transfer tuning
+static const int MAX_RETRIES = 3;
+static const long RETRY_DELAY_MS = 2000;
+static const curl_off_t MIN_SEGMENT_SIZE = 1024 * 1024; // Don't split below 1 MB per connection
+static const curl_off_t MIN_PIECE_SIZE = 256 * 1024;     // Don't steal ranges smaller than this
+static const long CONTROL_INTERVAL_MS = 2000;            // Throughput sample length for the connection count
+static const long JOURNAL_SAVE_MS = 2000;                // Longest time finished pieces go unrecorded
+static const size_t HASH_READ_SIZE = 1024 * 1024;        // Block size when reading the file back for the checksums
+static const curl_off_t HASH_CATCH_UP_BYTES = 64 * 1024 * 1024; // Read-back limit per worker job during the transfer
+static const long STALL_TIMEOUT_MS = 30000;              // A connection without data this long has stalled
+
+// Constructor
+DownloadTask::DownloadTask(TransferEngine* engine, CurlHandlePool* pool, DiskWriter* diskWriter, const DownloadItem& item, const wxString& filePath,
+                           int connections, int maxConnections, FinishedHandler onFinished)
+    : m_engine(engine), m_pool(pool), m_diskWriter(diskWriter), m_onFinished(onFinished), m_id(item.id), m_url(item.url), m_filePath(filePath),
+      m_connections(connections), m_bandwidthClass(static_cast<int>(item.priority)), m_headers(nullptr), m_redirects(nullptr), m_phase(Phase::IDLE),
+      m_succeeded(false), m_aborted(false), m_discard(false), m_etag(item.etag), m_lastModified(item.lastModified),
+      m_keptBytes(static_cast<curl_off_t>(item.downloadedSize)), m_resumeFrom(0), m_rangeChecked(false),
+      m_knownSize(static_cast<curl_off_t>(item.size)), m_conditional(false), m_notModified(false), m_resumeHeaders(nullptr),
+      m_writeMode(WriteMode::BUFFERED), m_curl(nullptr), m_retries(0), m_activeSegments(0),
+      m_controller(connections, 1, maxConnections), m_controlBytes(0), m_journalScheduled(false),
+      m_hashWorker(nullptr), m_hashTarget(0), m_pieceLength(item.pieceLength), m_pieceHashes(item.pieceHashes), m_downloaded(0), m_totalSize(0), m_speed(0), m_eta(-1)
+{
+    memset(m_errorBuffer, 0, CURL_ERROR_SIZE);
+    
+    // Prepare the request URL and headers once for all attempts
+    m_processedUrl = PrepareUrl(m_url);
+    m_headers = BuildRequestHeaders(m_url, m_processedUrl);
+    
+    // The main URL is the first mirror
+    MirrorSource main;
+    main.url = m_url;
+    main.requestUrl = m_processedUrl;
+    m_mirrors.push_back(main);
+    for (const auto& url : item.mirrors) {
+        bool known = std::any_of(m_mirrors.begin(), m_mirrors.end(), [&url](const MirrorSource& mirror) {
+            return mirror.url == url;
+        });
+        if (!known && !url.IsEmpty()) {
+            MirrorSource mirror;
+            mirror.url = url;
+            mirror.requestUrl = PrepareUrl(url);
+            m_mirrors.push_back(mirror);
+        }
+    }
+    
+    // Shared with the disk writer until the last buffer of the file is written
+    m_writer = std::make_shared<FileWriter>();
+}
+
+// Destructor
+DownloadTask::~DownloadTask()
+{
+    if (m_hashCancel) {
+        *m_hashCancel = true;
+    }
+    
+    if (m_curl) {
+        m_pool->Release(m_curl);
+    }
+    
+    for (auto& segment : m_segments) {
+        if (segment->curl) {
+            m_pool->Release(segment->curl);
+        }
+    }
+    
+    curl_slist_free_all(m_headers);
+    curl_slist_free_all(m_resumeHeaders);
+}
+
+// Start the transfer
+void DownloadTask::Start()
+{
+    wxLogMessage("Using libcurl for download: %s", m_url);
+    
+    // Pieces left by an earlier attempt; the journal knows which version of the file they belong to
+    if (m_journal.Load(m_filePath)) {
+        m_etag = m_journal.GetETag();
+        m_lastModified = m_journal.GetLastModified();
+        m_keptBytes = m_journal.GetContiguousBytes();
+        wxLogMessage("Journal of download id %d has %lld of %lld bytes", m_id, m_journal.GetCompletedBytes(), m_journal.GetTotalSize());
+    }
+    
+    // Continue after the bytes already on disk when the server copy can be validated
+    m_resumeFrom = GetResumeOffset();
+    if (m_resumeFrom > 0) {
+        wxLogMessage("Resuming download id %d from byte %lld", m_id, (long long)m_resumeFrom);
+    }
+    m_downloaded = m_resumeFrom;
+    m_rate.Reset(m_resumeFrom);
+    
+    // A complete copy is checked with If-None-Match/If-Modified-Since before anything is fetched
+    m_conditional = !m_journal.IsValid() && IsCompleteOnDisk();
+    
+    // Use several connections only when the server supports byte ranges;
+    // journaled pieces, mirrors and piece hashes also need ranges
+    if (m_connections > 1 || m_journal.IsValid() || m_mirrors.size() > 1 || m_pieceLength > 0 || m_conditional) {
+        StartProbe();
+    } else {
+        StartSingleStream();
+    }
+}
+
+// Stop every connection of the task
+void DownloadTask::Abort(bool discard)
+{
+    if (m_phase == Phase::FINISHED) {
+        return;
+    }
+    
+    wxLogMessage("Aborting download, id: %d", m_id);
+    m_aborted = true;
+    m_discard = discard;
+    
+    if (m_curl) {
+        m_engine->RemoveTransfer(m_curl);
+    }
+    for (auto& segment : m_segments) {
+        if (segment->curl) {
+            StopSegment(segment.get());
+        }
+    }
+    
+    Finish(false);
+}
+
+// Ask the server for the first byte to find out the size and range support
+void DownloadTask::StartProbe()
+{
+    m_phase = Phase::PROBING;
+    
+    m_curl = CreateHandle(m_errorBuffer);
+    if (!m_curl) {
+        Finish(false);
+        return;
+    }
+    
+    curl_easy_setopt(m_curl, CURLOPT_RANGE, "0-0");
+    
+    // The server answers 304 instead of the range when the copy on disk is current
+    if (m_conditional) {
+        curl_slist_free_all(m_resumeHeaders);
+        m_resumeHeaders = BuildRequestHeaders(m_url, m_processedUrl);
+        if (!m_etag.IsEmpty()) {
+            wxString ifNoneMatch = "If-None-Match: " + m_etag;
+            m_resumeHeaders = curl_slist_append(m_resumeHeaders, ifNoneMatch.c_str());
+        }
+        if (!m_lastModified.IsEmpty()) {
+            wxString ifModifiedSince = "If-Modified-Since: " + m_lastModified;
+            m_resumeHeaders = curl_slist_append(m_resumeHeaders, ifModifiedSince.c_str());
+        }
+        curl_easy_setopt(m_curl, CURLOPT_HTTPHEADER, m_resumeHeaders);
+    }
+    curl_easy_setopt(m_curl, CURLOPT_HEADERFUNCTION, OnHeader);
+    curl_easy_setopt(m_curl, CURLOPT_HEADERDATA, &m_info);
+    curl_easy_setopt(m_curl, CURLOPT_WRITEFUNCTION, OnProbeWrite);
+    curl_easy_setopt(m_curl, CURLOPT_WRITEDATA, m_curl);
+    curl_easy_setopt(m_curl, CURLOPT_TIMEOUT, 30L);
+    
+    std::weak_ptr<DownloadTask> weak = shared_from_this();
+    m_engine->AddTransfer(m_curl, [weak](CURL*, CURLcode result) {
+        if (auto task = weak.lock()) {
+            task->OnProbeDone(result);
+        }
+    });
+}
+
+// Choose a transfer mode from the probe result
+void DownloadTask::OnProbeDone(CURLcode result)
+{
+    long responseCode = 0;
+    curl_easy_getinfo(m_curl, CURLINFO_RESPONSE_CODE, &responseCode);
+    RecordRedirect(m_curl, 0, m_info, responseCode);
+    m_pool->Release(m_curl);
+    m_curl = nullptr;
+    
+    // Nothing changed since the last complete download
+    if (responseCode == 304 && m_conditional) {
+        wxLogMessage("Download id %d is not modified on the server, keeping %s", m_id, m_filePath);
+        m_notModified = true;
+        m_totalSize = m_knownSize;
+        m_downloaded = m_knownSize;
+        Finish(true);
+        return;
+    }
+    
+    // A 206 answer is proof of range support even without Accept-Ranges
+    m_info.acceptRanges = (responseCode == 206 && result == CURLE_OK);
+    
+    wxLogMessage("Probe result for %s: HTTP %ld, ranges: %d, size: %lld", m_url, responseCode, m_info.acceptRanges ? 1 : 0, (long long)m_info.contentLength);
+    
+    // Drop the partial file if it belongs to another version of the remote file
+    if ((m_resumeFrom > 0 || m_journal.IsValid()) && m_info.acceptRanges) {
+        bool sameSize = !m_journal.IsValid() || m_journal.GetTotalSize() == m_info.contentLength;
+        if (!ValidatorsMatch(m_info) || m_resumeFrom > m_info.contentLength || !sameSize) {
+            wxLogMessage("Remote file changed, restarting download id %d from zero", m_id);
+            m_journal.Discard(m_filePath);
+            TruncateFile(0);
+            m_resumeFrom = 0;
+            m_downloaded = 0;
+            m_rate.Reset(0);
+        } else if (m_resumeFrom == m_info.contentLength || m_journal.IsComplete()) {
+            wxLogMessage("Download id %d is already complete on disk", m_id);
+            m_totalSize = m_info.contentLength;
+            m_downloaded = m_info.contentLength;
+            AdoptValidators(m_info);
+            Finish(true);
+            return;
+        }
+    }
+    if (m_info.acceptRanges) {
+        AdoptValidators(m_info);
+    }
+    
+    // Missing journal pieces and hashed pieces are always fetched as ranges, however few there are
+    bool needRanges = m_journal.IsValid() || m_pieceLength > 0;
+    if (m_info.acceptRanges && (needRanges || m_info.contentLength - m_resumeFrom >= MIN_SEGMENT_SIZE * 2)) {
+        if (StartSegments()) {
+            return;
+        }
+        wxLogMessage("Segmented download failed, falling back to a single connection: %s", m_url);
+    } else {
+        wxLogMessage("Server does not support ranges, using a single connection: %s", m_url);
+    }
+    
+    StartSingleStream();
+}
+
+// Download the whole file over one connection
+void DownloadTask::StartSingleStream()
+{
+    m_phase = Phase::SINGLE;
+    
+    if (m_retries > 0) {
+        wxLogMessage("Retry attempt %d of %d for URL: %s", m_retries + 1, MAX_RETRIES, m_url);
+    }
+    
+    m_curl = CreateHandle(m_errorBuffer);
+    if (!m_curl) {
+        Finish(false);
+        return;
+    }
+    
+    // Continue after the bytes already on disk, or start a new file. Journaled pieces
+    // after the resume offset stay; the stream writes the same bytes over them.
+    m_resumeFrom = GetResumeOffset();
+    if (m_resumeFrom == 0) {
+        m_journal.Discard(m_filePath);
+    }
+    if (!m_writer->Open(m_filePath, m_resumeFrom == 0) || (m_resumeFrom > 0 && !m_journal.IsValid() && !m_writer->Truncate(m_resumeFrom))) {
+        Finish(false);
+        return;
+    }
+    m_downloaded = m_resumeFrom;
+    m_rate.Reset(m_resumeFrom);
+    m_rangeChecked = false;
+    m_info = RemoteFileInfo();
+    
+    // The stream is hashed as it arrives once the bytes before it are
+    DropHash(m_resumeFrom);
+    CatchUpHash(-1);
+    
+    // If-Range makes the server send the whole file when it changed since the partial download
+    if (m_resumeFrom > 0) {
+        wxString range = wxString::Format("%lld-", (long long)m_resumeFrom);
+        wxString ifRange = "If-Range: " + GetIfRangeValidator();
+        
+        curl_slist_free_all(m_resumeHeaders);
+        m_resumeHeaders = BuildRequestHeaders(m_url, m_processedUrl);
+        m_resumeHeaders = curl_slist_append(m_resumeHeaders, ifRange.c_str());
+        
+        curl_easy_setopt(m_curl, CURLOPT_RANGE, range.c_str());
+        curl_easy_setopt(m_curl, CURLOPT_HTTPHEADER, m_resumeHeaders);
+    }
+    
+    curl_easy_setopt(m_curl, CURLOPT_HEADERFUNCTION, OnHeader);
+    curl_easy_setopt(m_curl, CURLOPT_HEADERDATA, &m_info);
+    curl_easy_setopt(m_curl, CURLOPT_WRITEFUNCTION, OnWrite);
+    curl_easy_setopt(m_curl, CURLOPT_WRITEDATA, this);
+    curl_easy_setopt(m_curl, CURLOPT_NOPROGRESS, 0L);
+    curl_easy_setopt(m_curl, CURLOPT_XFERINFOFUNCTION, OnProgress);
+    curl_easy_setopt(m_curl, CURLOPT_XFERINFODATA, this);
+    
+    std::weak_ptr<DownloadTask> weak = shared_from_this();
+    m_engine->AddTransfer(m_curl, [weak](CURL*, CURLcode result) {
+        if (auto task = weak.lock()) {
+            task->OnSingleStreamDone(result);
+        }
+    });
+}
+
+// Check the result of a single-connection transfer
+void DownloadTask::OnSingleStreamDone(CURLcode result)
+{
+    long responseCode = 0;
+    curl_easy_getinfo(m_curl, CURLINFO_RESPONSE_CODE, &responseCode);
+    RecordRedirect(m_curl, 0, m_info, responseCode);
+    
+    // The requested offset is the end of the file: nothing was left to fetch
+    if (responseCode == 416 && m_resumeFrom > 0 && m_info.contentLength == m_resumeFrom) {
+        m_pool->Release(m_curl);
+        m_curl = nullptr;
+        
+        m_totalSize = m_resumeFrom;
+        wxLogMessage("Download id %d is already complete on disk", m_id);
+        Finish(true);
+        return;
+    }
+    
+    if (result == CURLE_OK && responseCode != 416) {
+        curl_off_t downloadedSize = 0;
+        curl_easy_getinfo(m_curl, CURLINFO_SIZE_DOWNLOAD_T, &downloadedSize);
+        m_pool->Release(m_curl);
+        m_curl = nullptr;
+        
+        m_downloaded = m_resumeFrom + downloadedSize;
+        m_totalSize = m_downloaded.load();
+        
+        wxLogMessage("Download completed, id: %d", m_id);
+        Finish(true);
+        return;
+    }
+    
+    wxLogError("Transfer failed: %s", curl_easy_strerror(result));
+    if (responseCode > 0) {
+        wxLogError("HTTP response code: %ld", responseCode);
+    }
+    wxLogError("Error details: %s", m_errorBuffer);
+    
+    m_pool->Release(m_curl);
+    m_curl = nullptr;
+    
+    // Keep only the bytes received, or none when the server can't satisfy the range,
+    // once the disk writer has written them
+    curl_off_t kept = responseCode == 416 ? 0 : m_downloaded.load();
+    FlushFile([this, kept](bool flushed) {
+        if (m_phase != Phase::SINGLE) {
+            return;
+        }
+        if (flushed) {
+            TruncateFile(kept);
+        } else {
+            wxLogError("Failed to write file: %s", m_filePath);
+        }
+        m_writer->Close();
+        
+        // Retry after a short pause without blocking the engine thread
+        if (++m_retries < MAX_RETRIES) {
+            std::weak_ptr<DownloadTask> weak = shared_from_this();
+            m_engine->PostDelayed(RETRY_DELAY_MS, [weak]() {
+                auto task = weak.lock();
+                if (task && !task->m_aborted) {
+                    task->StartSingleStream();
+                }
+            });
+            return;
+        }
+        
+        wxLogError("All download attempts failed for URL: %s", m_url);
+        Finish(false);
+    });
+}
+
+// Split the file into ranges and start one connection per range
+bool DownloadTask::StartSegments()
+{
+    curl_off_t totalSize = m_info.contentLength;
+    
+    // Piece hashes only help when they describe the file the server sends
+    if (m_pieceLength > 0 && (totalSize + m_pieceLength - 1) / m_pieceLength != static_cast<curl_off_t>(m_pieceHashes.size())) {
+        wxLogError("Piece hashes of download id %d don't match its size, pieces are not checked", m_id);
+        m_pieceLength = 0;
+    }
+    
+    // Resume at a piece boundary so every piece is checked as a whole
+    if (!m_journal.IsValid()) {
+        m_resumeFrom = AlignToPiece(m_resumeFrom);
+    }
+    bool resume = m_resumeFrom > 0 || m_journal.IsValid();
+    
+    // Open the file once for all segments, keeping resumed bytes, and reserve its full size
+    if (!m_writer->Open(m_filePath, !resume)) {
+        return false;
+    }
+    if (m_resumeFrom > 0 && !m_journal.IsValid()) {
+        m_writer->Truncate(m_resumeFrom);
+    }
+    m_writer->Preallocate(totalSize);
+    
+    // Memory-mapped writes need real blocks behind the whole mapping
+    if (m_writeMode == WriteMode::MAPPED && !m_writer->Map(totalSize)) {
+        wxLogMessage("Can't map %s, using buffered writes", m_filePath);
+    }
+    
+    m_phase = Phase::SEGMENTED;
+    m_totalSize = totalSize;
+    m_mirrors[0].etag = m_info.etag;
+    
+    // Fetch the pieces missing from the journal, or everything after the resume offset
+    std::vector<SegmentProgress> missing;
+    if (m_journal.IsValid()) {
+        missing = m_journal.GetMissingRanges();
+        
+        // Whole pieces are fetched again, since part of a piece can't be checked
+        if (m_pieceLength > 0) {
+            std::vector<SegmentProgress> aligned;
+            for (auto range : missing) {
+                range.start = AlignToPiece(range.start);
+                range.end = std::min<curl_off_t>(AlignToPiece(range.end) + m_pieceLength - 1, totalSize - 1);
+                if (!aligned.empty() && range.start <= aligned.back().end + 1) {
+                    aligned.back().end = std::max(aligned.back().end, range.end);
+                } else {
+                    aligned.push_back(range);
+                }
+            }
+            missing.swap(aligned);
+        }
+    } else {
+        SegmentProgress rest;
+        rest.start = m_resumeFrom;
+        rest.end = totalSize - 1;
+        rest.downloaded = 0;
+        missing.push_back(rest);
+        m_downloaded = m_resumeFrom;
+        
+        // A journal is only useful when the next attempt can tell the file version
+        if (!m_etag.IsEmpty() || !m_lastModified.IsEmpty()) {
+            SegmentProgress prefix;
+            prefix.start = 0;
+            prefix.end = m_resumeFrom - 1;
+            prefix.downloaded = m_resumeFrom;
+            m_journal.Reset(totalSize, m_etag, m_lastModified);
+            m_journal.MarkWritten(std::vector<SegmentProgress>(1, prefix), std::vector<std::pair<long long, long long>>());
+        }
+    }
+    
+    // Split the missing bytes between the connections
+    curl_off_t missingSize = 0;
+    for (const auto& range : missing) {
+        missingSize += range.end - range.start + 1;
+        AddSegment(range.start, range.end);
+    }
+    if (m_journal.IsValid()) {
+        m_downloaded = totalSize - missingSize;
+    }
+    m_rate.Reset(m_downloaded);
+    int count = static_cast<int>(std::min<curl_off_t>(m_controller.GetTarget(), missingSize / MIN_SEGMENT_SIZE));
+    count = std::max(count, 1);
+    
+    while (static_cast<int>(m_segments.size()) < count) {
+        DownloadSegment* largest = nullptr;
+        for (auto& segment : m_segments) {
+            if (!largest || segment->end - segment->start > largest->end - largest->start) {
+                largest = segment.get();
+            }
+        }
+        if (largest->end - largest->start + 1 < MIN_SEGMENT_SIZE * 2) {
+            break;
+        }
+        
+        curl_off_t oldEnd = largest->end;
+        curl_off_t middle = AlignToPiece(largest->start + (oldEnd - largest->start + 1) / 2);
+        if (middle <= largest->start) {
+            break;
+        }
+        largest->end = middle - 1;
+        AddSegment(middle, oldEnd);
+    }
+    
+    wxLogMessage("Downloading id %d in %d segments", m_id, (int)m_segments.size());
+    m_connections = count;
+    
+    // Hash what is already on disk so the first range can be hashed as it arrives
+    CatchUpHash(-1);
+    
+    // Ranges beyond the connection target wait parked until a connection is free
+    ApplyConnectionTarget();
+    if (m_activeSegments == 0) {
+        Finish(false);
+        return true;
+    }
+    
+    ScheduleControl();
+    ScheduleJournal();
+    return true;
+}
+
+// Create a range without starting its connection
+DownloadSegment* DownloadTask::AddSegment(curl_off_t start, curl_off_t end)
+{
+    std::unique_ptr<DownloadSegment> segment(new DownloadSegment());
+    segment->task = this;
+    segment->start = start;
+    segment->end = end;
+    segment->downloaded = 0;
+    segment->retries = 0;
+    segment->verified = false;
+    segment->mirror = 0;
+    segment->changeMirror = false;
+    segment->sampleBytes = 0;
+    segment->pieceFailed = false;
+    segment->flushing = false;
+    segment->pieceFailures = 0;
+    segment->curl = nullptr;
+    memset(segment->errorBuffer, 0, CURL_ERROR_SIZE);
+    
+    std::lock_guard<std::mutex> lock(m_segmentMutex);
+    m_segments.push_back(std::move(segment));
+    return m_segments.back().get();
+}
+
+// Add a range transfer to the engine
+bool DownloadTask::StartSegment(DownloadSegment* segment)
+{
+    segment->curl = CreateHandle(segment->errorBuffer);
+    if (!segment->curl) {
+        return false;
+    }
+    
+    curl_off_t offset = segment->start + segment->downloaded;
+    
+    // Each connection goes to the mirror where it is expected to be fastest
+    segment->mirror = PickMirror(segment->changeMirror ? segment->mirror : m_mirrors.size());
+    segment->changeMirror = false;
+    m_mirrors[segment->mirror].connections++;
+    curl_easy_setopt(segment->curl, CURLOPT_URL, GetRequestUrl(segment->mirror).c_str());
+    
+    // The response headers tell whether the mirror still has the same file
+    segment->info = RemoteFileInfo();
+    curl_easy_setopt(segment->curl, CURLOPT_HEADERFUNCTION, OnHeader);
+    curl_easy_setopt(segment->curl, CURLOPT_HEADERDATA, &segment->info);
+    segment->sampleBytes = segment->downloaded;
+    segment->lastData = std::chrono::steady_clock::now();
+    
+    wxString range = wxString::Format("%lld-%lld", (long long)offset, (long long)segment->end);
+    curl_easy_setopt(segment->curl, CURLOPT_RANGE, range.c_str());
+    curl_easy_setopt(segment->curl, CURLOPT_WRITEFUNCTION, OnSegmentWrite);
+    curl_easy_setopt(segment->curl, CURLOPT_WRITEDATA, segment);
+    segment->verified = false;
+    
+    m_activeSegments++;
+    
+    std::weak_ptr<DownloadTask> weak = shared_from_this();
+    m_engine->AddTransfer(segment->curl, [weak, segment](CURL*, CURLcode result) {
+        if (auto task = weak.lock()) {
+            task->OnSegmentDone(segment, result);
+        }
+    });
+    
+    return true;
+}
+
+// Split the largest unfinished range and start a connection on its second half
+bool DownloadTask::StealWork()
+{
+    DownloadSegment* victim = nullptr;
+    curl_off_t largest = 0;
+    for (auto& segment : m_segments) {
+        if (!segment->curl) {
+            continue;
+        }
+        curl_off_t remaining = segment->end - (segment->start + segment->downloaded) + 1;
+        if (remaining > largest) {
+            largest = remaining;
+            victim = segment.get();
+        }
+    }
+    
+    if (!victim || largest < MIN_PIECE_SIZE * 2) {
+        return false;
+    }
+    
+    // The running connection stops at the new end through the range check in OnSegmentWrite
+    curl_off_t oldEnd = victim->end;
+    curl_off_t middle = AlignToPiece(victim->start + victim->downloaded + largest / 2);
+    if (middle <= victim->start + victim->downloaded) {
+        return false;
+    }
+    victim->end = middle - 1;
+    
+    DownloadSegment* segment = AddSegment(middle, oldEnd);
+    if (!StartSegment(segment)) {
+        victim->end = oldEnd;
+        std::lock_guard<std::mutex> lock(m_segmentMutex);
+        m_segments.pop_back();
+        return false;
+    }
+    
+    wxLogMessage("Split range %lld-%lld of download id %d at byte %lld", (long long)victim->start, (long long)oldEnd, m_id, (long long)middle);
+    return true;
+}
+
+// Release the connection of a segment
+void DownloadTask::StopSegment(DownloadSegment* segment)
+{
+    if (segment->curl) {
+        m_engine->RemoveTransfer(segment->curl);
+        m_pool->Release(segment->curl);
+        segment->curl = nullptr;
+        m_activeSegments--;
+        m_mirrors[segment->mirror].connections--;
+    }
+}
+
+// Mirror for the next connection: every mirror is tried once, then the one whose
+// speed per connection, shared with the connections already on it, is highest
+size_t DownloadTask::PickMirror(size_t avoid) const
+{
+    size_t best = m_mirrors.size();
+    double bestScore = 0;
+    for (size_t i = 0; i < m_mirrors.size(); i++) {
+        const MirrorSource& mirror = m_mirrors[i];
+        if (mirror.dropped || i == avoid) {
+            continue;
+        }
+        
+        double speed = mirror.speed < 0 ? 1e18 : static_cast<double>(mirror.speed);
+        double score = speed / (mirror.connections + 1);
+        if (best == m_mirrors.size() || score > bestScore) {
+            best = i;
+            bestScore = score;
+        }
+    }
+    
+    // Only the avoided mirror is left
+    return best < m_mirrors.size() ? best : avoid;
+}
+
+// Stop sending ranges to a mirror; the last mirror left is never dropped
+bool DownloadTask::DropMirror(size_t index, bool mismatched)
+{
+    MirrorSource& mirror = m_mirrors[index];
+    if (mirror.dropped) {
+        return true;
+    }
+    
+    long left = std::count_if(m_mirrors.begin(), m_mirrors.end(), [](const MirrorSource& source) {
+        return !source.dropped;
+    });
+    if (left <= 1) {
+        return false;
+    }
+    
+    mirror.dropped = true;
+    mirror.mismatched = mismatched;
+    wxLogMessage("Dropping mirror %s of download id %d, %ld left", mirror.url, m_id, left - 1);
+    return true;
+}
+
+// Check that a mirror sends the same file before its first byte is written
+bool DownloadTask::CheckMirror(DownloadSegment* segment)
+{
+    MirrorSource& mirror = m_mirrors[segment->mirror];
+    const RemoteFileInfo& info = segment->info;
+    
+    // Mirrors may use their own ETags, but one mirror must keep the same
+    bool sameSize = info.contentLength < 0 || info.contentLength == m_totalSize;
+    bool sameETag = mirror.etag.IsEmpty() || info.etag.IsEmpty() || info.etag == mirror.etag;
+    if (sameSize && sameETag) {
+        if (mirror.etag.IsEmpty()) {
+            mirror.etag = info.etag;
+        }
+        return true;
+    }
+    
+    wxLogError("Mirror %s of download id %d sent another file (size: %lld, ETag: %s)", mirror.url, m_id, (long long)info.contentLength, info.etag);
+    DropMirror(segment->mirror, true);
+    return false;
+}
+
+// Measure the speed of each mirror and stop the connections that stalled or use a dropped mirror
+void DownloadTask::SampleMirrors(long long elapsed)
+{
+    auto now = std::chrono::steady_clock::now();
+    std::vector<curl_off_t> received(m_mirrors.size(), 0);
+    std::vector<DownloadSegment*> stalled;
+    
+    for (auto& segment : m_segments) {
+        if (!segment->curl) {
+            continue;
+        }
+        received[segment->mirror] += std::max<curl_off_t>(segment->downloaded - segment->sampleBytes, 0);
+        segment->sampleBytes = segment->downloaded;
+        
+        // A connection held back by the speed limit or the disk writer gets no data through no fault of its server
+        if (m_engine->IsPaused(segment->curl)) {
+            segment->lastData = now;
+            continue;
+        }
+        
+        long long idle = std::chrono::duration_cast<std::chrono::milliseconds>(now - segment->lastData).count();
+        if (idle >= STALL_TIMEOUT_MS) {
+            wxLogError("Connection to %s for download id %d stalled", m_mirrors[segment->mirror].url, m_id);
+            DropMirror(segment->mirror, false);
+            stalled.push_back(segment.get());
+        }
+    }
+    
+    // Smoothed, so one slow interval doesn't move every new connection away
+    for (size_t i = 0; i < m_mirrors.size(); i++) {
+        MirrorSource& mirror = m_mirrors[i];
+        if (mirror.connections == 0 || elapsed <= 0) {
+            continue;
+        }
+        long long speed = received[i] * 1000 / elapsed / mirror.connections;
+        mirror.speed = mirror.speed < 0 ? speed : (mirror.speed * 3 + speed) / 4;
+    }
+    
+    // The ranges are parked and resumed on the other mirrors; a stalled last mirror is reconnected
+    for (auto& segment : m_segments) {
+        bool isStalled = std::find(stalled.begin(), stalled.end(), segment.get()) != stalled.end();
+        if (segment->curl && (isStalled || m_mirrors[segment->mirror].dropped)) {
+            StopSegment(segment.get());
+            segment->changeMirror = true;
+        }
+    }
+}
+
+// Check the result of a range transfer
+void DownloadTask::OnSegmentDone(DownloadSegment* segment, CURLcode result)
+{
+    long responseCode = 0;
+    curl_easy_getinfo(segment->curl, CURLINFO_RESPONSE_CODE, &responseCode);
+    RecordRedirect(segment->curl, segment->mirror, segment->info, responseCode);
+    StopSegment(segment);
+    
+    if (m_phase == Phase::FINISHED) {
+        return;
+    }
+    
+    // A piece that failed its hash is fetched again right away from another mirror
+    if (segment->pieceFailed) {
+        segment->pieceFailed = false;
+        if (++segment->pieceFailures > MAX_RETRIES * static_cast<int>(m_mirrors.size())) {
+            wxLogError("Pieces of download id %d keep failing their checksum on every mirror", m_id);
+            Finish(false);
+            return;
+        }
+        
+        // The bad bytes must reach the disk before the new ones, or they could overwrite them;
+        // the range stays parked until the disk writer has written them
+        segment->changeMirror = true;
+        segment->flushing = true;
+        FlushFile([this, segment](bool flushed) {
+            segment->flushing = false;
+            if (m_phase != Phase::SEGMENTED) {
+                return;
+            }
+            if (!flushed || !StartSegment(segment)) {
+                Finish(false);
+            }
+        });
+        return;
+    }
+    
+    // A mirror that sent another file is not an error of the range; it continues elsewhere
+    bool complete = segment->start + segment->downloaded > segment->end;
+    if (!complete && m_mirrors[segment->mirror].dropped) {
+        segment->changeMirror = true;
+    } else if (!complete) {
+        wxLogError("Segment %lld-%lld failed: %s (%s)", (long long)segment->start, (long long)segment->end,
+                   curl_easy_strerror(result), segment->errorBuffer);
+        
+        // Fewer connections after errors, and no more than now when the server asks to slow down
+        bool throttled = (responseCode == 429 || responseCode == 503);
+        m_controller.OnError(throttled);
+        
+        if (++segment->retries >= MAX_RETRIES) {
+            wxLogError("All download attempts failed for URL: %s", m_url);
+            Finish(false);
+            return;
+        }
+        
+        // The next attempt goes to another mirror
+        segment->changeMirror = true;
+        
+        // The rest of the range stays parked until a connection is free for it
+        if (throttled && m_activeSegments == 0) {
+            wxLogMessage("Server throttled download id %d (HTTP %ld), waiting before reconnecting", m_id, responseCode);
+            std::weak_ptr<DownloadTask> weak = shared_from_this();
+            m_engine->PostDelayed(RETRY_DELAY_MS, [weak]() {
+                auto task = weak.lock();
+                if (task && task->m_phase == Phase::SEGMENTED) {
+                    task->ApplyConnectionTarget();
+                    if (task->m_activeSegments == 0 && !task->HasFlushingSegments()) {
+                        task->Finish(false);
+                    }
+                }
+            });
+            return;
+        }
+    }
+    
+    // Let the kernel write back a finished range of a mapped file
+    if (complete) {
+        m_writer->ReleaseRange(segment->start, segment->end - segment->start + 1);
+    }
+    
+    // Put the free connection to work on a parked range or the largest range still running
+    ApplyConnectionTarget();
+    
+    if (m_activeSegments == 0 && !HasFlushingSegments()) {
+        if (m_downloaded == m_totalSize) {
+            wxLogMessage("Segmented download completed, id: %d", m_id);
+        }
+        Finish(m_downloaded == m_totalSize);
+    }
+}
+
+// Feed a written block to the piece hash of its range; false and the bad piece dropped on a mismatch
+bool DownloadTask::CheckPieces(DownloadSegment* segment, curl_off_t offset, const void* data, size_t length)
+{
+    if (m_pieceLength <= 0) {
+        return true;
+    }
+    
+    // Ranges start on piece boundaries, so the hash always begins with a whole piece
+    const char* bytes = static_cast<const char*>(data);
+    while (length > 0) {
+        curl_off_t piece = offset / m_pieceLength;
+        curl_off_t pieceStart = piece * m_pieceLength;
+        curl_off_t pieceEnd = std::min<curl_off_t>(pieceStart + m_pieceLength, m_totalSize);
+        size_t part = static_cast<size_t>(std::min<curl_off_t>(length, pieceEnd - offset));
+        
+        segment->pieceHasher.Update(bytes, part);
+        bytes += part;
+        offset += part;
+        length -= part;
+        if (offset < pieceEnd) {
+            break;
+        }
+        
+        segment->pieceHasher.Finish();
+        bool match = segment->pieceHasher.GetDigest(ChecksumType::SHA256) == m_pieceHashes[piece];
+        segment->pieceHasher.Reset();
+        if (match) {
+            continue;
+        }
+        
+        wxLogError("Piece %lld of download id %d from %s failed its checksum", (long long)piece, m_id, m_mirrors[segment->mirror].url);
+        
+        // Forget everything from the start of the bad piece; the range continues there
+        curl_off_t dropped = segment->start + segment->downloaded - pieceStart;
+        segment->downloaded -= dropped;
+        m_downloaded -= dropped;
+        DropHash(pieceStart);
+        segment->pieceFailed = true;
+        return false;
+    }
+    
+    return true;
+}
+
+// Round an offset down to the start of its piece
+curl_off_t DownloadTask::AlignToPiece(curl_off_t offset) const
+{
+    return m_pieceLength > 0 ? offset / m_pieceLength * m_pieceLength : offset;
+}
+
+// Hash a received block when it continues the hashed part of the file
+void DownloadTask::HashBlock(curl_off_t offset, const void* data, size_t length)
+{
+    // A read-back on the worker owns the hash position until it reports back
+    curl_off_t position = m_hasher.GetLength();
+    if (m_hashCancel || offset > position || offset + static_cast<curl_off_t>(length) <= position) {
+        return;
+    }
+    
+    size_t skip = static_cast<size_t>(position - offset);
+    m_hasher.Update(static_cast<const char*>(data) + skip, length - skip);
+}
+
+// Read back and hash the file from the hash position on the hash worker, up to budget bytes
+// or all of it when negative. A read-back already running continues with the rest when it is done.
+void DownloadTask::CatchUpHash(curl_off_t budget)
+{
+    if (m_hashCancel) {
+        return;
+    }
+    
+    curl_off_t position = m_hasher.GetLength();
+    curl_off_t limit = GetHashLimit();
+    if (budget >= 0) {
+        limit = std::min(limit, position + budget);
+    }
+    if (limit <= position || !m_hashWorker) {
+        if (m_hashDone) {
+            std::function<void()> done = m_hashDone;
+            m_hashDone = nullptr;
+            done();
+        }
+        return;
+    }
+    
+    // The worker hashes a copy and the engine thread adopts it, unless the bytes were dropped meanwhile
+    std::shared_ptr<std::atomic<bool>> cancel = std::make_shared<std::atomic<bool>>(false);
+    m_hashCancel = cancel;
+    m_hashTarget = limit;
+    
+    std::weak_ptr<DownloadTask> weak = shared_from_this();
+    TransferEngine* engine = m_engine;
+    wxString filePath = m_filePath;
+    StreamHasher hasher = m_hasher;
+    m_hashWorker->Post([weak, engine, filePath, hasher, limit, cancel]() mutable {
+        bool success = ReadBackHash(filePath, hasher, limit, *cancel);
+        engine->Post([weak, hasher, cancel, success]() {
+            auto task = weak.lock();
+            if (task) {
+                task->OnHashCaughtUp(hasher, cancel, success);
+            }
+        });
+    });
+}
+
+// Take the hash read back on the worker and continue with what was written meanwhile
+void DownloadTask::OnHashCaughtUp(const StreamHasher& hasher, const std::shared_ptr<std::atomic<bool>>& cancel, bool success)
+{
+    if (*cancel) {
+        return;
+    }
+    m_hashCancel.reset();
+    
+    if (!success) {
+        wxLogError("Failed to read back %s for its checksums", m_filePath);
+    } else if (hasher.GetLength() > m_hasher.GetLength()) {
+        m_hasher = hasher;
+    }
+    
+    // Finish waits for the whole file, or gives up with a hash that doesn't cover it
+    if (m_hashDone) {
+        if (success) {
+            CatchUpHash(-1);
+        } else {
+            std::function<void()> done = m_hashDone;
+            m_hashDone = nullptr;
+            done();
+        }
+        return;
+    }
+    
+    if (success && (m_phase == Phase::SINGLE || m_phase == Phase::SEGMENTED)) {
+        CatchUpHash(HASH_CATCH_UP_BYTES);
+    }
+}
+
+// Forget the hash of the bytes from offset on, and the read-back that would hash them
+void DownloadTask::DropHash(curl_off_t offset)
+{
+    if (m_hasher.GetLength() > offset) {
+        m_hasher.Reset();
+    }
+    if (m_hashCancel && m_hashTarget > offset) {
+        *m_hashCancel = true;
+        m_hashCancel.reset();
+    }
+}
+
+// Worker thread: hash the file from the hasher position up to limit through a descriptor of its own
+bool DownloadTask::ReadBackHash(const wxString& filePath, StreamHasher& hasher, curl_off_t limit, const std::atomic<bool>& cancel)
+{
+    FileWriter file;
+    if (!wxFileName::FileExists(filePath) || !file.Open(filePath, false)) {
+        return false;
+    }
+    
+    std::vector<char> buffer(HASH_READ_SIZE);
+    curl_off_t position = hasher.GetLength();
+    while (position < limit && !cancel) {
+        size_t length = static_cast<size_t>(std::min<curl_off_t>(HASH_READ_SIZE, limit - position));
+        if (!file.Read(position, buffer.data(), length)) {
+            return false;
+        }
+        hasher.Update(buffer.data(), length);
+        position += length;
+    }
+    return true;
+}
+
+// End of the data in the file that directly follows the hash position
+curl_off_t DownloadTask::GetHashLimit() const
+{
+    curl_off_t position = m_hasher.GetLength();
+    curl_off_t limit = m_downloaded;
+    
+    // Bytes outside the ranges were on disk before the segments started
+    if (!m_segments.empty()) {
+        std::vector<SegmentProgress> ranges = GetSegmentProgress();
+        std::sort(ranges.begin(), ranges.end(), [](const SegmentProgress& a, const SegmentProgress& b) {
+            return a.start < b.start;
+        });
+        
+        limit = m_totalSize;
+        curl_off_t reached = position;
+        for (const auto& range : ranges) {
+            if (range.end < reached) {
+                continue;
+            }
+            reached = std::max<curl_off_t>(reached, range.start);
+            if (range.start + range.downloaded <= range.end) {
+                limit = std::max<curl_off_t>(reached, range.start + range.downloaded);
+                break;
+            }
+            reached = range.end + 1;
+        }
+    }
+    
+    // Blocks still in the disk writer's buffers are not in the file yet
+    for (const auto& pending : m_diskWriter->GetPendingRanges(m_writer)) {
+        if (pending.first + pending.second > position) {
+            limit = std::min<curl_off_t>(limit, std::max<curl_off_t>(pending.first, position));
+        }
+    }
+    
+    return limit;
+}
+
+// Save the journal again after the flush interval
+void DownloadTask::ScheduleJournal()
+{
+    if (m_journalScheduled) {
+        return;
+    }
+    m_journalScheduled = true;
+    
+    std::weak_ptr<DownloadTask> weak = shared_from_this();
+    m_engine->PostDelayed(JOURNAL_SAVE_MS, [weak]() {
+        auto task = weak.lock();
+        if (!task) {
+            return;
+        }
+        task->m_journalScheduled = false;
+        if (task->m_phase == Phase::SINGLE || task->m_phase == Phase::SEGMENTED) {
+            task->SaveJournal();
+            task->ScheduleJournal();
+        }
+    });
+}
+
+// Record the pieces that reached the file
+void DownloadTask::SaveJournal()
+{
+    if (!m_journal.IsValid()) {
+        return;
+    }
+    
+    // A single stream fills the file from the start
+    std::vector<SegmentProgress> written;
+    if (m_segments.empty()) {
+        SegmentProgress range;
+        range.start = 0;
+        range.end = m_totalSize - 1;
+        range.downloaded = m_downloaded;
+        written.push_back(range);
+    } else {
+        written = GetSegmentProgress();
+    }
+    
+    // Bytes of a piece count only once the piece matched its hash
+    if (m_pieceLength > 0) {
+        for (auto& range : written) {
+            if (range.start + range.downloaded <= range.end) {
+                range.downloaded = AlignToPiece(range.start + range.downloaded) - range.start;
+            }
+        }
+    }
+    
+    // Progress is taken first, so anything not in the pending list is already in the file
+    m_journal.MarkWritten(written, m_diskWriter->GetPendingRanges(m_writer));
+    m_journal.Save(m_filePath);
+}
+
+// Sample the throughput again after the control interval
+void DownloadTask::ScheduleControl()
+{
+    m_controlTime = std::chrono::steady_clock::now();
+    m_controlBytes = m_downloaded;
+    
+    std::weak_ptr<DownloadTask> weak = shared_from_this();
+    m_engine->PostDelayed(CONTROL_INTERVAL_MS, [weak]() {
+        auto task = weak.lock();
+        if (task && task->m_phase == Phase::SEGMENTED) {
+            task->OnControlTimer();
+        }
+    });
+}
+
+// Feed the throughput to the controller and follow its connection count
+void DownloadTask::OnControlTimer()
+{
+    auto now = std::chrono::steady_clock::now();
+    long long elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(now - m_controlTime).count();
+    long long rate = elapsed > 0 ? (m_downloaded - m_controlBytes) * 1000 / elapsed : 0;
+    
+    UpdateRate();
+    PublishProgress();
+    
+    int previous = m_controller.GetTarget();
+    m_controller.OnSample(rate, m_activeSegments);
+    if (m_controller.GetTarget() != previous) {
+        wxLogMessage("Download id %d: %lld B/s with %d connections, target now %d", m_id, rate, (int)m_activeSegments, m_controller.GetTarget());
+    }
+    
+    // Measure the mirrors and move stalled ranges elsewhere before opening connections
+    SampleMirrors(elapsed);
+    ApplyConnectionTarget();
+    
+    // Hash ranges that other connections finished while the hash position was behind them
+    CatchUpHash(HASH_CATCH_UP_BYTES);
+    ScheduleControl();
+}
+
+// Open or close connections until the count matches the controller target
+void DownloadTask::ApplyConnectionTarget()
+{
+    int target = m_controller.GetTarget();
+    
+    while (m_activeSegments < target) {
+        if (!ResumeParkedSegment() && !StealWork()) {
+            break;
+        }
+    }
+    while (m_activeSegments > target) {
+        ParkSegment();
+    }
+}
+
+// Restart the first unfinished range that has no connection
+bool DownloadTask::ResumeParkedSegment()
+{
+    DownloadSegment* parked = nullptr;
+    for (auto& segment : m_segments) {
+        bool complete = segment->start + segment->downloaded > segment->end;
+        if (!segment->curl && !complete && !segment->flushing && (!parked || segment->start < parked->start)) {
+            parked = segment.get();
+        }
+    }
+    
+    if (!parked || !StartSegment(parked)) {
+        return false;
+    }
+    
+    wxLogMessage("Resuming segment of download id %d from byte %lld", m_id, (long long)(parked->start + parked->downloaded));
+    return true;
+}
+
+// Close the connection with the least data left; its range is resumed later
+void DownloadTask::ParkSegment()
+{
+    DownloadSegment* victim = nullptr;
+    curl_off_t smallest = 0;
+    for (auto& segment : m_segments) {
+        if (!segment->curl) {
+            continue;
+        }
+        curl_off_t remaining = segment->end - (segment->start + segment->downloaded) + 1;
+        if (!victim || remaining < smallest) {
+            smallest = remaining;
+            victim = segment.get();
+        }
+    }
+    
+    if (victim) {
+        StopSegment(victim);
+    }
+}
+
+// Bytes on disk that can be kept, or zero when the server copy can't be validated
+curl_off_t DownloadTask::GetResumeOffset() const
+{
+    if (GetIfRangeValidator().IsEmpty() || !wxFileName::FileExists(m_filePath)) {
+        return 0;
+    }
+    
+    wxULongLong size = wxFileName::GetSize(m_filePath);
+    if (size == wxInvalidSize) {
+        return 0;
+    }
+    
+    // Preallocated files are longer than the data in them
+    return std::min(static_cast<curl_off_t>(size.GetValue()), m_keptBytes);
+}
+
+// The file on disk has the size recorded when the download last completed
+bool DownloadTask::IsCompleteOnDisk() const
+{
+    if ((m_etag.IsEmpty() && m_lastModified.IsEmpty()) || m_knownSize <= 0 || m_keptBytes < m_knownSize || !wxFileName::FileExists(m_filePath)) {
+        return false;
+    }
+    
+    wxULongLong size = wxFileName::GetSize(m_filePath);
+    if (size == wxInvalidSize) {
+        return false;
+    }
+    
+    return static_cast<curl_off_t>(size.GetValue()) == m_knownSize;
+}
+
+// Validator for If-Range: a strong ETag, or Last-Modified
+wxString DownloadTask::GetIfRangeValidator() const
+{
+    // Weak ETags are not allowed in If-Range
+    if (!m_etag.IsEmpty() && !m_etag.StartsWith("W/")) {
+        return m_etag;
+    }
+    
+    return m_lastModified;
+}
+
+// Check that a response describes the same file version as the partial download
+bool DownloadTask::ValidatorsMatch(const RemoteFileInfo& info) const
+{
+    if (!m_etag.IsEmpty() && !info.etag.IsEmpty()) {
+        return m_etag == info.etag;
+    }
+    if (!m_lastModified.IsEmpty() && !info.lastModified.IsEmpty()) {
+        return m_lastModified == info.lastModified;
+    }
+    
+    // Nothing to compare against
+    return false;
+}
+
+// Remember the validators sent with a full or ranged response
+void DownloadTask::AdoptValidators(const RemoteFileInfo& info)
+{
+    if (info.etag.IsEmpty() && info.lastModified.IsEmpty()) {
+        return;
+    }
+    
+    m_etag = info.etag;
+    m_lastModified = info.lastModified;
+}
+
+// Bytes written without gaps from the start of the file in segmented mode
+curl_off_t DownloadTask::GetContiguousBytes() const
+{
+    // Split ranges are appended out of order
+    std::vector<SegmentProgress> ranges = GetSegmentProgress();
+    std::sort(ranges.begin(), ranges.end(), [](const SegmentProgress& a, const SegmentProgress& b) {
+        return a.start < b.start;
+    });
+    
+    curl_off_t contiguous = m_resumeFrom;
+    for (const auto& range : ranges) {
+        if (range.start != contiguous) {
+            break;
+        }
+        contiguous = range.start + range.downloaded;
+        if (contiguous <= range.end) {
+            break;
+        }
+    }
+    
+    return contiguous;
+}
+
+// Mirrors besides the main URL that didn't send another file
+std::vector<wxString> DownloadTask::GetMirrors() const
+{
+    std::vector<wxString> urls;
+    for (size_t i = 1; i < m_mirrors.size(); i++) {
+        if (!m_mirrors[i].mismatched) {
+            urls.push_back(m_mirrors[i].url);
+        }
+    }
+    return urls;
+}
+
+// Snapshot of the ranges, safe to call from any thread
+std::vector<SegmentProgress> DownloadTask::GetSegmentProgress() const
+{
+    std::lock_guard<std::mutex> lock(m_segmentMutex);
+    
+    std::vector<SegmentProgress> ranges;
+    ranges.reserve(m_segments.size());
+    for (const auto& segment : m_segments) {
+        SegmentProgress range;
+        range.start = segment->start;
+        range.end = segment->end;
+        range.downloaded = segment->downloaded;
+        ranges.push_back(range);
+    }
+    
+    return ranges;
+}
+
+// Cut the target file to the given length; an open file must have nothing left in the disk writer
+bool DownloadTask::TruncateFile(curl_off_t length)
+{
+    if (m_writer->IsOpen()) {
+        if (!m_writer->Truncate(length)) {
+            wxLogError("Failed to truncate file: %s", m_filePath);
+            return false;
+        }
+        m_keptBytes = length;
+        DropHash(length);
+        return true;
+    }
+    
+#ifdef _WIN32
+    int fd = _open(m_filePath.c_str(), _O_RDWR | _O_BINARY);
+    bool ok = fd >= 0 && _chsize_s(fd, length) == 0;
+    if (fd >= 0) {
+        _close(fd);
+    }
+#else
+    bool ok = truncate(m_filePath.c_str(), length) == 0;
+#endif
+    
+    if (!ok) {
+        wxLogError("Failed to truncate file: %s", m_filePath);
+        return false;
+    }
+    
+    m_keptBytes = length;
+    return true;
+}
+
+// Continue on the engine thread once the data handed to the disk writer is in the file
+void DownloadTask::FlushFile(std::function<void(bool)> then)
+{
+    std::weak_ptr<DownloadTask> weak = shared_from_this();
+    TransferEngine* engine = m_engine;
+    m_diskWriter->FlushAsync(m_writer, [weak, engine, then](bool flushed) {
+        engine->Post([weak, then, flushed]() {
+            if (auto task = weak.lock()) {
+                then(flushed);
+            }
+        });
+    });
+}
+
+// A range waits for the disk writer before it is fetched again
+bool DownloadTask::HasFlushingSegments() const
+{
+    return std::any_of(m_segments.begin(), m_segments.end(), [](const std::unique_ptr<DownloadSegment>& segment) {
+        return segment->flushing;
+    });
+}
+
+// Stop all remaining work and report the result once the file is written
+void DownloadTask::Finish(bool success)
+{
+    if (m_phase == Phase::FINISHED) {
+        return;
+    }
+    m_phase = Phase::FINISHED;
+    
+    // A failed download has no use for its checksums
+    if (!success) {
+        DropHash(0);
+    }
+    
+    // Stop segments still running after a failure
+    for (auto& segment : m_segments) {
+        StopSegment(segment.get());
+    }
+    if (m_curl) {
+        m_engine->RemoveTransfer(m_curl);
+        m_pool->Release(m_curl);
+        m_curl = nullptr;
+    }
+    
+    // Wait for the mapping and the disk writer without blocking the engine thread;
+    // data that never reached the disk fails the download
+    if (m_writer->IsOpen()) {
+        m_writer->Unmap();
+        FlushFile([this, success](bool flushed) {
+            OnFinishFlushed(success && flushed);
+        });
+        return;
+    }
+    
+    OnFinishFlushed(success);
+}
+
+// Trim the file after the last write and complete the checksums
+void DownloadTask::OnFinishFlushed(bool success)
+{
+    // Drop space a single stream reserved for a size the server announced but didn't send
+    if (success && m_segments.empty() && m_writer->IsOpen()) {
+        TruncateFile(m_downloaded);
+    }
+    
+    // Hash the bytes that arrived out of order by reading them back in file order on the hash worker
+    if (success && !m_notModified) {
+        m_hashDone = [this]() {
+            if (m_hasher.GetLength() == m_downloaded) {
+                m_hasher.Finish();
+            } else {
+                wxLogError("Failed to compute the checksums of %s", m_filePath);
+            }
+            OnFinishHashed(true);
+        };
+        CatchUpHash(-1);
+        return;
+    }
+    
+    OnFinishHashed(success);
+}
+
+// Settle the journal and the file once the checksums are complete and report the result
+void DownloadTask::OnFinishHashed(bool success)
+{
+    // The journal of a stopped download records every piece on disk; after a failed write it can't be trusted
+    if (success || m_writer->HasFailed() || m_discard) {
+        m_journal.Discard(m_filePath);
+    } else if (m_journal.IsValid()) {
+        SaveJournal();
+        m_downloaded = m_journal.GetCompletedBytes();
+    }
+    
+    // Without a journal keep only the gap-free start of the file so the next attempt can append to it;
+    // the space reserved after it would otherwise look like downloaded data
+    if (m_discard) {
+        // A canceled download starts over, so none of its data may look like a resumable start
+        if (wxFileName::FileExists(m_filePath) && TruncateFile(0)) {
+            m_downloaded = 0;
+        }
+    } else if (!success && m_writer->IsOpen() && !m_journal.IsValid()) {
+        curl_off_t kept = m_segments.empty() ? m_downloaded.load() : GetContiguousBytes();
+        if (m_writer->HasFailed()) {
+            kept = m_resumeFrom;
+        }
+        if (TruncateFile(kept)) {
+            m_downloaded = kept;
+        }
+    }
+    m_writer->Close();
+    
+    m_succeeded = success;
+    m_speed = 0;
+    m_eta = -1;
+    PublishProgress();
+    
+    if (m_onFinished) {
+        m_onFinished(this);
+    }
+}
+
+// Count received bytes and update the speed and time left
+void DownloadTask::AddDownloaded(curl_off_t bytes)
+{
+    m_downloaded += bytes;
+    UpdateRate();
+    PublishProgress();
+}
+
+// Feed the byte count to the estimator of this download
+void DownloadTask::UpdateRate()
+{
+    curl_off_t done = m_downloaded;
+    m_rate.AddSample(done);
+    m_speed = m_rate.GetRate();
+    m_eta = m_totalSize > 0 ? m_rate.GetEta(m_totalSize - done) : -1;
+}
+
+// Hand the current progress to the UI without waiting for it
+void DownloadTask::PublishProgress()
+{
+    if (!m_progressSlot) {
+        return;
+    }
+    
+    ProgressSnapshot snapshot;
+    snapshot.downloaded = m_downloaded;
+    snapshot.totalSize = m_totalSize;
+    snapshot.speed = m_speed;
+    snapshot.eta = m_eta;
+    snapshot.connections = GetConnectionCount();
+    m_progressSlot->Publish(snapshot);
+}
+
+// Create an easy handle with the options shared by every request of the task
+CURL* DownloadTask::CreateHandle(char* errorBuffer)
+{
+    CURL* curl = m_pool->Acquire();
+    if (!curl) {
+        return nullptr;
+    }
+    
+    curl_easy_setopt(curl, CURLOPT_URL, GetRequestUrl(0).c_str());
+    curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
+    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, m_headers);
+    curl_easy_setopt(curl, CURLOPT_COOKIEFILE, ""); // Enable cookies, shared through the pool
+    curl_easy_setopt(curl, CURLOPT_VERBOSE, 1L); // Enable verbose output for debugging
+    curl_easy_setopt(curl, CURLOPT_ERRORBUFFER, errorBuffer); // Set error buffer
+    curl_easy_setopt(curl, CURLOPT_TIMEOUT, 300L); // 5 minute timeout
+    curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT, 30L); // 30 second connect timeout
+    curl_easy_setopt(curl, CURLOPT_SSL_VERIFYPEER, 0L); // Don't verify SSL certificates
+    curl_easy_setopt(curl, CURLOPT_SSL_VERIFYHOST, 0L); // Don't verify host
+    
+    return curl;
+}
+
+// URL a request to a mirror is sent to, skipping the redirects seen before
+wxString DownloadTask::GetRequestUrl(size_t mirror) const
+{
+    const wxString& url = m_mirrors[mirror].requestUrl;
+    return m_redirects ? m_redirects->Resolve(url) : url;
+}
+
+// Remember where a request ended; an endpoint that can't be reached or answers with an error is forgotten
+void DownloadTask::RecordRedirect(CURL* curl, size_t mirror, const RemoteFileInfo& info, long responseCode)
+{
+    if (!m_redirects) {
+        return;
+    }
+    
+    const wxString& url = m_mirrors[mirror].requestUrl;
+    if (responseCode == 0 || responseCode >= 400) {
+        m_redirects->Invalidate(url);
+        return;
+    }
+    
+    char* effectiveUrl = nullptr;
+    curl_easy_getinfo(curl, CURLINFO_EFFECTIVE_URL, &effectiveUrl);
+    if (effectiveUrl) {
+        m_redirects->Store(url, wxString::FromUTF8(effectiveUrl), info.redirects);
+    }
+}
+
+// Set up headers to mimic a browser
+struct curl_slist* DownloadTask::BuildRequestHeaders(const wxString& originalUrl, const wxString& processedUrl)
+{
+    struct curl_slist *headers = NULL;
+    headers = curl_slist_append(headers, "User-Agent: Mozilla/5.0 (Windows NT 10.0; Win64; x64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/120.0.0.0 Safari/537.36");
+    headers = curl_slist_append(headers, "Accept: */*");
+    headers = curl_slist_append(headers, "Accept-Language: en-US,en;q=0.9,ar;q=0.8");
+    headers = curl_slist_append(headers, "Connection: keep-alive");
+    
+    // Extract the domain from the URL to use as the Referer
+    wxString domain;
+    if (processedUrl.StartsWith("http://")) {
+        domain = processedUrl.Mid(7).BeforeFirst('/');
+    } else if (processedUrl.StartsWith("https://")) {
+        domain = processedUrl.Mid(8).BeforeFirst('/');
+    }
+
+    if (!domain.IsEmpty()) {
+        wxString referer = "Referer: http://" + domain + "/";
+        headers = curl_slist_append(headers, referer.c_str());
+
+        wxString origin = "Origin: http://" + domain;
+        headers = curl_slist_append(headers, origin.c_str());
+    }
+
+    // Special handling for mp3quran.net
+    if (originalUrl.Contains("mp3quran.net")) {
+        wxLogMessage("Adding special headers for mp3quran.net");
+        headers = curl_slist_append(headers, "Referer: https://mp3quran.net/");
+        headers = curl_slist_append(headers, "Origin: https://mp3quran.net");
+        headers = curl_slist_append(headers, "Accept: audio/webm,audio/ogg,audio/mp3,audio/*;q=0.9");
+    }
+
+    return headers;
+}
+
+// Process URL - encode spaces and special characters
+wxString DownloadTask::PrepareUrl(const wxString& url)
+{
+    wxString processedUrl = url;
+
+    // Check for spaces or special characters and encode them properly
+    if (processedUrl.Contains(" ") || processedUrl.Contains("\"") || processedUrl.Contains("'") ||
+        processedUrl.Contains("<") || processedUrl.Contains(">") || processedUrl.Contains("[") ||
+        processedUrl.Contains("]")) {
+        wxLogMessage("URL contains spaces or special characters, encoding it");
+
+        // Use curl's URL encoding function
+        CURL* curl = curl_easy_init();
+        char* output = curl ? curl_easy_escape(curl, processedUrl.c_str(), processedUrl.length()) : nullptr;
+        if (output) {
+            // We need to preserve the http:// or https:// part
+            wxString protocol;
+            if (processedUrl.StartsWith("http://")) {
+                protocol = "http://";
+            } else if (processedUrl.StartsWith("https://")) {
+                protocol = "https://";
+            }
+
+            // Combine protocol with encoded URL, but be careful not to double-encode
+            if (!protocol.IsEmpty()) {
+                wxString encodedPart = wxString(output);
+                // Remove the protocol part from the encoded string if it's there
+                if (encodedPart.StartsWith("http%3A%2F%2F")) {
+                    encodedPart = encodedPart.Mid(13);
+                    processedUrl = protocol + encodedPart;
+                } else if (encodedPart.StartsWith("https%3A%2F%2F")) {
+                    encodedPart = encodedPart.Mid(14);
+                    processedUrl = protocol + encodedPart;
+                } else {
+                    // If the protocol wasn't encoded, just use the encoded string
+                    processedUrl = encodedPart;
+                }
+            } else {
+                processedUrl = wxString(output);
+            }
+
+            curl_free(output);
+        } else {
+            // Manual encoding for basic cases
+            processedUrl.Replace(" ", "%20");
+            processedUrl.Replace("\"", "%22");
+            processedUrl.Replace("'", "%27");
+            processedUrl.Replace("<", "%3C");
+            processedUrl.Replace(">", "%3E");
+            processedUrl.Replace("[", "%5B");
+            processedUrl.Replace("]", "%5D");
+        }
+
+        if (curl) {
+            curl_easy_cleanup(curl);
+        }
+
+        wxLogMessage("Encoded URL: %s", processedUrl);
+    }
+
+    return processedUrl;
+}
+
+// Write callback for the single-connection transfer
+size_t DownloadTask::OnWrite(void* contents, size_t size, size_t nmemb, void* userp)
+{
+    DownloadTask* task = static_cast<DownloadTask*>(userp);
+    
+    // Wait for the shared speed limit; libcurl delivers the same data again after the pause
+    if (!task->m_engine->AcquireBandwidth(task->m_curl, task->m_bandwidthClass, size * nmemb)) {
+        return CURL_WRITEFUNC_PAUSE;
+    }
+    
+    // Look at the status once the headers are complete
+    if (!task->m_rangeChecked) {
+        long responseCode = 0;
+        curl_easy_getinfo(task->m_curl, CURLINFO_RESPONSE_CODE, &responseCode);
+        
+        if (task->m_resumeFrom > 0 && responseCode == 200) {
+            // The file changed or ranges are not supported: start over from byte zero
+            // Nothing of this response was handed to the disk writer yet, so the file can be cut right away
+            wxLogMessage("Server sent the whole file, restarting download id %d from zero", task->m_id);
+            task->m_journal.Discard(task->m_filePath);
+            if (!task->TruncateFile(0)) {
+                return 0;
+            }
+            task->m_resumeFrom = 0;
+            task->m_downloaded = 0;
+            task->m_rate.Reset(0);
+        } else if (task->m_resumeFrom > 0 && responseCode != 206) {
+            // Keep the partial file for the next attempt
+            return 0;
+        }
+        
+        task->AdoptValidators(task->m_info);
+        task->m_rangeChecked = true;
+        
+        // Reserve the rest of the file once its length is known
+        curl_off_t contentLength = -1;
+        curl_easy_getinfo(task->m_curl, CURLINFO_CONTENT_LENGTH_DOWNLOAD_T, &contentLength);
+        if (contentLength > 0) {
+            curl_off_t totalSize = task->m_resumeFrom + contentLength;
+            task->m_writer->Preallocate(totalSize);
+            
+            // Journal the stream, since the reserved space hides how much was written
+            bool hasValidator = !task->m_etag.IsEmpty() || !task->m_lastModified.IsEmpty();
+            if (hasValidator && task->m_journal.GetTotalSize() != totalSize) {
+                task->m_journal.Reset(totalSize, task->m_etag, task->m_lastModified);
+            }
+            if (task->m_journal.IsValid()) {
+                task->ScheduleJournal();
+            }
+        }
+    }
+    
+    // Hand the data to the disk writer, or wait while its buffers are full
+    size_t length = size * nmemb;
+    if (task->m_writer->HasFailed()) {
+        return 0;
+    }
+    if (!task->m_diskWriter->Submit(task->m_writer, task->m_downloaded, contents, length)) {
+        task->m_engine->ReturnBandwidth(task->m_bandwidthClass, length);
+        task->m_engine->WaitForBuffers(task->m_curl);
+        return CURL_WRITEFUNC_PAUSE;
+    }
+    task->HashBlock(task->m_downloaded, contents, length);
+    task->AddDownloaded(length);
+    return length;
+}
+
+// Write callback for a single range in segmented mode
+size_t DownloadTask::OnSegmentWrite(void* contents, size_t size, size_t nmemb, void* userp)
+{
+    DownloadSegment* segment = static_cast<DownloadSegment*>(userp);
+    size_t length = size * nmemb;
+    segment->lastData = std::chrono::steady_clock::now();
+
+    // Wait for the shared speed limit; libcurl delivers the same data again after the pause
+    if (!segment->task->m_engine->AcquireBandwidth(segment->curl, segment->task->m_bandwidthClass, length)) {
+        return CURL_WRITEFUNC_PAUSE;
+    }
+
+    // Refuse to write a full body at a range offset
+    if (!segment->verified) {
+        long responseCode = 0;
+        curl_easy_getinfo(segment->curl, CURLINFO_RESPONSE_CODE, &responseCode);
+        if (responseCode != 206) {
+            // A mirror that can't serve ranges is left out; the range continues on the others
+            wxLogError("Server ignored range request (HTTP %ld) from %s", responseCode, segment->task->m_mirrors[segment->mirror].url);
+            segment->task->DropMirror(segment->mirror, false);
+            return 0;
+        }
+        if (!segment->task->CheckMirror(segment)) {
+            return 0;
+        }
+        segment->verified = true;
+    }
+
+    // Never write past the end of the range
+    curl_off_t remaining = segment->end - segment->start + 1 - segment->downloaded;
+    if (remaining <= 0) {
+        return 0;
+    }
+    size_t toWrite = static_cast<size_t>(std::min<curl_off_t>(length, remaining));
+
+    // Copy into the mapping, or hand the data to the disk writer and wait while its buffers are full
+    if (segment->task->m_writer->HasFailed()) {
+        return 0;
+    }
+    if (segment->task->m_writer->IsMapped()) {
+        if (!segment->task->m_writer->Write(segment->start + segment->downloaded, contents, toWrite)) {
+            return 0;
+        }
+    } else if (!segment->task->m_diskWriter->Submit(segment->task->m_writer, segment->start + segment->downloaded, contents, toWrite)) {
+        segment->task->m_engine->ReturnBandwidth(segment->task->m_bandwidthClass, length);
+        segment->task->m_engine->WaitForBuffers(segment->curl);
+        return CURL_WRITEFUNC_PAUSE;
+    }
+    curl_off_t offset = segment->start + segment->downloaded;
+    segment->task->HashBlock(offset, contents, toWrite);
+    segment->downloaded += toWrite;
+    segment->task->AddDownloaded(toWrite);
+    
+    // Stop the connection when a piece doesn't match its hash
+    if (!segment->task->CheckPieces(segment, offset, contents, toWrite)) {
+        return 0;
+    }
+
+    return length;
+}
+
+// Header callback collecting size, range support and validators
+size_t DownloadTask::OnHeader(char* buffer, size_t size, size_t nitems, void* userdata)
+{
+    RemoteFileInfo* info = static_cast<RemoteFileInfo*>(userdata);
+    size_t length = size * nitems;
+    wxString header = wxString(buffer, length).Trim();
+
+    // Every redirect starts a new set of headers; the chain of redirects is kept
+    info->redirects.AddHeader(header);
+    if (header.StartsWith("HTTP/")) {
+        RedirectChain redirects = info->redirects;
+        *info = RemoteFileInfo();
+        info->redirects = redirects;
+        return length;
+    }
+
+    // Content-Range: bytes 0-0/12345
+    if (header.Lower().StartsWith("content-range:")) {
+        wxString total = header.AfterLast('/');
+        long long value = 0;
+        if (total.ToLongLong(&value)) {
+            info->contentLength = value;
+        }
+    } else if (header.Lower().StartsWith("accept-ranges:")) {
+        info->acceptRanges = header.Lower().Contains("bytes");
+    } else if (header.Lower().StartsWith("etag:")) {
+        info->etag = header.AfterFirst(':').Trim(false);
+    } else if (header.Lower().StartsWith("last-modified:")) {
+        info->lastModified = header.AfterFirst(':').Trim(false);
+    }
+
+    return length;
+}
+
+// Discard the probe body
+size_t DownloadTask::OnProbeWrite(void* contents, size_t size, size_t nmemb, void* userp)
+{
+    CURL* curl = static_cast<CURL*>(userp);
+    long responseCode = 0;
+    curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &responseCode);
+
+    // Abort if the server sends the whole file instead of one byte
+    if (responseCode != 206) {
+        return 0;
+    }
+
+    return size * nmemb;
+}
+
+// Progress callback for the single-connection transfer
+int DownloadTask::OnProgress(void* clientp, curl_off_t dltotal, curl_off_t dlnow, curl_off_t ultotal, curl_off_t ulnow)
+{
+    DownloadTask* task = static_cast<DownloadTask*>(clientp);
+
+    // Total size is only known once the headers have arrived
+    if (dltotal > 0) {
+        task->m_totalSize = task->m_resumeFrom + dltotal;
+    }
+
+    return 0;  // Return 0 to continue download
+}
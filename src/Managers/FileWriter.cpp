@@ -0,0 +1,289 @@
+#include "Managers/FileWriter.h"
+#include <wx/log.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#ifdef _WIN32
+#include <io.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#endif
+
+// Constructor
+FileWriter::FileWriter()
+    : m_fd(-1), m_failed(false), m_allocated(false), m_map(nullptr), m_mapSize(0)
+{
+}
+
+// Destructor
+FileWriter::~FileWriter()
+{
+    Close();
+}
+
+// Open the file for writing at any offset
+bool FileWriter::Open(const wxString& path, bool truncate)
+{
+    Close();
+    m_path = path;
+    m_failed = false;
+    m_allocated = false;
+
+#ifdef _WIN32
+    int flags = _O_RDWR | _O_CREAT | _O_BINARY;
+    if (truncate) {
+        flags |= _O_TRUNC;
+    }
+    m_fd = _open(path.c_str(), flags, _S_IREAD | _S_IWRITE);
+#else
+    int flags = O_RDWR | O_CREAT | O_CLOEXEC;
+    if (truncate) {
+        flags |= O_TRUNC;
+    }
+    m_fd = open(path.c_str(), flags, 0644);
+#endif
+    
+    if (m_fd < 0) {
+        wxLogError("Failed to open file for writing: %s", path);
+        return false;
+    }
+    
+    return true;
+}
+
+// Close the descriptor
+void FileWriter::Close()
+{
+    if (m_fd < 0) {
+        return;
+    }
+    
+    Unmap();
+
+#ifdef _WIN32
+    _close(m_fd);
+#else
+    close(m_fd);
+#endif
+    m_fd = -1;
+}
+
+// Reserve the blocks of the whole file
+bool FileWriter::Preallocate(long long size)
+{
+    if (m_fd < 0 || size <= 0) {
+        return false;
+    }
+
+#ifdef _WIN32
+    // Only grow the file; the bytes already on disk stay
+    long long current = _filelengthi64(m_fd);
+    if (current >= size) {
+        return true;
+    }
+    return _chsize_s(m_fd, size) == 0;
+#else
+#ifdef __linux__
+    // Also fills holes left in a resumed file; never shrinks it
+    if (fallocate(m_fd, 0, 0, size) == 0) {
+        m_allocated = true;
+        return true;
+    }
+    if (errno != EOPNOTSUPP && errno != ENOSYS) {
+        wxLogError("Failed to preallocate %lld bytes for %s", size, m_path);
+        return false;
+    }
+#endif
+    
+    // No allocation support: set the size and let the file stay sparse
+    struct stat info;
+    if (fstat(m_fd, &info) == 0 && info.st_size >= size) {
+        return true;
+    }
+    return ftruncate(m_fd, size) == 0;
+#endif
+}
+
+// Map the file for writing
+bool FileWriter::Map(long long size)
+{
+#ifdef _WIN32
+    return false;
+#else
+    // A store into a hole of a full disk would kill the process with SIGBUS
+    if (m_fd < 0 || size <= 0 || !m_allocated) {
+        return false;
+    }
+    
+    Unmap();
+    void* map = mmap(nullptr, static_cast<size_t>(size), PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0);
+    if (map == MAP_FAILED) {
+        wxLogError("Failed to map file: %s", m_path);
+        return false;
+    }
+    
+    m_map = static_cast<char*>(map);
+    m_mapSize = size;
+    
+    // Every connection fills its range front to back
+    madvise(m_map, static_cast<size_t>(m_mapSize), MADV_SEQUENTIAL);
+    return true;
+#endif
+}
+
+// Write back a finished range
+void FileWriter::ReleaseRange(long long offset, long long length)
+{
+#ifndef _WIN32
+    if (!m_map || offset >= m_mapSize || length <= 0) {
+        return;
+    }
+    
+    // msync and madvise want page-aligned addresses; only whole pages inside the range are dropped
+    long long pageSize = sysconf(_SC_PAGESIZE);
+    long long end = std::min(offset + length, m_mapSize);
+    long long first = (offset + pageSize - 1) / pageSize * pageSize;
+    long long last = end / pageSize * pageSize;
+    if (end == m_mapSize) {
+        last = end;
+    }
+    if (last <= first) {
+        return;
+    }
+    
+    msync(m_map + first, static_cast<size_t>(last - first), MS_ASYNC);
+    madvise(m_map + first, static_cast<size_t>(last - first), MADV_DONTNEED);
+#endif
+}
+
+// Write all bytes of a block at its offset
+bool FileWriter::Write(long long offset, const void* data, size_t length)
+{
+    if (m_fd < 0) {
+        return false;
+    }
+    
+    const char* buffer = static_cast<const char*>(data);
+    
+    // Mapped files take a copy; blocks outside the mapping use the descriptor
+    if (m_map && offset >= 0 && offset + static_cast<long long>(length) <= m_mapSize) {
+        memcpy(m_map + offset, buffer, length);
+        return true;
+    }
+
+#ifdef _WIN32
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (_lseeki64(m_fd, offset, SEEK_SET) < 0) {
+        m_failed = true;
+        return false;
+    }
+    while (length > 0) {
+        int written = _write(m_fd, buffer, static_cast<unsigned int>(length));
+        if (written <= 0) {
+            wxLogError("Failed to write to file: %s", m_path);
+            m_failed = true;
+            return false;
+        }
+        buffer += written;
+        length -= written;
+    }
+#else
+    while (length > 0) {
+        ssize_t written = pwrite(m_fd, buffer, length, offset);
+        if (written < 0 && errno == EINTR) {
+            continue;
+        }
+        if (written <= 0) {
+            wxLogError("Failed to write to file: %s", m_path);
+            m_failed = true;
+            return false;
+        }
+        buffer += written;
+        length -= written;
+        offset += written;
+    }
+#endif
+    
+    return true;
+}
+
+// Read all bytes of a block at its offset
+bool FileWriter::Read(long long offset, void* data, size_t length)
+{
+    if (m_fd < 0) {
+        return false;
+    }
+    
+    char* buffer = static_cast<char*>(data);
+
+#ifdef _WIN32
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (_lseeki64(m_fd, offset, SEEK_SET) < 0) {
+        return false;
+    }
+    while (length > 0) {
+        int count = _read(m_fd, buffer, static_cast<unsigned int>(length));
+        if (count <= 0) {
+            return false;
+        }
+        buffer += count;
+        length -= count;
+    }
+#else
+    while (length > 0) {
+        ssize_t count = pread(m_fd, buffer, length, offset);
+        if (count < 0 && errno == EINTR) {
+            continue;
+        }
+        if (count <= 0) {
+            return false;
+        }
+        buffer += count;
+        length -= count;
+        offset += count;
+    }
+#endif
+    
+    return true;
+}
+
+// Cut the file
+bool FileWriter::Truncate(long long length)
+{
+    if (m_fd < 0) {
+        return false;
+    }
+    
+    // The mapping must not reach past the end of the file
+    Unmap();
+
+#ifdef _WIN32
+    return _chsize_s(m_fd, length) == 0;
+#else
+    return ftruncate(m_fd, length) == 0;
+#endif
+}
+
+// Write back and remove the mapping
+void FileWriter::Unmap()
+{
+#ifndef _WIN32
+    if (!m_map) {
+        return;
+    }
+    
+    if (msync(m_map, static_cast<size_t>(m_mapSize), MS_SYNC) != 0) {
+        wxLogError("Failed to write mapped data to file: %s", m_path);
+        m_failed = true;
+    }
+    munmap(m_map, static_cast<size_t>(m_mapSize));
+    m_map = nullptr;
+    m_mapSize = 0;
+#endif
+}
@@ -0,0 +1,78 @@
+#include "Managers/HashWorker.h"
+
+// Constructor
+HashWorker::HashWorker()
+    : m_running(false)
+{
+}
+
+// Destructor
+HashWorker::~HashWorker()
+{
+    Stop();
+}
+
+// Start the worker thread
+void HashWorker::Start()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_running) {
+        return;
+    }
+    
+    m_running = true;
+    m_thread = std::thread(&HashWorker::Run, this);
+}
+
+// Stop the worker thread after the running job
+void HashWorker::Stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_running) {
+            return;
+        }
+        m_running = false;
+        m_jobs.clear();
+    }
+    m_condition.notify_one();
+    
+    if (m_thread.joinable()) {
+        m_thread.join();
+    }
+}
+
+// Queue a job
+void HashWorker::Post(Job job)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_running) {
+            return;
+        }
+        m_jobs.push_back(job);
+    }
+    m_condition.notify_one();
+}
+
+// Worker thread: run the jobs in the order they were queued
+void HashWorker::Run()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    
+    while (true) {
+        m_condition.wait(lock, [this]() {
+            return !m_running || !m_jobs.empty();
+        });
+        if (!m_running) {
+            break;
+        }
+        
+        Job job = m_jobs.front();
+        m_jobs.pop_front();
+        
+        lock.unlock();
+        job();
+        lock.lock();
+    }
+}
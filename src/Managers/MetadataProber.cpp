@@ -0,0 +1,281 @@
+#include "Managers/MetadataProber.h"
+#include "Managers/TransferEngine.h"
+#include "Managers/CurlHandlePool.h"
+#include "Managers/DownloadTask.h"
+#include <wx/log.h>
+#include <cstring>
+#include <cctype>
+#include <string>
+
+static const size_t MAX_RUNNING_PROBES = 16; // Probes in the engine at once
+
+// Constructor
+MetadataProber::MetadataProber(TransferEngine* engine, CurlHandlePool* pool, RedirectCache* redirects, ResultHandler onResult)
+    : m_engine(engine), m_pool(pool), m_redirects(redirects), m_onResult(onResult)
+{
+}
+
+// Destructor
+MetadataProber::~MetadataProber()
+{
+    for (auto& running : m_running) {
+        ReleaseRequest(running.second.get());
+    }
+}
+
+// Queue a URL
+void MetadataProber::Probe(int id, const wxString& url)
+{
+    m_engine->Post([this, id, url]() {
+        std::unique_ptr<Request> request(new Request());
+        request->id = id;
+        request->url = url;
+        request->useGet = false;
+        request->curl = nullptr;
+        request->headers = nullptr;
+        request->result.id = id;
+        memset(request->errorBuffer, 0, CURL_ERROR_SIZE);
+        
+        m_waiting.push_back(std::move(request));
+        StartRequests();
+    });
+}
+
+// Drop the probe of a download that started or was deleted
+void MetadataProber::Cancel(int id)
+{
+    m_engine->Post([this, id]() {
+        for (auto it = m_waiting.begin(); it != m_waiting.end(); ++it) {
+            if ((*it)->id == id) {
+                m_waiting.erase(it);
+                return;
+            }
+        }
+        
+        auto running = m_running.find(id);
+        if (running != m_running.end()) {
+            m_engine->RemoveTransfer(running->second->curl);
+            ReleaseRequest(running->second.get());
+            m_running.erase(running);
+            StartRequests();
+        }
+    });
+}
+
+// Move waiting probes into the engine while slots are free
+void MetadataProber::StartRequests()
+{
+    while (m_running.size() < MAX_RUNNING_PROBES && !m_waiting.empty()) {
+        std::unique_ptr<Request> request = std::move(m_waiting.front());
+        m_waiting.pop_front();
+        
+        // A download added twice is probed once
+        if (m_running.count(request->id)) {
+            continue;
+        }
+        
+        Request* started = request.get();
+        m_running[request->id] = std::move(request);
+        if (!StartRequest(started)) {
+            m_onResult(started->result);
+            m_running.erase(started->id);
+        }
+    }
+}
+
+// Configure a handle for HEAD, or a one-byte GET, and add it to the engine
+bool MetadataProber::StartRequest(Request* request)
+{
+    request->curl = m_pool->Acquire();
+    if (!request->curl) {
+        return false;
+    }
+    
+    wxString processedUrl = DownloadTask::PrepareUrl(request->url);
+    request->headers = DownloadTask::BuildRequestHeaders(request->url, processedUrl);
+    request->result = ProbeResult();
+    request->result.id = request->id;
+    request->contentLength.clear();
+    request->contentRange.clear();
+    request->disposition.clear();
+    request->redirects = RedirectChain();
+    
+    curl_easy_setopt(request->curl, CURLOPT_URL, processedUrl.c_str());
+    curl_easy_setopt(request->curl, CURLOPT_HTTPHEADER, request->headers);
+    curl_easy_setopt(request->curl, CURLOPT_FOLLOWLOCATION, 1L);
+    curl_easy_setopt(request->curl, CURLOPT_COOKIEFILE, "");
+    curl_easy_setopt(request->curl, CURLOPT_ERRORBUFFER, request->errorBuffer);
+    curl_easy_setopt(request->curl, CURLOPT_TIMEOUT, 30L);
+    curl_easy_setopt(request->curl, CURLOPT_CONNECTTIMEOUT, 15L);
+    curl_easy_setopt(request->curl, CURLOPT_SSL_VERIFYPEER, 0L);
+    curl_easy_setopt(request->curl, CURLOPT_SSL_VERIFYHOST, 0L);
+    curl_easy_setopt(request->curl, CURLOPT_HEADERFUNCTION, OnHeader);
+    curl_easy_setopt(request->curl, CURLOPT_HEADERDATA, request);
+    curl_easy_setopt(request->curl, CURLOPT_WRITEFUNCTION, OnWrite);
+    curl_easy_setopt(request->curl, CURLOPT_WRITEDATA, request->curl);
+    if (request->useGet) {
+        curl_easy_setopt(request->curl, CURLOPT_RANGE, "0-0");
+    } else {
+        curl_easy_setopt(request->curl, CURLOPT_NOBODY, 1L);
+    }
+    
+    int id = request->id;
+    m_engine->AddTransfer(request->curl, [this, id](CURL*, CURLcode result) {
+        OnRequestDone(id, result);
+    });
+    return true;
+}
+
+// Read the result of a probe, trying GET when HEAD was refused
+void MetadataProber::OnRequestDone(int id, CURLcode result)
+{
+    auto it = m_running.find(id);
+    if (it == m_running.end()) {
+        return;
+    }
+    Request* request = it->second.get();
+    
+    long responseCode = 0;
+    char* effectiveUrl = nullptr;
+    curl_easy_getinfo(request->curl, CURLINFO_RESPONSE_CODE, &responseCode);
+    curl_easy_getinfo(request->curl, CURLINFO_EFFECTIVE_URL, &effectiveUrl);
+    if (effectiveUrl) {
+        request->result.finalUrl = wxString::FromUTF8(effectiveUrl);
+    }
+    ReleaseRequest(request);
+    
+    // Transfers of the download go straight to where the redirects ended
+    wxString processedUrl = DownloadTask::PrepareUrl(request->url);
+    if (responseCode > 0 && responseCode < 400) {
+        m_redirects->Store(processedUrl, request->result.finalUrl, request->redirects);
+    }
+    
+    // Some servers answer HEAD with 403, 405 or 501, or drop the connection
+    if (!request->useGet && (result != CURLE_OK || responseCode >= 400)) {
+        request->useGet = true;
+        if (StartRequest(request)) {
+            return;
+        }
+    } else {
+        // A GET answered with the whole body is stopped once its headers are in
+        bool stopped = request->useGet && result == CURLE_WRITE_ERROR && responseCode == 200;
+        request->result.succeeded = (result == CURLE_OK || stopped) && responseCode >= 200 && responseCode < 300;
+    }
+    
+    // Content-Range: bytes 0-0/12345 carries the size of a ranged answer
+    ProbeResult& probe = request->result;
+    long long size = -1;
+    if (responseCode == 206) {
+        probe.acceptRanges = true;
+        if (request->contentRange.AfterLast('/').ToLongLong(&size)) {
+            probe.size = size;
+        }
+    } else if (request->contentLength.ToLongLong(&size)) {
+        probe.size = size;
+    }
+    probe.fileName = ParseFileName(request->disposition);
+    
+    if (!probe.succeeded) {
+        wxLogMessage("Probe of %s failed: %s (HTTP %ld)", request->url, curl_easy_strerror(result), responseCode);
+    }
+    
+    ProbeResult finished = probe;
+    m_running.erase(it);
+    m_onResult(finished);
+    StartRequests();
+}
+
+// Give the handle and headers of a request back
+void MetadataProber::ReleaseRequest(Request* request)
+{
+    if (request->curl) {
+        m_pool->Release(request->curl);
+        request->curl = nullptr;
+    }
+    curl_slist_free_all(request->headers);
+    request->headers = nullptr;
+}
+
+// File name of Content-Disposition: filename*=UTF-8''name (RFC 6266) wins over filename="name"
+wxString MetadataProber::ParseFileName(const wxString& disposition)
+{
+    wxString name;
+    wxString rest = disposition;
+    while (!rest.IsEmpty()) {
+        wxString parameter = rest.BeforeFirst(';').Trim().Trim(false);
+        rest = rest.AfterFirst(';');
+        
+        wxString key = parameter.BeforeFirst('=').Trim().Lower();
+        wxString value = parameter.AfterFirst('=').Trim(false);
+        if (key == "filename*") {
+            // charset'language'percent-encoded
+            std::string encoded = value.AfterLast('\'').ToStdString();
+            std::string decoded;
+            for (size_t i = 0; i < encoded.size(); i++) {
+                if (encoded[i] == '%' && i + 2 < encoded.size() && isxdigit(static_cast<unsigned char>(encoded[i + 1])) &&
+                    isxdigit(static_cast<unsigned char>(encoded[i + 2]))) {
+                    decoded += static_cast<char>(std::stoi(encoded.substr(i + 1, 2), nullptr, 16));
+                    i += 2;
+                } else {
+                    decoded += encoded[i];
+                }
+            }
+            name = wxString::FromUTF8(decoded.c_str());
+            break;
+        }
+        if (key == "filename") {
+            if (value.StartsWith("\"")) {
+                value = value.Mid(1).BeforeLast('"');
+            }
+            name = value;
+        }
+    }
+    
+    // Only the last path component; a server must not choose the folder
+    return name.AfterLast('/').AfterLast('\\').Trim().Trim(false);
+}
+
+// Header callback collecting the size, range support and file name
+size_t MetadataProber::OnHeader(char* buffer, size_t size, size_t nitems, void* userdata)
+{
+    Request* request = static_cast<Request*>(userdata);
+    size_t length = size * nitems;
+    wxString header = wxString(buffer, length).Trim();
+    wxString lower = header.Lower();
+    request->redirects.AddHeader(header);
+    
+    // Every redirect starts a new set of headers
+    if (header.StartsWith("HTTP/")) {
+        request->contentLength.clear();
+        request->contentRange.clear();
+        request->disposition.clear();
+        request->result.acceptRanges = false;
+        return length;
+    }
+    
+    if (lower.StartsWith("content-length:")) {
+        request->contentLength = header.AfterFirst(':').Trim(false);
+    } else if (lower.StartsWith("content-range:")) {
+        request->contentRange = header.AfterFirst(':').Trim(false);
+    } else if (lower.StartsWith("content-disposition:")) {
+        request->disposition = header.AfterFirst(':').Trim(false);
+    } else if (lower.StartsWith("accept-ranges:")) {
+        request->result.acceptRanges = lower.Contains("bytes");
+    }
+    
+    return length;
+}
+
+// Keep the one byte of a ranged answer, stop a whole body
+size_t MetadataProber::OnWrite(void* contents, size_t size, size_t nmemb, void* userp)
+{
+    CURL* curl = static_cast<CURL*>(userp);
+    long responseCode = 0;
+    curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &responseCode);
+    
+    if (responseCode != 206) {
+        return 0;
+    }
+    
+    return size * nmemb;
+}
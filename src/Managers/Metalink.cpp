@@ -0,0 +1,239 @@
+#include "Managers/Metalink.h"
+#include <wx/xml/xml.h>
+#include <wx/mstream.h>
+#include <wx/log.h>
+#include <curl/curl.h>
+#include <algorithm>
+
+static const size_t MAX_DOCUMENT_SIZE = 16 * 1024 * 1024; // Refuse anything this large as a Metalink document
+
+// Write callback collecting the document in memory
+static size_t OnDocumentWrite(void* contents, size_t size, size_t nmemb, void* userp)
+{
+    std::vector<char>* data = static_cast<std::vector<char>*>(userp);
+    size_t length = size * nmemb;
+    if (data->size() + length > MAX_DOCUMENT_SIZE) {
+        return 0;
+    }
+    
+    const char* bytes = static_cast<const char*>(contents);
+    data->insert(data->end(), bytes, bytes + length);
+    return length;
+}
+
+// The source names a Metalink document by its extension
+bool Metalink::IsMetalink(const wxString& source)
+{
+    wxString path = source.BeforeFirst('?').Lower();
+    return path.EndsWith(".meta4") || path.EndsWith(".metalink");
+}
+
+// The document has to be downloaded first
+bool Metalink::IsRemote(const wxString& source)
+{
+    return source.StartsWith("http://") || source.StartsWith("https://");
+}
+
+// Read the files of a local document
+bool Metalink::Load(const wxString& source, std::vector<MetalinkFile>& files)
+{
+    wxXmlDocument document;
+    if (!document.Load(source)) {
+        wxLogError("Invalid Metalink document: %s", source);
+        return false;
+    }
+    
+    return ReadDocument(document, source, files);
+}
+
+// Read the files of a downloaded document
+bool Metalink::Parse(const wxString& source, const std::vector<char>& data, std::vector<MetalinkFile>& files)
+{
+    wxXmlDocument document;
+    wxMemoryInputStream stream(data.data(), data.size());
+    if (!document.Load(stream)) {
+        wxLogError("Invalid Metalink document: %s", source);
+        return false;
+    }
+    
+    return ReadDocument(document, source, files);
+}
+
+// Set up a handle that downloads a document into memory
+void Metalink::PrepareFetch(CURL* curl, const wxString& url, std::vector<char>* data)
+{
+    curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
+    curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, OnDocumentWrite);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, data);
+    curl_easy_setopt(curl, CURLOPT_TIMEOUT, 30L);
+    curl_easy_setopt(curl, CURLOPT_SSL_VERIFYPEER, 0L);
+    curl_easy_setopt(curl, CURLOPT_SSL_VERIFYHOST, 0L);
+}
+
+// Collect the files of a loaded document
+bool Metalink::ReadDocument(const wxXmlDocument& document, const wxString& source, std::vector<MetalinkFile>& files)
+{
+    wxXmlNode* root = document.GetRoot();
+    if (!root || root->GetName() != "metalink") {
+        wxLogError("Not a Metalink document: %s", source);
+        return false;
+    }
+    
+    // Version 3 keeps the files inside a <files> element
+    files.clear();
+    for (wxXmlNode* node = root->GetChildren(); node; node = node->GetNext()) {
+        if (node->GetName() == "file") {
+            MetalinkFile file;
+            if (ReadFile(node, file)) {
+                files.push_back(file);
+            }
+        } else if (node->GetName() == "files") {
+            for (wxXmlNode* child = node->GetChildren(); child; child = child->GetNext()) {
+                MetalinkFile file;
+                if (child->GetName() == "file" && ReadFile(child, file)) {
+                    files.push_back(file);
+                }
+            }
+        }
+    }
+    
+    if (files.empty()) {
+        wxLogError("Metalink document lists no file that can be downloaded: %s", source);
+        return false;
+    }
+    
+    wxLogMessage("Loaded %zu files from Metalink document %s", files.size(), source);
+    return true;
+}
+
+// Read one <file> element
+bool Metalink::ReadFile(wxXmlNode* node, MetalinkFile& file)
+{
+    // Only the last path component; a document must not write outside the save folder
+    file.name = node->GetAttribute("name").AfterLast('/').AfterLast('\\');
+    if (file.name.IsEmpty() || file.name == "." || file.name == "..") {
+        return false;
+    }
+    
+    std::vector<std::pair<long, wxString>> urls;
+    ReadHashes(node, file);
+    ReadUrls(node, urls, false);
+    
+    for (wxXmlNode* child = node->GetChildren(); child; child = child->GetNext()) {
+        if (child->GetName() == "size") {
+            long long size = 0;
+            if (child->GetNodeContent().Trim().Trim(false).ToLongLong(&size)) {
+                file.size = size;
+            }
+        } else if (child->GetName() == "verification") {
+            ReadHashes(child, file);
+        } else if (child->GetName() == "resources") {
+            ReadUrls(child, urls, true);
+        }
+    }
+    
+    // Most preferred mirror first
+    std::stable_sort(urls.begin(), urls.end(), [](const std::pair<long, wxString>& a, const std::pair<long, wxString>& b) {
+        return a.first < b.first;
+    });
+    for (const auto& url : urls) {
+        if (std::find(file.urls.begin(), file.urls.end(), url.second) == file.urls.end()) {
+            file.urls.push_back(url.second);
+        }
+    }
+    
+    if (file.urls.empty()) {
+        wxLogError("Metalink file %s has no HTTP or FTP mirror", file.name);
+        return false;
+    }
+    
+    // Piece hashes must cover the whole file
+    if (file.pieceLength > 0 && file.size >= 0) {
+        long long pieces = (file.size + file.pieceLength - 1) / file.pieceLength;
+        if (pieces != static_cast<long long>(file.pieceHashes.size())) {
+            wxLogError("Metalink file %s has %zu piece hashes for %lld pieces, ignoring them", file.name, file.pieceHashes.size(), pieces);
+            file.pieceLength = 0;
+            file.pieceHashes.clear();
+        }
+    }
+    
+    return true;
+}
+
+// Read the whole-file and piece hashes among the children of a node
+void Metalink::ReadHashes(wxXmlNode* node, MetalinkFile& file)
+{
+    for (wxXmlNode* child = node->GetChildren(); child; child = child->GetNext()) {
+        wxString type = GetHashType(child->GetAttribute("type"));
+        
+        if (child->GetName() == "hash") {
+            wxString value = child->GetNodeContent().Trim().Trim(false).Lower();
+            if (type == "sha256") {
+                file.checksum = "sha256:" + value;
+            } else if (type == "md5" && file.checksum.IsEmpty()) {
+                file.checksum = "md5:" + value;
+            }
+        } else if (child->GetName() == "pieces") {
+            long long length = 0;
+            if (type != "sha256" || !child->GetAttribute("length").ToLongLong(&length) || length <= 0) {
+                wxLogMessage("Skipping %s piece hashes of %s", child->GetAttribute("type"), file.name);
+                continue;
+            }
+            
+            // The hashes are stored back to back, so one of the wrong length would shift all that follow
+            file.pieceLength = length;
+            file.pieceHashes.clear();
+            for (wxXmlNode* hash = child->GetChildren(); hash; hash = hash->GetNext()) {
+                if (hash->GetName() != "hash") {
+                    continue;
+                }
+                wxString value = hash->GetNodeContent().Trim().Trim(false).Lower();
+                if (value.length() != 64 || value.find_first_not_of("0123456789abcdef") != wxString::npos) {
+                    wxLogError("Ignoring the piece hashes of %s, one is not a SHA-256 digest", file.name);
+                    file.pieceLength = 0;
+                    file.pieceHashes.clear();
+                    break;
+                }
+                file.pieceHashes.push_back(value);
+            }
+        }
+    }
+}
+
+// Collect the <url> children of a node with their sort key, lower first
+void Metalink::ReadUrls(wxXmlNode* node, std::vector<std::pair<long, wxString>>& urls, bool version3)
+{
+    for (wxXmlNode* child = node->GetChildren(); child; child = child->GetNext()) {
+        if (child->GetName() != "url") {
+            continue;
+        }
+        
+        wxString url = child->GetNodeContent().Trim().Trim(false);
+        // Ranges are checked with HTTP 206, so only HTTP mirrors can share a file
+        wxString scheme = url.BeforeFirst(':').Lower();
+        if (scheme != "http" && scheme != "https") {
+            continue;
+        }
+        
+        // Version 4 ranks by priority (1 is best), version 3 by preference (100 is best)
+        long key = 0;
+        if (version3) {
+            long preference = 0;
+            child->GetAttribute("preference", "0").ToLong(&preference);
+            key = 100 - preference;
+        } else {
+            key = 999999;
+            child->GetAttribute("priority", "999999").ToLong(&key);
+        }
+        urls.push_back(std::make_pair(key, url));
+    }
+}
+
+// Normalize "sha-256" and "SHA256" to "sha256"
+wxString Metalink::GetHashType(const wxString& type)
+{
+    wxString normalized = type.Lower();
+    normalized.Replace("-", "");
+    return normalized;
+}
@@ -0,0 +1,334 @@
+#include "Managers/PieceJournal.h"
+#include <wx/log.h>
+#include <wx/filefn.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+// Sidecar format: magic, version, sizes, validators, bitmap, FNV-1a checksum of everything before it
+static const char JOURNAL_MAGIC[4] = { 'A', 'D', 'M', 'J' };
+static const uint32_t JOURNAL_VERSION = 1;
+
+// Smallest piece; larger files use larger pieces to keep the bitmap under 8 KB
+static const long long MIN_PIECE_SIZE = 256 * 1024;
+static const long long MAX_PIECES = 65536;
+
+// Append raw bytes of a value
+template <typename T>
+static void AppendValue(std::vector<uint8_t>& data, T value)
+{
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&value);
+    data.insert(data.end(), bytes, bytes + sizeof(T));
+}
+
+// Append a length-prefixed UTF-8 string
+static void AppendString(std::vector<uint8_t>& data, const wxString& text)
+{
+    wxScopedCharBuffer utf8 = text.utf8_str();
+    AppendValue<uint32_t>(data, static_cast<uint32_t>(utf8.length()));
+    data.insert(data.end(), utf8.data(), utf8.data() + utf8.length());
+}
+
+// Read a value, advancing the position; false past the end
+template <typename T>
+static bool ReadValue(const std::vector<uint8_t>& data, size_t& pos, T& value)
+{
+    if (pos + sizeof(T) > data.size()) {
+        return false;
+    }
+    memcpy(&value, data.data() + pos, sizeof(T));
+    pos += sizeof(T);
+    return true;
+}
+
+// Read a length-prefixed UTF-8 string
+static bool ReadString(const std::vector<uint8_t>& data, size_t& pos, wxString& text)
+{
+    uint32_t length = 0;
+    if (!ReadValue(data, pos, length) || pos + length > data.size()) {
+        return false;
+    }
+    text = wxString::FromUTF8(reinterpret_cast<const char*>(data.data() + pos), length);
+    pos += length;
+    return true;
+}
+
+// 32-bit FNV-1a hash
+static uint32_t Checksum(const uint8_t* data, size_t length)
+{
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < length; i++) {
+        hash ^= data[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+// Constructor
+PieceJournal::PieceJournal()
+    : m_totalSize(0), m_pieceSize(MIN_PIECE_SIZE)
+{
+}
+
+// Sidecar path
+wxString PieceJournal::GetPath(const wxString& filePath)
+{
+    return filePath + ".admj";
+}
+
+// Read the sidecar
+bool PieceJournal::Load(const wxString& filePath)
+{
+    m_totalSize = 0;
+    m_bitmap.clear();
+    
+    FILE* fp = fopen(GetPath(filePath).c_str(), "rb");
+    if (!fp) {
+        return false;
+    }
+    
+    std::vector<uint8_t> data;
+    uint8_t block[4096];
+    size_t count;
+    while ((count = fread(block, 1, sizeof(block), fp)) > 0) {
+        data.insert(data.end(), block, block + count);
+    }
+    fclose(fp);
+    
+    // Check the trailer before trusting any field
+    if (data.size() < sizeof(JOURNAL_MAGIC) + sizeof(uint32_t) || memcmp(data.data(), JOURNAL_MAGIC, sizeof(JOURNAL_MAGIC)) != 0) {
+        return false;
+    }
+    size_t bodySize = data.size() - sizeof(uint32_t);
+    uint32_t checksum = 0;
+    memcpy(&checksum, data.data() + bodySize, sizeof(uint32_t));
+    if (checksum != Checksum(data.data(), bodySize)) {
+        wxLogError("Damaged download journal: %s", GetPath(filePath));
+        return false;
+    }
+    
+    size_t pos = sizeof(JOURNAL_MAGIC);
+    uint32_t version = 0;
+    long long totalSize = 0;
+    long long pieceSize = 0;
+    uint32_t bitmapSize = 0;
+    wxString etag;
+    wxString lastModified;
+    if (!ReadValue(data, pos, version) || version != JOURNAL_VERSION ||
+        !ReadValue(data, pos, totalSize) || !ReadValue(data, pos, pieceSize) ||
+        !ReadString(data, pos, etag) || !ReadString(data, pos, lastModified) ||
+        !ReadValue(data, pos, bitmapSize) || pos + bitmapSize != bodySize) {
+        return false;
+    }
+    if (totalSize <= 0 || pieceSize <= 0 || bitmapSize != static_cast<uint32_t>(((totalSize + pieceSize - 1) / pieceSize + 7) / 8)) {
+        return false;
+    }
+    
+    m_totalSize = totalSize;
+    m_pieceSize = pieceSize;
+    m_etag = etag;
+    m_lastModified = lastModified;
+    m_bitmap.assign(data.begin() + pos, data.begin() + pos + bitmapSize);
+    return true;
+}
+
+// Write the sidecar
+bool PieceJournal::Save(const wxString& filePath) const
+{
+    if (!IsValid()) {
+        return false;
+    }
+    
+    std::vector<uint8_t> data(JOURNAL_MAGIC, JOURNAL_MAGIC + sizeof(JOURNAL_MAGIC));
+    AppendValue(data, JOURNAL_VERSION);
+    AppendValue(data, m_totalSize);
+    AppendValue(data, m_pieceSize);
+    AppendString(data, m_etag);
+    AppendString(data, m_lastModified);
+    AppendValue<uint32_t>(data, static_cast<uint32_t>(m_bitmap.size()));
+    data.insert(data.end(), m_bitmap.begin(), m_bitmap.end());
+    AppendValue(data, Checksum(data.data(), data.size()));
+    
+    wxString path = GetPath(filePath);
+    wxString tempPath = path + ".tmp";
+    FILE* fp = fopen(tempPath.c_str(), "wb");
+    if (!fp) {
+        wxLogError("Failed to write download journal: %s", path);
+        return false;
+    }
+    bool ok = fwrite(data.data(), 1, data.size(), fp) == data.size();
+    ok = (fclose(fp) == 0) && ok;
+    
+    // Replace the old copy in one step
+    if (!ok || !wxRenameFile(tempPath, path, true)) {
+        wxLogError("Failed to write download journal: %s", path);
+        wxRemoveFile(tempPath);
+        return false;
+    }
+    
+    return true;
+}
+
+// Drop the journal
+void PieceJournal::Discard(const wxString& filePath)
+{
+    m_totalSize = 0;
+    m_bitmap.clear();
+    
+    wxString path = GetPath(filePath);
+    if (wxFileExists(path)) {
+        wxRemoveFile(path);
+    }
+}
+
+// Start an empty bitmap
+void PieceJournal::Reset(long long totalSize, const wxString& etag, const wxString& lastModified)
+{
+    m_totalSize = std::max(totalSize, 0LL);
+    m_pieceSize = MIN_PIECE_SIZE;
+    while (m_totalSize / m_pieceSize > MAX_PIECES) {
+        m_pieceSize *= 2;
+    }
+    
+    m_etag = etag;
+    m_lastModified = lastModified;
+    m_bitmap.assign((GetPieceCount() + 7) / 8, 0);
+}
+
+// Mark finished pieces
+void PieceJournal::MarkWritten(const std::vector<SegmentProgress>& ranges, const std::vector<std::pair<long long, long long>>& pending)
+{
+    if (!IsValid()) {
+        return;
+    }
+    
+    // Merge touching ranges, so a piece split between two connections counts once both are done
+    std::vector<std::pair<long long, long long>> written;
+    for (const auto& range : ranges) {
+        if (range.downloaded > 0) {
+            written.push_back(std::make_pair(range.start, range.start + range.downloaded));
+        }
+    }
+    std::sort(written.begin(), written.end());
+    
+    std::vector<std::pair<long long, long long>> merged;
+    for (const auto& range : written) {
+        if (!merged.empty() && range.first <= merged.back().second) {
+            merged.back().second = std::max(merged.back().second, range.second);
+        } else {
+            merged.push_back(range);
+        }
+    }
+    
+    for (const auto& range : merged) {
+        size_t first = static_cast<size_t>((range.first + m_pieceSize - 1) / m_pieceSize);
+        for (size_t piece = first; piece < GetPieceCount(); piece++) {
+            long long start = static_cast<long long>(piece) * m_pieceSize;
+            long long end = start + GetPieceLength(piece);
+            if (end > range.second) {
+                break;
+            }
+            
+            // Data still in a write buffer isn't in the file yet
+            bool waiting = false;
+            for (const auto& block : pending) {
+                if (block.first < end && block.first + block.second > start) {
+                    waiting = true;
+                    break;
+                }
+            }
+            if (!waiting) {
+                SetPiece(piece);
+            }
+        }
+    }
+}
+
+// Bytes in finished pieces
+long long PieceJournal::GetCompletedBytes() const
+{
+    long long completed = 0;
+    for (size_t piece = 0; piece < GetPieceCount(); piece++) {
+        if (HasPiece(piece)) {
+            completed += GetPieceLength(piece);
+        }
+    }
+    
+    return completed;
+}
+
+// Bytes in finished pieces from the start of the file without gaps
+long long PieceJournal::GetContiguousBytes() const
+{
+    long long contiguous = 0;
+    for (size_t piece = 0; piece < GetPieceCount() && HasPiece(piece); piece++) {
+        contiguous += GetPieceLength(piece);
+    }
+    
+    return contiguous;
+}
+
+// Finished runs
+std::vector<SegmentProgress> PieceJournal::GetCompletedRanges() const
+{
+    return GetRanges(true);
+}
+
+// Missing runs
+std::vector<SegmentProgress> PieceJournal::GetMissingRanges() const
+{
+    return GetRanges(false);
+}
+
+// Number of pieces
+size_t PieceJournal::GetPieceCount() const
+{
+    return static_cast<size_t>((m_totalSize + m_pieceSize - 1) / m_pieceSize);
+}
+
+// Length of a piece; the last one may be short
+long long PieceJournal::GetPieceLength(size_t piece) const
+{
+    long long start = static_cast<long long>(piece) * m_pieceSize;
+    return std::min(m_pieceSize, m_totalSize - start);
+}
+
+// Test a bit
+bool PieceJournal::HasPiece(size_t piece) const
+{
+    return (m_bitmap[piece / 8] & (1 << (piece % 8))) != 0;
+}
+
+// Set a bit
+void PieceJournal::SetPiece(size_t piece)
+{
+    m_bitmap[piece / 8] |= static_cast<uint8_t>(1 << (piece % 8));
+}
+
+// Runs of pieces in one state
+std::vector<SegmentProgress> PieceJournal::GetRanges(bool completed) const
+{
+    std::vector<SegmentProgress> ranges;
+    size_t count = GetPieceCount();
+    
+    size_t piece = 0;
+    while (piece < count) {
+        if (HasPiece(piece) != completed) {
+            piece++;
+            continue;
+        }
+        
+        size_t first = piece;
+        while (piece < count && HasPiece(piece) == completed) {
+            piece++;
+        }
+        
+        SegmentProgress range;
+        range.start = static_cast<long long>(first) * m_pieceSize;
+        range.end = std::min(static_cast<long long>(piece) * m_pieceSize, m_totalSize) - 1;
+        range.downloaded = completed ? range.end - range.start + 1 : 0;
+        ranges.push_back(range);
+    }
+    
+    return ranges;
+}
@@ -0,0 +1,77 @@
+#include "Managers/ProgressBoard.h"
+
+// Constructor
+ProgressSlot::ProgressSlot()
+    : m_sequence(0), m_downloaded(0), m_totalSize(0), m_speed(0), m_eta(-1), m_connections(0)
+{
+}
+
+// Replace the values; the odd sequence tells readers to try again
+void ProgressSlot::Publish(const ProgressSnapshot& snapshot)
+{
+    unsigned sequence = m_sequence.load(std::memory_order_relaxed);
+    m_sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    
+    m_downloaded.store(snapshot.downloaded, std::memory_order_relaxed);
+    m_totalSize.store(snapshot.totalSize, std::memory_order_relaxed);
+    m_speed.store(snapshot.speed, std::memory_order_relaxed);
+    m_eta.store(snapshot.eta, std::memory_order_relaxed);
+    m_connections.store(snapshot.connections, std::memory_order_relaxed);
+    
+    m_sequence.store(sequence + 2, std::memory_order_release);
+}
+
+// Read until no publish overlapped the read
+ProgressSnapshot ProgressSlot::Read() const
+{
+    ProgressSnapshot snapshot;
+    unsigned before = 0;
+    unsigned after = 0;
+    do {
+        before = m_sequence.load(std::memory_order_acquire);
+        snapshot.downloaded = m_downloaded.load(std::memory_order_relaxed);
+        snapshot.totalSize = m_totalSize.load(std::memory_order_relaxed);
+        snapshot.speed = m_speed.load(std::memory_order_relaxed);
+        snapshot.eta = m_eta.load(std::memory_order_relaxed);
+        snapshot.connections = m_connections.load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        after = m_sequence.load(std::memory_order_relaxed);
+    } while ((before & 1) != 0 || before != after);
+    
+    return snapshot;
+}
+
+// Fresh slot for a starting download; a task of an earlier run keeps its own until released
+std::shared_ptr<ProgressSlot> ProgressBoard::Open(int id)
+{
+    std::shared_ptr<ProgressSlot> slot = std::make_shared<ProgressSlot>();
+    
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_slots[id] = slot;
+    return slot;
+}
+
+// Forget the slot of a finished download; its task may still hold it
+void ProgressBoard::Close(int id)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_slots.erase(id);
+}
+
+// Last values of a running download
+bool ProgressBoard::Read(int id, ProgressSnapshot& snapshot) const
+{
+    std::shared_ptr<ProgressSlot> slot;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = m_slots.find(id);
+        if (it == m_slots.end()) {
+            return false;
+        }
+        slot = it->second;
+    }
+    
+    snapshot = slot->Read();
+    return true;
+}
@@ -0,0 +1,100 @@
+#include "Managers/RateEstimator.h"
+#include <cmath>
+
+static const long long TICK_MS = 1000;
+static const double RATE_WEIGHT = 0.3;          // Share of the newest window rate in the EWMA
+static const long long LONG_TERM_SECONDS = 30;  // Span of recent history before it counts for the ETA
+
+// Constructor
+RateEstimator::RateEstimator()
+    : m_windowStart(0), m_windowCount(0), m_historyCount(0), m_historyStep(1), m_ticks(0), m_rate(-1)
+{
+    Reset(0);
+}
+
+// Start over from a byte count
+void RateEstimator::Reset(long long bytes, Clock::time_point now)
+{
+    Sample sample = { now, bytes };
+    
+    m_window[0] = sample;
+    m_windowStart = 0;
+    m_windowCount = 1;
+    m_history[0] = sample;
+    m_historyCount = 1;
+    m_historyStep = 1;
+    m_ticks = 0;
+    m_rate = -1;
+}
+
+// Record the byte count, sampling once per tick
+void RateEstimator::AddSample(long long bytes, Clock::time_point now)
+{
+    const Sample& newest = m_window[(m_windowStart + m_windowCount - 1) % WINDOW_SIZE];
+    if (std::chrono::duration_cast<std::chrono::milliseconds>(now - newest.time).count() < TICK_MS) {
+        return;
+    }
+    
+    // Slide the window, dropping its oldest tick when full
+    Sample sample = { now, bytes };
+    if (m_windowCount < WINDOW_SIZE) {
+        m_window[(m_windowStart + m_windowCount) % WINDOW_SIZE] = sample;
+        m_windowCount++;
+    } else {
+        m_window[m_windowStart] = sample;
+        m_windowStart = (m_windowStart + 1) % WINDOW_SIZE;
+    }
+    
+    // Rate across the window, smoothed into the EWMA
+    const Sample& oldest = m_window[m_windowStart];
+    double seconds = std::chrono::duration<double>(now - oldest.time).count();
+    double rate = seconds > 0 ? (bytes - oldest.bytes) / seconds : 0;
+    m_rate = m_rate < 0 ? rate : RATE_WEIGHT * rate + (1 - RATE_WEIGHT) * m_rate;
+    
+    if (++m_ticks % m_historyStep == 0) {
+        AddToHistory(sample);
+    }
+}
+
+// Smoothed bytes per second
+long long RateEstimator::GetRate() const
+{
+    return m_rate > 0 ? static_cast<long long>(std::llround(m_rate)) : 0;
+}
+
+// Seconds until the remaining bytes are in
+long long RateEstimator::GetEta(long long remaining) const
+{
+    if (remaining <= 0) {
+        return 0;
+    }
+    
+    // Once the later half of the history is long enough, its average steadies the current rate
+    double rate = m_rate;
+    const Sample& first = m_history[m_historyCount / 2];
+    const Sample& last = m_history[m_historyCount - 1];
+    double span = std::chrono::duration<double>(last.time - first.time).count();
+    if (span >= LONG_TERM_SECONDS && rate >= 0) {
+        rate = (rate + (last.bytes - first.bytes) / span) / 2;
+    }
+    
+    if (rate <= 0) {
+        return -1;
+    }
+    return static_cast<long long>(std::ceil(remaining / rate));
+}
+
+// Append a sample; a full history keeps every other sample and is sampled half as often
+void RateEstimator::AddToHistory(const Sample& sample)
+{
+    if (m_historyCount == HISTORY_SIZE) {
+        size_t kept = 0;
+        for (size_t i = 0; i < HISTORY_SIZE; i += 2) {
+            m_history[kept++] = m_history[i];
+        }
+        m_historyCount = kept;
+        m_historyStep *= 2;
+    }
+    
+    m_history[m_historyCount++] = sample;
+}
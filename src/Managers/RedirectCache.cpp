@@ -0,0 +1,124 @@
+#include "Managers/RedirectCache.h"
+#include <wx/log.h>
+#include <algorithm>
+
+static const long long PERMANENT_REDIRECT_TTL = 24 * 60 * 60; // 301 and 308 without Cache-Control
+static const long long TEMPORARY_REDIRECT_TTL = 5 * 60;       // 302, 303 and 307; long enough for the connections of a download
+static const size_t MAX_ENTRIES = 4096;
+
+// Constructor
+RedirectChain::RedirectChain()
+    : m_hops(0), m_ttl(-1), m_inRedirect(false), m_hopTtl(0), m_hopNoStore(false)
+{
+}
+
+// Take the next header line
+void RedirectChain::AddHeader(const wxString& header)
+{
+    wxString lower = header.Lower();
+    
+    // HTTP/1.1 302 Found
+    if (lower.StartsWith("http/")) {
+        if (m_inRedirect) {
+            long long ttl = m_hopNoStore ? 0 : m_hopTtl;
+            m_ttl = m_ttl < 0 ? ttl : std::min(m_ttl, ttl);
+        }
+        
+        long status = 0;
+        header.AfterFirst(' ').BeforeFirst(' ').ToLong(&status);
+        m_inRedirect = (status == 301 || status == 302 || status == 303 || status == 307 || status == 308);
+        m_hopNoStore = false;
+        if (m_inRedirect) {
+            m_hops++;
+            m_hopTtl = (status == 301 || status == 308) ? PERMANENT_REDIRECT_TTL : TEMPORARY_REDIRECT_TTL;
+        }
+        return;
+    }
+    
+    // Cache-Control: max-age=600, or no-store/no-cache for a redirect that must be followed every time
+    if (m_inRedirect && lower.StartsWith("cache-control:")) {
+        if (lower.Contains("no-store") || lower.Contains("no-cache")) {
+            m_hopNoStore = true;
+        }
+        long long maxAge = 0;
+        int position = lower.Find("max-age=");
+        if (position != wxNOT_FOUND && lower.Mid(position + 8).BeforeFirst(',').Trim().ToLongLong(&maxAge)) {
+            m_hopTtl = std::max(maxAge, 0LL);
+        }
+    }
+}
+
+// Seconds the whole chain may be reused
+long long RedirectChain::GetTtl() const
+{
+    long long ttl = m_ttl;
+    if (m_inRedirect) {
+        long long hopTtl = m_hopNoStore ? 0 : m_hopTtl;
+        ttl = ttl < 0 ? hopTtl : std::min(ttl, hopTtl);
+    }
+    
+    return std::max(ttl, 0LL);
+}
+
+// Final URL of a URL
+wxString RedirectCache::Resolve(const wxString& url)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    
+    auto it = m_entries.find(url);
+    if (it == m_entries.end()) {
+        return url;
+    }
+    if (it->second.expires <= Clock::now()) {
+        m_entries.erase(it);
+        return url;
+    }
+    
+    return it->second.finalUrl;
+}
+
+// Remember where a request ended
+void RedirectCache::Store(const wxString& url, const wxString& finalUrl, const RedirectChain& chain)
+{
+    long long ttl = chain.GetTtl();
+    if (chain.GetHops() == 0 || ttl <= 0 || finalUrl.IsEmpty() || finalUrl == url) {
+        return;
+    }
+    
+    std::lock_guard<std::mutex> lock(m_mutex);
+    
+    Clock::time_point now = Clock::now();
+    if (m_entries.size() >= MAX_ENTRIES) {
+        RemoveExpired(now);
+    }
+    if (m_entries.size() >= MAX_ENTRIES) {
+        m_entries.erase(m_entries.begin());
+    }
+    
+    Entry& entry = m_entries[url];
+    entry.finalUrl = finalUrl;
+    entry.expires = now + std::chrono::seconds(ttl);
+    wxLogMessage("Caching redirect of %s to %s for %lld s", url, finalUrl, ttl);
+}
+
+// Forget a URL whose endpoint returned an error
+void RedirectCache::Invalidate(const wxString& url)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    
+    if (m_entries.erase(url) > 0) {
+        wxLogMessage("Dropped cached redirect of %s", url);
+    }
+}
+
+// Drop the entries past their lifetime
+void RedirectCache::RemoveExpired(Clock::time_point now)
+{
+    for (auto it = m_entries.begin(); it != m_entries.end();) {
+        if (it->second.expires <= now) {
+            it = m_entries.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
@@ -0,0 +1,492 @@
+#include "Managers/StreamHasher.h"
+#include <algorithm>
+#include <cstring>
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define STREAMHASHER_X86 1
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
+
+namespace {
+
+// SHA-256 round constants
+const uint32_t SHA256_K[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+// MD5 per-round shift amounts and constants
+const uint32_t MD5_SHIFT[64] = {
+    7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22,
+    5, 9, 14, 20, 5, 9, 14, 20, 5, 9, 14, 20, 5, 9, 14, 20,
+    4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23,
+    6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21
+};
+
+const uint32_t MD5_K[64] = {
+    0xd76aa478, 0xe8c7b756, 0x242070db, 0xc1bdceee, 0xf57c0faf, 0x4787c62a, 0xa8304613, 0xfd469501,
+    0x698098d8, 0x8b44f7af, 0xffff5bb1, 0x895cd7be, 0x6b901122, 0xfd987193, 0xa679438e, 0x49b40821,
+    0xf61e2562, 0xc040b340, 0x265e5a51, 0xe9b6c7aa, 0xd62f105d, 0x02441453, 0xd8a1e681, 0xe7d3fbc8,
+    0x21e1cde6, 0xc33707d6, 0xf4d50d87, 0x455a14ed, 0xa9e3e905, 0xfcefa3f8, 0x676f02d9, 0x8d2a4c8a,
+    0xfffa3942, 0x8771f681, 0x6d9d6122, 0xfde5380c, 0xa4beea44, 0x4bdecfa9, 0xf6bb4b60, 0xbebfbc70,
+    0x289b7ec6, 0xeaa127fa, 0xd4ef3085, 0x04881d05, 0xd9d4d039, 0xe6db99e5, 0x1fa27cf8, 0xc4ac5665,
+    0xf4292244, 0x432aff97, 0xab9423a7, 0xfc93a039, 0x655b59c3, 0x8f0ccc92, 0xffeff47d, 0x85845dd1,
+    0x6fa87e4f, 0xfe2ce6e0, 0xa3014314, 0x4e0811a1, 0xf7537e82, 0xbd3af235, 0x2ad7d2bb, 0xeb86d391
+};
+
+// Reflected Castagnoli polynomial
+const uint32_t CRC32C_POLY = 0x82f63b78;
+
+inline uint32_t RotateRight(uint32_t value, int bits)
+{
+    return (value >> bits) | (value << (32 - bits));
+}
+
+inline uint32_t RotateLeft(uint32_t value, int bits)
+{
+    return (value << bits) | (value >> (32 - bits));
+}
+
+inline uint32_t LoadBigEndian(const uint8_t* p)
+{
+    return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | uint32_t(p[3]);
+}
+
+inline uint32_t LoadLittleEndian(const uint8_t* p)
+{
+    return uint32_t(p[0]) | (uint32_t(p[1]) << 8) | (uint32_t(p[2]) << 16) | (uint32_t(p[3]) << 24);
+}
+
+// Portable SHA-256 compression of whole 64-byte blocks
+void Sha256BlocksGeneric(uint32_t state[8], const uint8_t* data, size_t blocks)
+{
+    while (blocks--) {
+        uint32_t w[64];
+        for (int i = 0; i < 16; ++i) {
+            w[i] = LoadBigEndian(data + i * 4);
+        }
+        for (int i = 16; i < 64; ++i) {
+            uint32_t s0 = RotateRight(w[i - 15], 7) ^ RotateRight(w[i - 15], 18) ^ (w[i - 15] >> 3);
+            uint32_t s1 = RotateRight(w[i - 2], 17) ^ RotateRight(w[i - 2], 19) ^ (w[i - 2] >> 10);
+            w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+        }
+        
+        uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+        uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+        for (int i = 0; i < 64; ++i) {
+            uint32_t s1 = RotateRight(e, 6) ^ RotateRight(e, 11) ^ RotateRight(e, 25);
+            uint32_t ch = (e & f) ^ (~e & g);
+            uint32_t t1 = h + s1 + ch + SHA256_K[i] + w[i];
+            uint32_t s0 = RotateRight(a, 2) ^ RotateRight(a, 13) ^ RotateRight(a, 22);
+            uint32_t maj = (a & b) ^ (a & c) ^ (b & c);
+            uint32_t t2 = s0 + maj;
+            h = g;
+            g = f;
+            f = e;
+            e = d + t1;
+            d = c;
+            c = b;
+            b = a;
+            a = t1 + t2;
+        }
+        
+        state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+        state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+        data += 64;
+    }
+}
+
+// Byte-at-a-time CRC32C table
+struct Crc32cTable {
+    uint32_t entries[256];
+    
+    Crc32cTable()
+    {
+        for (uint32_t i = 0; i < 256; ++i) {
+            uint32_t crc = i;
+            for (int bit = 0; bit < 8; ++bit) {
+                crc = (crc >> 1) ^ ((crc & 1) ? CRC32C_POLY : 0);
+            }
+            entries[i] = crc;
+        }
+    }
+};
+
+uint32_t Crc32cGeneric(uint32_t crc, const uint8_t* data, size_t length)
+{
+    static const Crc32cTable table;
+    while (length--) {
+        crc = table.entries[(crc ^ *data++) & 0xff] ^ (crc >> 8);
+    }
+    return crc;
+}
+
+#ifdef STREAMHASHER_X86
+
+// SHA-256 with the SHA extensions; four rounds per message vector, two per sha256rnds2
+__attribute__((target("sha,sse4.1")))
+void Sha256BlocksShaNi(uint32_t state[8], const uint8_t* data, size_t blocks)
+{
+    const __m128i byteSwap = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+    
+    // The instructions keep the state as ABEF and CDGH
+    __m128i tmp = _mm_shuffle_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(&state[0])), 0xb1);
+    __m128i state1 = _mm_shuffle_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(&state[4])), 0x1b);
+    __m128i state0 = _mm_alignr_epi8(tmp, state1, 8);
+    state1 = _mm_blend_epi16(state1, tmp, 0xf0);
+    
+    while (blocks--) {
+        __m128i savedState0 = state0;
+        __m128i savedState1 = state1;
+        
+        __m128i message[4];
+        for (int i = 0; i < 4; ++i) {
+            message[i] = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i * 16)), byteSwap);
+        }
+        
+        for (int group = 0; group < 16; ++group) {
+            __m128i& current = message[group & 3];
+            __m128i& previous = message[(group + 3) & 3];
+            __m128i& next = message[(group + 1) & 3];
+            
+            __m128i words = _mm_add_epi32(current, _mm_loadu_si128(reinterpret_cast<const __m128i*>(&SHA256_K[group * 4])));
+            state1 = _mm_sha256rnds2_epu32(state1, state0, words);
+            
+            // Expand the schedule for the group after next
+            if (group >= 3 && group < 15) {
+                next = _mm_add_epi32(next, _mm_alignr_epi8(current, previous, 4));
+                next = _mm_sha256msg2_epu32(next, current);
+            }
+            
+            words = _mm_shuffle_epi32(words, 0x0e);
+            state0 = _mm_sha256rnds2_epu32(state0, state1, words);
+            
+            if (group >= 1 && group < 13) {
+                previous = _mm_sha256msg1_epu32(previous, current);
+            }
+        }
+        
+        state0 = _mm_add_epi32(state0, savedState0);
+        state1 = _mm_add_epi32(state1, savedState1);
+        data += 64;
+    }
+    
+    // Back to ABCD and EFGH
+    tmp = _mm_shuffle_epi32(state0, 0x1b);
+    state1 = _mm_shuffle_epi32(state1, 0xb1);
+    state0 = _mm_blend_epi16(tmp, state1, 0xf0);
+    state1 = _mm_alignr_epi8(state1, tmp, 8);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(&state[0]), state0);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(&state[4]), state1);
+}
+
+// CRC32C with the SSE4.2 instruction, eight bytes at a time
+__attribute__((target("sse4.2")))
+uint32_t Crc32cHardware(uint32_t crc, const uint8_t* data, size_t length)
+{
+#ifdef __x86_64__
+    uint64_t crc64 = crc;
+    while (length >= 8) {
+        uint64_t word;
+        memcpy(&word, data, 8);
+        crc64 = _mm_crc32_u64(crc64, word);
+        data += 8;
+        length -= 8;
+    }
+    crc = static_cast<uint32_t>(crc64);
+#endif
+    while (length--) {
+        crc = _mm_crc32_u8(crc, *data++);
+    }
+    return crc;
+}
+
+#endif // STREAMHASHER_X86
+
+// Kernels picked once for the running processor
+struct HashKernels {
+    void (*sha256)(uint32_t*, const uint8_t*, size_t);
+    uint32_t (*crc32c)(uint32_t, const uint8_t*, size_t);
+    
+    HashKernels() : sha256(Sha256BlocksGeneric), crc32c(Crc32cGeneric)
+    {
+#ifdef STREAMHASHER_X86
+        unsigned int eax = 0, ebx = 0, ecx = 0, edx = 0;
+        bool sse41 = false;
+        if (__get_cpuid(1, &eax, &ebx, &ecx, &edx)) {
+            sse41 = (ecx & bit_SSE4_1) != 0;
+            if (ecx & bit_SSE4_2) {
+                crc32c = Crc32cHardware;
+            }
+        }
+        if (sse41 && __get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx) && (ebx & bit_SHA)) {
+            sha256 = Sha256BlocksShaNi;
+        }
+#endif
+    }
+};
+
+const HashKernels& GetKernels()
+{
+    static const HashKernels kernels;
+    return kernels;
+}
+
+// Portable MD5 compression of whole 64-byte blocks
+void Md5Blocks(uint32_t state[4], const uint8_t* data, size_t blocks)
+{
+    while (blocks--) {
+        uint32_t m[16];
+        for (int i = 0; i < 16; ++i) {
+            m[i] = LoadLittleEndian(data + i * 4);
+        }
+        
+        uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+        for (int i = 0; i < 64; ++i) {
+            uint32_t f;
+            int g;
+            if (i < 16) {
+                f = (b & c) | (~b & d);
+                g = i;
+            } else if (i < 32) {
+                f = (d & b) | (~d & c);
+                g = (5 * i + 1) & 15;
+            } else if (i < 48) {
+                f = b ^ c ^ d;
+                g = (3 * i + 5) & 15;
+            } else {
+                f = c ^ (b | ~d);
+                g = (7 * i) & 15;
+            }
+            f += a + MD5_K[i] + m[g];
+            a = d;
+            d = c;
+            c = b;
+            b += RotateLeft(f, MD5_SHIFT[i]);
+        }
+        
+        state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+        data += 64;
+    }
+}
+
+wxString ToHex(const uint8_t* bytes, size_t length)
+{
+    static const char digits[] = "0123456789abcdef";
+    wxString hex;
+    for (size_t i = 0; i < length; ++i) {
+        hex += digits[bytes[i] >> 4];
+        hex += digits[bytes[i] & 15];
+    }
+    return hex;
+}
+    
+} // namespace
+
+// Constructor
+StreamHasher::StreamHasher(bool sha256Only)
+    : m_sha256Only(sha256Only)
+{
+    Reset();
+}
+
+// Start again from the first byte
+void StreamHasher::Reset()
+{
+    static const uint32_t sha256Initial[8] = {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+    };
+    static const uint32_t md5Initial[4] = { 0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476 };
+    
+    m_length = 0;
+    m_finished = false;
+    memcpy(m_sha256, sha256Initial, sizeof(m_sha256));
+    m_sha256Used = 0;
+    memcpy(m_md5, md5Initial, sizeof(m_md5));
+    m_md5Used = 0;
+    m_crc32c = 0xffffffff;
+    m_sha256Digest.clear();
+    m_md5Digest.clear();
+    m_crc32cDigest.clear();
+}
+
+// Hash the next block of the file
+void StreamHasher::Update(const void* data, size_t length)
+{
+    if (m_finished || length == 0) {
+        return;
+    }
+    
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    UpdateSha256(bytes, length);
+    if (!m_sha256Only) {
+        UpdateMd5(bytes, length);
+        m_crc32c = GetKernels().crc32c(m_crc32c, bytes, length);
+    }
+    m_length += length;
+}
+
+// Fill the partial block first, then compress whole blocks straight from the input
+void StreamHasher::UpdateSha256(const uint8_t* data, size_t length)
+{
+    if (m_sha256Used > 0) {
+        size_t take = std::min(length, sizeof(m_sha256Block) - m_sha256Used);
+        memcpy(m_sha256Block + m_sha256Used, data, take);
+        m_sha256Used += take;
+        data += take;
+        length -= take;
+        if (m_sha256Used < sizeof(m_sha256Block)) {
+            return;
+        }
+        GetKernels().sha256(m_sha256, m_sha256Block, 1);
+        m_sha256Used = 0;
+    }
+    
+    size_t blocks = length / 64;
+    if (blocks > 0) {
+        GetKernels().sha256(m_sha256, data, blocks);
+        data += blocks * 64;
+        length -= blocks * 64;
+    }
+    
+    memcpy(m_sha256Block, data, length);
+    m_sha256Used = length;
+}
+
+void StreamHasher::UpdateMd5(const uint8_t* data, size_t length)
+{
+    if (m_md5Used > 0) {
+        size_t take = std::min(length, sizeof(m_md5Block) - m_md5Used);
+        memcpy(m_md5Block + m_md5Used, data, take);
+        m_md5Used += take;
+        data += take;
+        length -= take;
+        if (m_md5Used < sizeof(m_md5Block)) {
+            return;
+        }
+        Md5Blocks(m_md5, m_md5Block, 1);
+        m_md5Used = 0;
+    }
+    
+    size_t blocks = length / 64;
+    if (blocks > 0) {
+        Md5Blocks(m_md5, data, blocks);
+        data += blocks * 64;
+        length -= blocks * 64;
+    }
+    
+    memcpy(m_md5Block, data, length);
+    m_md5Used = length;
+}
+
+// Pad the last blocks and format the digests
+void StreamHasher::Finish()
+{
+    if (m_finished) {
+        return;
+    }
+    
+    // Both padding schemes append 0x80, zeros and the bit length in the last 8 bytes
+    uint64_t bits = static_cast<uint64_t>(m_length) * 8;
+    uint8_t padding[72] = { 0x80 };
+    size_t padLength = (m_length % 64 < 56 ? 56 : 120) - m_length % 64;
+    
+    uint8_t lengthBytes[8];
+    for (int i = 0; i < 8; ++i) {
+        lengthBytes[i] = static_cast<uint8_t>(bits >> (56 - i * 8));
+    }
+    UpdateSha256(padding, padLength);
+    UpdateSha256(lengthBytes, 8);
+    
+    uint8_t digest[32];
+    for (int i = 0; i < 8; ++i) {
+        digest[i * 4] = static_cast<uint8_t>(m_sha256[i] >> 24);
+        digest[i * 4 + 1] = static_cast<uint8_t>(m_sha256[i] >> 16);
+        digest[i * 4 + 2] = static_cast<uint8_t>(m_sha256[i] >> 8);
+        digest[i * 4 + 3] = static_cast<uint8_t>(m_sha256[i]);
+    }
+    m_sha256Digest = ToHex(digest, 32);
+    m_finished = true;
+    if (m_sha256Only) {
+        return;
+    }
+    
+    for (int i = 0; i < 8; ++i) {
+        lengthBytes[i] = static_cast<uint8_t>(bits >> (i * 8));
+    }
+    UpdateMd5(padding, padLength);
+    UpdateMd5(lengthBytes, 8);
+    
+    for (int i = 0; i < 4; ++i) {
+        digest[i * 4] = static_cast<uint8_t>(m_md5[i]);
+        digest[i * 4 + 1] = static_cast<uint8_t>(m_md5[i] >> 8);
+        digest[i * 4 + 2] = static_cast<uint8_t>(m_md5[i] >> 16);
+        digest[i * 4 + 3] = static_cast<uint8_t>(m_md5[i] >> 24);
+    }
+    m_md5Digest = ToHex(digest, 16);
+    
+    m_crc32cDigest = wxString::Format("%08x", ~m_crc32c);
+}
+
+// Lower-case hex digest
+wxString StreamHasher::GetDigest(ChecksumType type) const
+{
+    switch (type) {
+        case ChecksumType::SHA256:
+            return m_sha256Digest;
+        case ChecksumType::MD5:
+            return m_md5Digest;
+        case ChecksumType::CRC32C:
+            return m_crc32cDigest;
+        default:
+            return wxString();
+    }
+}
+
+// Split an expected checksum into its algorithm and digest
+bool StreamHasher::ParseChecksum(const wxString& text, ChecksumType& type, wxString& digest)
+{
+    wxString value = text;
+    value.Trim().Trim(false);
+    value.MakeLower();
+    
+    wxString name;
+    if (value.Contains(":")) {
+        name = value.BeforeFirst(':');
+        value = value.AfterFirst(':');
+        value.Trim(false);
+    }
+    
+    for (size_t i = 0; i < value.length(); ++i) {
+        wxUniChar c = value[i];
+        if (!((c >= '0' && c <= '9') || (c >= 'a' && c <= 'f'))) {
+            return false;
+        }
+    }
+    
+    // Without a name the length tells the algorithm
+    if (name == "sha256" || name == "sha-256" || (name.IsEmpty() && value.length() == 64)) {
+        type = ChecksumType::SHA256;
+    } else if (name == "md5" || (name.IsEmpty() && value.length() == 32)) {
+        type = ChecksumType::MD5;
+    } else if (name == "crc32c" || (name.IsEmpty() && value.length() == 8)) {
+        type = ChecksumType::CRC32C;
+    } else {
+        return false;
+    }
+    
+    size_t expected = type == ChecksumType::SHA256 ? 64 : type == ChecksumType::MD5 ? 32 : 8;
+    if (value.length() != expected) {
+        return false;
+    }
+    
+    digest = value;
+    return true;
+}
@@ -0,0 +1,453 @@
+#include "Managers/TransferEngine.h"
+#include <wx/log.h>
+#include <algorithm>
+
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#endif
+
+// Longest time the loop sleeps without looking at timers and queued work
+static const long MAX_WAIT_MS = 1000;
+
+// Constructor
+TransferEngine::TransferEngine()
+    : m_multi(nullptr), m_running(false), m_epollFd(-1), m_wakeFd(-1), m_curlTimerArmed(false)
+{
+    m_multi = curl_multi_init();
+
+#ifdef __linux__
+    curl_multi_setopt(m_multi, CURLMOPT_SOCKETFUNCTION, SocketCallback);
+    curl_multi_setopt(m_multi, CURLMOPT_SOCKETDATA, this);
+    curl_multi_setopt(m_multi, CURLMOPT_TIMERFUNCTION, TimerCallback);
+    curl_multi_setopt(m_multi, CURLMOPT_TIMERDATA, this);
+    
+    m_epollFd = epoll_create1(EPOLL_CLOEXEC);
+    m_wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    
+    struct epoll_event event = {};
+    event.events = EPOLLIN;
+    event.data.fd = m_wakeFd;
+    epoll_ctl(m_epollFd, EPOLL_CTL_ADD, m_wakeFd, &event);
+#endif
+}
+
+// Destructor
+TransferEngine::~TransferEngine()
+{
+    Stop();
+    
+    // Detach transfers still in the loop; their owners clean up the easy handles
+    for (auto& entry : m_handlers) {
+        curl_multi_remove_handle(m_multi, entry.first);
+    }
+    m_handlers.clear();
+    
+    curl_multi_cleanup(m_multi);
+
+#ifdef __linux__
+    if (m_wakeFd >= 0) {
+        close(m_wakeFd);
+    }
+    if (m_epollFd >= 0) {
+        close(m_epollFd);
+    }
+#endif
+}
+
+// Start the engine thread
+void TransferEngine::Start()
+{
+    if (m_running) {
+        return;
+    }
+    
+    m_running = true;
+    m_thread = std::thread(&TransferEngine::Run, this);
+    
+    wxLogMessage("Transfer engine started");
+}
+
+// Stop the engine thread
+void TransferEngine::Stop()
+{
+    if (!m_running) {
+        return;
+    }
+    
+    m_running = false;
+    Wakeup();
+    
+    if (m_thread.joinable()) {
+        m_thread.join();
+    }
+    
+    wxLogMessage("Transfer engine stopped");
+}
+
+// Add a transfer; on the engine thread right away, so a RemoveTransfer that follows always finds it
+void TransferEngine::AddTransfer(CURL* curl, CompletionHandler onDone)
+{
+    if (!IsEngineThread()) {
+        Post([this, curl, onDone]() { AddTransfer(curl, onDone); });
+        return;
+    }
+    
+    m_handlers[curl] = onDone;
+    
+    CURLMcode res = curl_multi_add_handle(m_multi, curl);
+    if (res != CURLM_OK) {
+        wxLogError("curl_multi_add_handle() failed: %s", curl_multi_strerror(res));
+        m_handlers.erase(curl);
+        
+        // Report the failure after the caller has finished setting up the transfer, unless it removes it first
+        m_failedAdds.insert(curl);
+        Post([this, curl, onDone]() {
+            if (m_failedAdds.erase(curl) > 0) {
+                onDone(curl, CURLE_FAILED_INIT);
+            }
+        });
+    }
+}
+
+// Remove a transfer without completing it
+void TransferEngine::RemoveTransfer(CURL* curl)
+{
+    m_failedAdds.erase(curl);
+    
+    auto it = m_handlers.find(curl);
+    if (it == m_handlers.end()) {
+        return;
+    }
+    
+    curl_multi_remove_handle(m_multi, curl);
+    m_handlers.erase(it);
+    m_pausedHandles.erase(curl);
+    m_bufferWaiters.erase(curl);
+}
+
+// Set the shared rate limit
+void TransferEngine::SetRateLimit(long long bytesPerSecond, long long burstBytes)
+{
+    m_limiter.SetRate(bytesPerSecond, burstBytes);
+    
+    // Let the loop pick up the new rate right away
+    Wakeup();
+}
+
+// Cap connections per host
+void TransferEngine::SetMaxHostConnections(long maxConnections)
+{
+    Post([this, maxConnections]() {
+        curl_multi_setopt(m_multi, CURLMOPT_MAX_HOST_CONNECTIONS, maxConnections);
+    });
+}
+
+// Configure a bandwidth class
+void TransferEngine::SetBandwidthClass(int classId, int weight, long long minRate, long long maxRate)
+{
+    m_limiter.SetClass(classId, weight, minRate, maxRate);
+    Wakeup();
+}
+
+// Take bandwidth for received data
+bool TransferEngine::AcquireBandwidth(CURL* curl, int classId, size_t bytes)
+{
+    if (m_limiter.TryConsume(classId, static_cast<long long>(bytes))) {
+        return true;
+    }
+    
+    m_pausedHandles[curl] = classId;
+    return false;
+}
+
+// Give back bandwidth for refused data
+void TransferEngine::ReturnBandwidth(int classId, size_t bytes)
+{
+    m_limiter.Refund(classId, static_cast<long long>(bytes));
+}
+
+// Park a transfer until the disk writer has space
+void TransferEngine::WaitForBuffers(CURL* curl)
+{
+    m_bufferWaiters.insert(curl);
+}
+
+// Continue transfers parked by the disk writer
+void TransferEngine::ResumeBufferWaiters()
+{
+    Post([this]() {
+        std::set<CURL*> waiters;
+        waiters.swap(m_bufferWaiters);
+        
+        // Unpausing may deliver data right away and park the handle again
+        for (CURL* curl : waiters) {
+            if (m_handlers.find(curl) != m_handlers.end()) {
+                curl_easy_pause(curl, CURLPAUSE_CONT);
+            }
+        }
+    });
+}
+
+// Check whether the engine holds a transfer back
+bool TransferEngine::IsPaused(CURL* curl) const
+{
+    return m_pausedHandles.find(curl) != m_pausedHandles.end() || m_bufferWaiters.find(curl) != m_bufferWaiters.end();
+}
+
+// Queue a function for the engine thread
+void TransferEngine::Post(std::function<void()> task)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_taskMutex);
+        m_pendingTasks.push_back(task);
+    }
+    Wakeup();
+}
+
+// Queue a function for the engine thread after a delay
+void TransferEngine::PostDelayed(long delayMs, std::function<void()> task)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_taskMutex);
+        m_timers.insert(std::make_pair(Clock::now() + std::chrono::milliseconds(delayMs), task));
+    }
+    Wakeup();
+}
+
+// Check the calling thread
+bool TransferEngine::IsEngineThread() const
+{
+    return std::this_thread::get_id() == m_thread.get_id();
+}
+
+// Interrupt the wait in the engine loop
+void TransferEngine::Wakeup()
+{
+#ifdef __linux__
+    uint64_t value = 1;
+    ssize_t written = write(m_wakeFd, &value, sizeof(value));
+    (void)written;
+#else
+    curl_multi_wakeup(m_multi);
+#endif
+}
+
+// Engine loop
+void TransferEngine::Run()
+{
+    wxLogMessage("Transfer engine thread started");
+    
+    int running = 0;
+    
+    while (m_running) {
+        long timeout = GetWaitTimeout();
+
+#ifdef __linux__
+        struct epoll_event events[64];
+        int count = epoll_wait(m_epollFd, events, 64, static_cast<int>(timeout));
+        
+        for (int i = 0; i < count; i++) {
+            if (events[i].data.fd == m_wakeFd) {
+                uint64_t value;
+                ssize_t bytes = read(m_wakeFd, &value, sizeof(value));
+                (void)bytes;
+                continue;
+            }
+            
+            int flags = 0;
+            if (events[i].events & EPOLLIN) {
+                flags |= CURL_CSELECT_IN;
+            }
+            if (events[i].events & EPOLLOUT) {
+                flags |= CURL_CSELECT_OUT;
+            }
+            if (events[i].events & (EPOLLERR | EPOLLHUP)) {
+                flags |= CURL_CSELECT_ERR;
+            }
+            
+            curl_multi_socket_action(m_multi, events[i].data.fd, flags, &running);
+        }
+#else
+        curl_multi_poll(m_multi, nullptr, 0, static_cast<int>(timeout), nullptr);
+        curl_multi_perform(m_multi, &running);
+#endif
+        
+        // Let libcurl handle its own timeouts
+        if (m_curlTimerArmed && Clock::now() >= m_curlDeadline) {
+            m_curlTimerArmed = false;
+            curl_multi_socket_action(m_multi, CURL_SOCKET_TIMEOUT, 0, &running);
+        }
+        
+        CheckCompleted();
+        ResumePausedTransfers();
+        RunPendingTasks();
+        RunDueTimers();
+    }
+    
+    wxLogMessage("Transfer engine thread stopped");
+}
+
+// Run work queued by other threads
+void TransferEngine::RunPendingTasks()
+{
+    std::vector<std::function<void()>> tasks;
+    {
+        std::lock_guard<std::mutex> lock(m_taskMutex);
+        tasks.swap(m_pendingTasks);
+    }
+    
+    for (auto& task : tasks) {
+        task();
+    }
+}
+
+// Run delayed work whose time has come
+void TransferEngine::RunDueTimers()
+{
+    std::vector<std::function<void()>> due;
+    {
+        std::lock_guard<std::mutex> lock(m_taskMutex);
+        Clock::time_point now = Clock::now();
+        while (!m_timers.empty() && m_timers.begin()->first <= now) {
+            due.push_back(m_timers.begin()->second);
+            m_timers.erase(m_timers.begin());
+        }
+    }
+    
+    for (auto& task : due) {
+        task();
+    }
+}
+
+// Hand finished transfers back to their owners
+void TransferEngine::CheckCompleted()
+{
+    CURLMsg* msg;
+    int messagesLeft;
+    while ((msg = curl_multi_info_read(m_multi, &messagesLeft))) {
+        if (msg->msg != CURLMSG_DONE) {
+            continue;
+        }
+        
+        CURL* curl = msg->easy_handle;
+        CURLcode result = msg->data.result;
+        
+        auto it = m_handlers.find(curl);
+        if (it == m_handlers.end()) {
+            curl_multi_remove_handle(m_multi, curl);
+            continue;
+        }
+        
+        CompletionHandler onDone = it->second;
+        RemoveTransfer(curl);
+        onDone(curl, result);
+    }
+}
+
+// Continue transfers paused by the limiter once there is bandwidth again
+void TransferEngine::ResumePausedTransfers()
+{
+    if (m_pausedHandles.empty()) {
+        return;
+    }
+    
+    // Take out the transfers whose class has tokens again
+    std::vector<CURL*> ready;
+    for (auto it = m_pausedHandles.begin(); it != m_pausedHandles.end();) {
+        if (m_limiter.GetDelayMs(it->second) == 0) {
+            ready.push_back(it->first);
+            it = m_pausedHandles.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    
+    // Unpausing may deliver data right away and pause the handle again
+    for (CURL* curl : ready) {
+        if (m_handlers.find(curl) != m_handlers.end()) {
+            curl_easy_pause(curl, CURLPAUSE_CONT);
+        }
+    }
+}
+
+// Time until the next thing the loop has to do
+long TransferEngine::GetWaitTimeout()
+{
+    Clock::time_point now = Clock::now();
+    Clock::time_point wakeAt = now + std::chrono::milliseconds(MAX_WAIT_MS);
+    
+    if (m_curlTimerArmed) {
+        wakeAt = std::min(wakeAt, m_curlDeadline);
+    }
+    for (auto& entry : m_pausedHandles) {
+        long delayMs = m_limiter.GetDelayMs(entry.second);
+        if (delayMs >= 0) {
+            wakeAt = std::min(wakeAt, now + std::chrono::milliseconds(delayMs));
+        }
+    }
+    
+    {
+        std::lock_guard<std::mutex> lock(m_taskMutex);
+        if (!m_pendingTasks.empty()) {
+            return 0;
+        }
+        if (!m_timers.empty()) {
+            wakeAt = std::min(wakeAt, m_timers.begin()->first);
+        }
+    }
+    
+    if (wakeAt <= now) {
+        return 0;
+    }
+    
+    return static_cast<long>(std::chrono::duration_cast<std::chrono::milliseconds>(wakeAt - now).count()) + 1;
+}
+
+// libcurl wants a socket watched for different events
+int TransferEngine::SocketCallback(CURL* curl, curl_socket_t socket, int what, void* userp, void* socketp)
+{
+#ifdef __linux__
+    TransferEngine* engine = static_cast<TransferEngine*>(userp);
+    
+    if (what == CURL_POLL_REMOVE) {
+        epoll_ctl(engine->m_epollFd, EPOLL_CTL_DEL, socket, nullptr);
+        curl_multi_assign(engine->m_multi, socket, nullptr);
+        return 0;
+    }
+    
+    struct epoll_event event = {};
+    event.data.fd = socket;
+    if (what == CURL_POLL_IN || what == CURL_POLL_INOUT) {
+        event.events |= EPOLLIN;
+    }
+    if (what == CURL_POLL_OUT || what == CURL_POLL_INOUT) {
+        event.events |= EPOLLOUT;
+    }
+    
+    // socketp marks sockets that are already registered with epoll
+    if (socketp) {
+        epoll_ctl(engine->m_epollFd, EPOLL_CTL_MOD, socket, &event);
+    } else {
+        epoll_ctl(engine->m_epollFd, EPOLL_CTL_ADD, socket, &event);
+        curl_multi_assign(engine->m_multi, socket, engine);
+    }
+#endif
+    return 0;
+}
+
+// libcurl wants to be called back after a timeout
+int TransferEngine::TimerCallback(CURLM* multi, long timeoutMs, void* userp)
+{
+    TransferEngine* engine = static_cast<TransferEngine*>(userp);
+    
+    if (timeoutMs < 0) {
+        engine->m_curlTimerArmed = false;
+    } else {
+        engine->m_curlTimerArmed = true;
+        engine->m_curlDeadline = Clock::now() + std::chrono::milliseconds(timeoutMs);
+    }
+    
+    return 0;
+}
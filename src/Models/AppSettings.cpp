@@ -3,10 +3,34 @@
 #include <wx/filename.h>
 #include <wx/stdpaths.h>
 
+// Read the share of one priority, named by its config key prefix
+static void ReadPriorityBandwidth(wxConfig& config, const wxString& prefix, PriorityBandwidth& bandwidth, int defaultWeight)
+{
+    config.Read(prefix + "Weight", &bandwidth.weight, defaultWeight);
+    config.Read(prefix + "MinRate", &bandwidth.minRate, 0);
+    config.Read(prefix + "MaxRate", &bandwidth.maxRate, 0);
+}
+
+// Write the share of one priority
+static void WritePriorityBandwidth(wxConfig& config, const wxString& prefix, const PriorityBandwidth& bandwidth)
+{
+    config.Write(prefix + "Weight", bandwidth.weight);
+    config.Write(prefix + "MinRate", bandwidth.minRate);
+    config.Write(prefix + "MaxRate", bandwidth.maxRate);
+}
+
 // Constructor
 AppSettings::AppSettings()
     : defaultSavePath(wxStandardPaths::Get().GetDocumentsDir())
     , maxSimultaneousDownloads(3)
+    , maxConnectionsPerDownload(4)
+    , maxConnectionsPerHost(8)
+    , hostRequestInterval(250)
+    , writeMode(WriteMode::BUFFERED)
+    , speedLimitBurst(250)
+    , highPriority{4, 0, 0}
+    , normalPriority{2, 0, 0}
+    , lowPriority{1, 0, 0}
     , showNotifications(true)
     , minimizeToTray(false)
     , startWithWindows(false)
@@ -23,6 +47,19 @@ void AppSettings::Load()
     
     config.Read("DefaultSavePath", &defaultSavePath, wxStandardPaths::Get().GetDocumentsDir());
     config.Read("MaxSimultaneousDownloads", &maxSimultaneousDownloads, 3);
+    config.Read("MaxConnectionsPerDownload", &maxConnectionsPerDownload, 4);
+    config.Read("MaxConnectionsPerHost", &maxConnectionsPerHost, 8);
+    config.Read("HostRequestInterval", &hostRequestInterval, 250);
+    
+    int mode = 0;
+    config.Read("WriteMode", &mode, 0);
+    writeMode = (mode == static_cast<int>(WriteMode::MAPPED)) ? WriteMode::MAPPED : WriteMode::BUFFERED;
+    
+    config.Read("SpeedLimitBurst", &speedLimitBurst, 250);
+    ReadPriorityBandwidth(config, "HighPriority", highPriority, 4);
+    ReadPriorityBandwidth(config, "NormalPriority", normalPriority, 2);
+    ReadPriorityBandwidth(config, "LowPriority", lowPriority, 1);
+    
     config.Read("ShowNotifications", &showNotifications, true);
     config.Read("MinimizeToTray", &minimizeToTray, false);
     config.Read("StartWithWindows", &startWithWindows, false);
@@ -38,6 +75,14 @@ void AppSettings::Save()
     
     config.Write("DefaultSavePath", defaultSavePath);
     config.Write("MaxSimultaneousDownloads", maxSimultaneousDownloads);
+    config.Write("MaxConnectionsPerDownload", maxConnectionsPerDownload);
+    config.Write("MaxConnectionsPerHost", maxConnectionsPerHost);
+    config.Write("HostRequestInterval", hostRequestInterval);
+    config.Write("WriteMode", static_cast<int>(writeMode));
+    config.Write("SpeedLimitBurst", speedLimitBurst);
+    WritePriorityBandwidth(config, "HighPriority", highPriority);
+    WritePriorityBandwidth(config, "NormalPriority", normalPriority);
+    WritePriorityBandwidth(config, "LowPriority", lowPriority);
     config.Write("ShowNotifications", showNotifications);
     config.Write("MinimizeToTray", minimizeToTray);
     config.Write("StartWithWindows", startWithWindows);
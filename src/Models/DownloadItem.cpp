@@ -8,7 +8,7 @@ const double DownloadItem::GB = 1024 * 1024 * 1024;
 
 DownloadItem::DownloadItem()
     : id(-1), status(DownloadStatus::PENDING), progress(0), size(0), downloadedSize(0), speed(0),
-      isYouTube(false), youtubeFormat(""), mainFrame(nullptr) {
+      connections(0), priority(DownloadPriority::NORMAL), pieceLength(0), acceptRanges(true), isYouTube(false), youtubeFormat(""), mainFrame(nullptr) {
     // تعيين تاريخ الإضافة
     dateAdded = wxDateTime::Now().Format("%Y-%m-%d %H:%M:%S");
 }
@@ -24,6 +24,7 @@ wxString DownloadItem::GetStatusText() const {
         case DownloadStatus::COMPLETED: return "مكتمل";
         case DownloadStatus::ERROR: return "فشل";
         case DownloadStatus::CANCELED: return "ملغى";
+        case DownloadStatus::QUEUED: return "في الطابور";
         default: return "غير معروف";
     }
 }
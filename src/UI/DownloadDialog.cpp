@@ -1,14 +1,17 @@
 #include "UI/DownloadDialog.h"
+#include "Managers/StreamHasher.h"
 #include <wx/stattext.h>
 #include <wx/textctrl.h>
 #include <wx/button.h>
 #include <wx/sizer.h>
 #include <wx/dirdlg.h>
 #include <wx/msgdlg.h>
+#include <wx/spinctrl.h>
 
 // Constructor
-DownloadDialog::DownloadDialog(wxWindow* parent)
-  : wxDialog(parent, wxID_ANY, "Add Download", wxDefaultPosition, wxSize(500, 200))
+DownloadDialog::DownloadDialog(wxWindow* parent, int defaultConnections)
+  : wxDialog(parent, wxID_ANY, "Add Download", wxDefaultPosition, wxSize(500, 460)),
+    m_defaultConnections(defaultConnections)
 {
   // Create UI
   CreateUI();
@@ -23,12 +26,13 @@ void DownloadDialog::CreateUI()
   // Create main sizer
   wxBoxSizer* mainSizer = new wxBoxSizer(wxVERTICAL);
   
-  // URL
+  // URLs, one per line
   wxBoxSizer* urlSizer = new wxBoxSizer(wxHORIZONTAL);
-  urlSizer->Add(new wxStaticText(this, wxID_ANY, "URL:"), 0, wxALIGN_CENTER_VERTICAL | wxRIGHT, 5);
-  m_urlCtrl = new wxTextCtrl(this, wxID_ANY, wxEmptyString, wxDefaultPosition, wxDefaultSize, wxTE_PROCESS_ENTER);
-  urlSizer->Add(m_urlCtrl, 1, wxALIGN_CENTER_VERTICAL);
-  mainSizer->Add(urlSizer, 0, wxEXPAND | wxALL, 10);
+  urlSizer->Add(new wxStaticText(this, wxID_ANY, "URLs:"), 0, wxALIGN_TOP | wxRIGHT, 5);
+  m_urlCtrl = new wxTextCtrl(this, wxID_ANY, wxEmptyString, wxDefaultPosition, wxSize(-1, 80), wxTE_MULTILINE);
+  m_urlCtrl->SetHint("Download URLs, one per line, or the URL or path of a .meta4/.metalink file");
+  urlSizer->Add(m_urlCtrl, 1, wxEXPAND);
+  mainSizer->Add(urlSizer, 1, wxEXPAND | wxALL, 10);
   
   // Save path
   wxBoxSizer* savePathSizer = new wxBoxSizer(wxHORIZONTAL);
@@ -39,6 +43,29 @@ void DownloadDialog::CreateUI()
   savePathSizer->Add(browseButton, 0, wxALIGN_CENTER_VERTICAL);
   mainSizer->Add(savePathSizer, 0, wxEXPAND | wxLEFT | wxRIGHT | wxBOTTOM, 10);
   
+  // Connections
+  wxBoxSizer* connectionsSizer = new wxBoxSizer(wxHORIZONTAL);
+  connectionsSizer->Add(new wxStaticText(this, wxID_ANY, "Connections:"), 0, wxALIGN_CENTER_VERTICAL | wxRIGHT, 5);
+  m_connectionsCtrl = new wxSpinCtrl(this, wxID_ANY, wxEmptyString, wxDefaultPosition, wxDefaultSize, wxSP_ARROW_KEYS, 1, 16, m_defaultConnections);
+  connectionsSizer->Add(m_connectionsCtrl, 0, wxALIGN_CENTER_VERTICAL);
+  mainSizer->Add(connectionsSizer, 0, wxEXPAND | wxLEFT | wxRIGHT | wxBOTTOM, 10);
+  
+  // Expected checksum
+  wxBoxSizer* checksumSizer = new wxBoxSizer(wxHORIZONTAL);
+  checksumSizer->Add(new wxStaticText(this, wxID_ANY, "Checksum:"), 0, wxALIGN_CENTER_VERTICAL | wxRIGHT, 5);
+  m_checksumCtrl = new wxTextCtrl(this, wxID_ANY);
+  m_checksumCtrl->SetHint("Optional, e.g. sha256:<hex>, md5:<hex> or crc32c:<hex>");
+  checksumSizer->Add(m_checksumCtrl, 1, wxALIGN_CENTER_VERTICAL);
+  mainSizer->Add(checksumSizer, 0, wxEXPAND | wxLEFT | wxRIGHT | wxBOTTOM, 10);
+  
+  // Mirrors
+  wxBoxSizer* mirrorsSizer = new wxBoxSizer(wxHORIZONTAL);
+  mirrorsSizer->Add(new wxStaticText(this, wxID_ANY, "Mirrors:"), 0, wxALIGN_TOP | wxRIGHT, 5);
+  m_mirrorsCtrl = new wxTextCtrl(this, wxID_ANY, wxEmptyString, wxDefaultPosition, wxSize(-1, 80), wxTE_MULTILINE);
+  m_mirrorsCtrl->SetHint("Optional, other URLs of the same file, one per line");
+  mirrorsSizer->Add(m_mirrorsCtrl, 1, wxEXPAND);
+  mainSizer->Add(mirrorsSizer, 1, wxEXPAND | wxLEFT | wxRIGHT | wxBOTTOM, 10);
+  
   // Add buttons
   wxBoxSizer* buttonSizer = new wxBoxSizer(wxHORIZONTAL);
   buttonSizer->Add(new wxButton(this, wxID_OK, "OK"), 0, wxRIGHT, 5);
@@ -50,7 +77,6 @@ void DownloadDialog::CreateUI()
   
   // Connect events
   browseButton->Bind(wxEVT_BUTTON, &DownloadDialog::OnBrowse, this);
-  m_urlCtrl->Bind(wxEVT_TEXT_ENTER, &DownloadDialog::OnOK, this);
   Bind(wxEVT_BUTTON, &DownloadDialog::OnOK, this, wxID_OK);
   
   // Set focus to URL control
@@ -69,8 +95,9 @@ void DownloadDialog::OnBrowse(wxCommandEvent& event)
 
 void DownloadDialog::OnOK(wxCommandEvent& event)
 {
-  // Validate URL
-  if (m_urlCtrl->GetValue().IsEmpty()) {
+  // Validate URLs
+  std::vector<wxString> urls = GetURLs();
+  if (urls.empty()) {
       wxMessageBox("URL cannot be empty.", "Error", wxOK | wxICON_ERROR);
       m_urlCtrl->SetFocus();
       return;
@@ -83,14 +110,39 @@ void DownloadDialog::OnOK(wxCommandEvent& event)
       return;
   }
   
+  // Validate checksum
+  ChecksumType type;
+  wxString digest;
+  if (!GetChecksum().IsEmpty() && !StreamHasher::ParseChecksum(GetChecksum(), type, digest)) {
+      wxMessageBox("Checksum must be a SHA-256, MD5 or CRC32C digest in hex.", "Error", wxOK | wxICON_ERROR);
+      m_checksumCtrl->SetFocus();
+      return;
+  }
+  
+  // A checksum and mirrors describe one file
+  if (urls.size() > 1 && (!GetChecksum().IsEmpty() || !GetMirrors().empty())) {
+      wxMessageBox("A checksum or mirrors can only be given for a single URL.", "Error", wxOK | wxICON_ERROR);
+      m_urlCtrl->SetFocus();
+      return;
+  }
+  
+  // Validate mirrors
+  for (const auto& mirror : GetMirrors()) {
+      if (!mirror.StartsWith("http://") && !mirror.StartsWith("https://") && !mirror.StartsWith("ftp://")) {
+          wxMessageBox("Mirror is not an HTTP or FTP URL: " + mirror, "Error", wxOK | wxICON_ERROR);
+          m_mirrorsCtrl->SetFocus();
+          return;
+      }
+  }
+  
   // Close dialog
   EndModal(wxID_OK);
 }
 
-// Get URL
-wxString DownloadDialog::GetURL() const
+// Get URLs
+std::vector<wxString> DownloadDialog::GetURLs() const
 {
-  return m_urlCtrl->GetValue();
+  return SplitLines(m_urlCtrl->GetValue());
 }
 
 // Get save path
@@ -99,3 +151,41 @@ wxString DownloadDialog::GetSavePath() const
   return m_savePathCtrl->GetValue();
 }
 
+// Get connection count
+int DownloadDialog::GetConnections() const
+{
+  return m_connectionsCtrl->GetValue();
+}
+
+// Get expected checksum
+wxString DownloadDialog::GetChecksum() const
+{
+  return m_checksumCtrl->GetValue().Trim().Trim(false);
+}
+
+// Get mirror URLs
+std::vector<wxString> DownloadDialog::GetMirrors() const
+{
+  std::vector<wxString> urls = GetURLs();
+  std::vector<wxString> mirrors;
+  for (const auto& line : SplitLines(m_mirrorsCtrl->GetValue())) {
+      if (urls.empty() || line != urls.front()) {
+          mirrors.push_back(line);
+      }
+  }
+  return mirrors;
+}
+
+// Non-empty trimmed lines of a text
+std::vector<wxString> DownloadDialog::SplitLines(const wxString& text)
+{
+  std::vector<wxString> lines;
+  wxArrayString parts = wxSplit(text, '\n');
+  for (auto& part : parts) {
+      part.Trim().Trim(false);
+      if (!part.IsEmpty()) {
+          lines.push_back(part);
+      }
+  }
+  return lines;
+}
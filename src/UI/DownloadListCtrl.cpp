@@ -0,0 +1,315 @@
+#include "UI/DownloadListCtrl.h"
+#include "Managers/DownloadManager.h"
+#include <algorithm>
+
+// Format a size for the Size column
+static wxString FormatSize(long long size)
+{
+  if (size <= 0) {
+    return "Unknown";
+  }
+  if (size < 1024) {
+    return wxString::Format("%lld B", size);
+  } else if (size < 1024 * 1024) {
+    return wxString::Format("%.2f KB", size / 1024.0);
+  } else if (size < 1024 * 1024 * 1024) {
+    return wxString::Format("%.2f MB", size / (1024.0 * 1024.0));
+  }
+  return wxString::Format("%.2f GB", size / (1024.0 * 1024.0 * 1024.0));
+}
+
+// Format a speed for the Speed column
+static wxString FormatSpeed(long long speed)
+{
+  if (speed <= 0) {
+    return "-";
+  }
+  if (speed < 1024) {
+    return wxString::Format("%lld B/s", speed);
+  } else if (speed < 1024 * 1024) {
+    return wxString::Format("%.2f KB/s", speed / 1024.0);
+  }
+  return wxString::Format("%.2f MB/s", speed / (1024.0 * 1024.0));
+}
+
+// Format the time left for the ETA column
+static wxString FormatEta(long long seconds)
+{
+  if (seconds < 0) {
+    return "-";
+  }
+  if (seconds < 60) {
+    return wxString::Format("%llds", seconds);
+  } else if (seconds < 60 * 60) {
+    return wxString::Format("%lldm %02llds", seconds / 60, seconds % 60);
+  }
+  return wxString::Format("%lldh %02lldm", seconds / 3600, (seconds / 60) % 60);
+}
+
+// Text of a status
+static wxString FormatStatus(DownloadStatus status)
+{
+  switch (status) {
+    case DownloadStatus::PENDING:
+      return "Pending";
+    case DownloadStatus::DOWNLOADING:
+      return "Downloading";
+    case DownloadStatus::PAUSED:
+      return "Paused";
+    case DownloadStatus::COMPLETED:
+      return "Completed";
+    case DownloadStatus::ERROR:
+      return "Error";
+    case DownloadStatus::QUEUED:
+      return "Queued";
+    default:
+      return "Unknown";
+  }
+}
+
+// Text of a priority
+static wxString FormatPriority(DownloadPriority priority)
+{
+  switch (priority) {
+    case DownloadPriority::HIGH:
+      return "High";
+    case DownloadPriority::LOW:
+      return "Low";
+    default:
+      return "Normal";
+  }
+}
+
+// Constructor
+DownloadListCtrl::DownloadListCtrl(wxWindow* parent, wxWindowID id, DownloadManager* downloadManager)
+  : wxListCtrl(parent, id, wxDefaultPosition, wxDefaultSize, wxLC_REPORT | wxLC_VIRTUAL | wxLC_SINGLE_SEL),
+    m_downloadManager(downloadManager)
+{
+  // Add columns
+  InsertColumn(0, "ID", wxLIST_FORMAT_LEFT, 50);
+  InsertColumn(1, "Name", wxLIST_FORMAT_LEFT, 200);
+  InsertColumn(2, "Status", wxLIST_FORMAT_LEFT, 100);
+  InsertColumn(3, "Progress", wxLIST_FORMAT_LEFT, 100);
+  InsertColumn(4, "Size", wxLIST_FORMAT_LEFT, 100);
+  InsertColumn(5, "Speed", wxLIST_FORMAT_LEFT, 100);
+  InsertColumn(6, "ETA", wxLIST_FORMAT_LEFT, 80);
+  InsertColumn(7, "URL", wxLIST_FORMAT_LEFT, 300);
+  InsertColumn(8, "Date Added", wxLIST_FORMAT_LEFT, 150);
+  InsertColumn(9, "Priority", wxLIST_FORMAT_LEFT, 80);
+  
+  // Columns sort the list in the order of DownloadSortKey
+  Bind(wxEVT_LIST_COL_CLICK, &DownloadListCtrl::OnColumnClick, this);
+}
+
+// Show the downloads, repainting only the rows that changed
+void DownloadListCtrl::SetDownloads(const std::vector<DownloadItem>& downloads)
+{
+  std::vector<DownloadRow> rows;
+  rows.reserve(downloads.size());
+  m_activeIds.clear();
+  for (const auto& item : downloads) {
+    if (item.status == DownloadStatus::DOWNLOADING) {
+      m_activeIds.push_back(item.id);
+    }
+    rows.push_back(MakeRow(item));
+  }
+  
+  // Selection is kept by download id, since rows can move
+  std::vector<int> selectedIds = GetSelectedIds();
+  int focusedId = GetDownloadId(GetNextItem(-1, wxLIST_NEXT_ALL, wxLIST_STATE_FOCUSED));
+  
+  std::vector<long> changedRows;
+  DownloadListModel::Change change = m_model.Assign(rows, changedRows);
+  ApplyChange(change, changedRows, selectedIds, focusedId);
+}
+
+// Update the running downloads from their published progress
+void DownloadListCtrl::RefreshProgress()
+{
+  std::vector<int> selectedIds;
+  int focusedId = -1;
+  bool moved = false;
+  std::vector<long> changedRows;
+  
+  for (int id : m_activeIds) {
+    const DownloadRow* row = m_model.FindRow(id);
+    ProgressSnapshot snapshot;
+    if (!row || !m_downloadManager->GetProgress(id, snapshot)) {
+      continue;
+    }
+    
+    // A transfer that has not reported yet keeps the values of the last update
+    if (snapshot.downloaded <= 0 && snapshot.totalSize <= 0) {
+      continue;
+    }
+    
+    DownloadRow updated = *row;
+    if (snapshot.totalSize > 0) {
+      updated.progress = static_cast<int>((snapshot.downloaded * 100) / snapshot.totalSize);
+      updated.size = snapshot.totalSize;
+    }
+    updated.speed = snapshot.speed;
+    updated.eta = snapshot.eta;
+    
+    // Sorting by speed or time left moves rows; remember the selection before the first move
+    if (!moved) {
+      selectedIds = GetSelectedIds();
+      focusedId = GetDownloadId(GetNextItem(-1, wxLIST_NEXT_ALL, wxLIST_STATE_FOCUSED));
+    }
+    DownloadListModel::Change change = m_model.Update(updated);
+    if (change == DownloadListModel::Change::LAYOUT) {
+      moved = true;
+    } else if (change == DownloadListModel::Change::ROWS) {
+      changedRows.push_back(m_model.FindPosition(id));
+    }
+  }
+  
+  ApplyChange(moved ? DownloadListModel::Change::LAYOUT : DownloadListModel::Change::ROWS, changedRows, selectedIds, focusedId);
+}
+
+// Show only some of the downloads
+void DownloadListCtrl::SetFilter(const DownloadFilter& filter)
+{
+  std::vector<int> selectedIds = GetSelectedIds();
+  int focusedId = GetDownloadId(GetNextItem(-1, wxLIST_NEXT_ALL, wxLIST_STATE_FOCUSED));
+  
+  m_model.SetFilter(filter);
+  ApplyChange(DownloadListModel::Change::LAYOUT, std::vector<long>(), selectedIds, focusedId);
+}
+
+// Download id of a row
+int DownloadListCtrl::GetDownloadId(long row) const
+{
+  const DownloadRow* downloadRow = m_model.GetRow(row);
+  return downloadRow ? downloadRow->id : -1;
+}
+
+// Ids of the selected rows
+std::vector<int> DownloadListCtrl::GetSelectedIds() const
+{
+  std::vector<int> ids;
+  long item = -1;
+  while ((item = GetNextItem(item, wxLIST_NEXT_ALL, wxLIST_STATE_SELECTED)) != -1) {
+    int id = GetDownloadId(item);
+    if (id != -1) {
+      ids.push_back(id);
+    }
+  }
+  return ids;
+}
+
+// Text of a cell
+wxString DownloadListCtrl::OnGetItemText(long item, long column) const
+{
+  const DownloadRow* row = m_model.GetRow(item);
+  if (!row) {
+    return wxEmptyString;
+  }
+  
+  switch (column) {
+    case 0:
+      return wxString::Format("%d", row->id);
+    case 1:
+      return row->name;
+    case 2:
+      return FormatStatus(row->status);
+    case 3:
+      return wxString::Format("%d%%", row->progress);
+    case 4:
+      return FormatSize(row->size);
+    case 5:
+      return FormatSpeed(row->speed);
+    case 6:
+      return FormatEta(row->eta);
+    case 7:
+      return row->url;
+    case 8:
+      return row->dateAdded;
+    case 9:
+      return FormatPriority(row->priority);
+    default:
+      return wxEmptyString;
+  }
+}
+
+// Build a row, taking speed and time left from the running transfer
+DownloadRow DownloadListCtrl::MakeRow(const DownloadItem& item) const
+{
+  DownloadRow row;
+  row.id = item.id;
+  row.name = item.name;
+  row.status = item.status;
+  row.progress = item.progress;
+  row.size = static_cast<long long>(item.size);
+  row.speed = 0;
+  row.eta = -1;
+  row.url = item.url;
+  row.host = DownloadManager::GetHostName(item.url);
+  row.dateAdded = item.dateAdded;
+  row.priority = item.priority;
+  
+  ProgressSnapshot snapshot;
+  if (item.status == DownloadStatus::DOWNLOADING && m_downloadManager->GetProgress(item.id, snapshot)) {
+    row.speed = snapshot.speed;
+    row.eta = snapshot.eta;
+  }
+  return row;
+}
+
+// Repaint after the model changed
+void DownloadListCtrl::ApplyChange(DownloadListModel::Change change, const std::vector<long>& changedRows,
+                                   const std::vector<int>& selectedIds, int focusedId)
+{
+  if (change == DownloadListModel::Change::LAYOUT) {
+    if (GetItemCount() != m_model.GetCount()) {
+      SetItemCount(m_model.GetCount());
+    }
+    RestoreSelection(selectedIds, focusedId);
+    Refresh();
+    return;
+  }
+  
+  for (long row : changedRows) {
+    if (row != -1) {
+      RefreshItem(row);
+    }
+  }
+}
+
+// Select the rows of the given downloads again after rows moved
+void DownloadListCtrl::RestoreSelection(const std::vector<int>& selectedIds, int focusedId)
+{
+  long item = -1;
+  while ((item = GetNextItem(item, wxLIST_NEXT_ALL, wxLIST_STATE_SELECTED)) != -1) {
+    SetItemState(item, 0, wxLIST_STATE_SELECTED);
+  }
+  
+  for (int id : selectedIds) {
+    long position = m_model.FindPosition(id);
+    if (position != -1) {
+      SetItemState(position, wxLIST_STATE_SELECTED, wxLIST_STATE_SELECTED);
+    }
+  }
+  long focused = m_model.FindPosition(focusedId);
+  if (focused != -1) {
+    SetItemState(focused, wxLIST_STATE_FOCUSED, wxLIST_STATE_FOCUSED);
+  }
+}
+
+// Sort by the clicked column, or reverse the order when it already is the sort column
+void DownloadListCtrl::OnColumnClick(wxListEvent& event)
+{
+  int column = event.GetColumn();
+  if (column < 0 || column > static_cast<int>(DownloadSortKey::PRIORITY)) {
+    return;
+  }
+  
+  DownloadSortKey key = static_cast<DownloadSortKey>(column);
+  bool ascending = key != m_model.GetSortKey() || !m_model.IsAscending();
+  
+  std::vector<int> selectedIds = GetSelectedIds();
+  int focusedId = GetDownloadId(GetNextItem(-1, wxLIST_NEXT_ALL, wxLIST_STATE_FOCUSED));
+  
+  m_model.SetSort(key, ascending);
+  ApplyChange(DownloadListModel::Change::LAYOUT, std::vector<long>(), selectedIds, focusedId);
+}
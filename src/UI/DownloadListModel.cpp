@@ -0,0 +1,347 @@
+#include "UI/DownloadListModel.h"
+#include <algorithm>
+#include <climits>
+
+// New rows beyond this count are sorted in one pass instead of inserted one at a time
+static const size_t BULK_INSERT_ROWS = 256;
+
+// Three-way comparison of two values
+template <typename T>
+static int Compare(const T& a, const T& b)
+{
+  return a < b ? -1 : (b < a ? 1 : 0);
+}
+
+// Compare everything a row shows
+bool DownloadRow::operator==(const DownloadRow& other) const
+{
+  return id == other.id && status == other.status && progress == other.progress && size == other.size &&
+         speed == other.speed && eta == other.eta && priority == other.priority && name == other.name &&
+         url == other.url && host == other.host && dateAdded == other.dateAdded;
+}
+
+// Constructor
+DownloadListModel::DownloadListModel()
+  : m_sortKey(DownloadSortKey::ID), m_ascending(true)
+{
+}
+
+// Make the rows match the given ones
+DownloadListModel::Change DownloadListModel::Assign(const std::vector<DownloadRow>& rows, std::vector<long>& changedRows)
+{
+  Change change = Change::NONE;
+  
+  std::vector<int> ids;
+  ids.reserve(rows.size());
+  for (const auto& row : rows) {
+    ids.push_back(row.id);
+  }
+  std::sort(ids.begin(), ids.end());
+  
+  // Rows of deleted downloads leave both orders in one pass
+  std::vector<int> removed;
+  for (const auto& entry : m_rows) {
+    if (!std::binary_search(ids.begin(), ids.end(), entry.first)) {
+      removed.push_back(entry.first);
+    }
+  }
+  if (!removed.empty()) {
+    auto isRemoved = [&removed](const DownloadRow* row) {
+      return std::binary_search(removed.begin(), removed.end(), row->id);
+    };
+    size_t visible = m_view.size();
+    m_sorted.erase(std::remove_if(m_sorted.begin(), m_sorted.end(), isRemoved), m_sorted.end());
+    m_view.erase(std::remove_if(m_view.begin(), m_view.end(), isRemoved), m_view.end());
+    if (m_view.size() != visible) {
+      change = Change::LAYOUT;
+    }
+    for (int id : removed) {
+      auto it = m_rows.find(id);
+      RemoveHost(it->second.host);
+      m_rows.erase(it);
+    }
+  }
+  
+  // Many new rows, as when the history is loaded, are cheaper to sort once
+  size_t added = 0;
+  for (const auto& row : rows) {
+    if (m_rows.find(row.id) == m_rows.end()) {
+      added++;
+    }
+  }
+  if (added > BULK_INSERT_ROWS) {
+    for (const auto& row : rows) {
+      auto it = m_rows.find(row.id);
+      if (it == m_rows.end()) {
+        m_rows.emplace(row.id, row);
+        AddHost(row.host);
+      } else if (!(it->second == row)) {
+        RemoveHost(it->second.host);
+        AddHost(row.host);
+        it->second = row;
+      }
+    }
+    Sort();
+    return Change::LAYOUT;
+  }
+  
+  for (const auto& row : rows) {
+    Change rowChange = Update(row);
+    if (rowChange == Change::LAYOUT) {
+      change = Change::LAYOUT;
+    } else if (rowChange == Change::ROWS && change != Change::LAYOUT) {
+      change = Change::ROWS;
+      changedRows.push_back(FindPosition(row.id));
+    }
+  }
+  
+  return change;
+}
+
+// Insert or update one row
+DownloadListModel::Change DownloadListModel::Update(const DownloadRow& row)
+{
+  auto it = m_rows.find(row.id);
+  if (it == m_rows.end()) {
+    const DownloadRow* stored = &m_rows.emplace(row.id, row).first->second;
+    AddHost(row.host);
+    Insert(m_sorted, stored);
+    if (!Matches(*stored)) {
+      return Change::NONE;
+    }
+    Insert(m_view, stored);
+    return Change::LAYOUT;
+  }
+  
+  DownloadRow& stored = it->second;
+  if (stored == row) {
+    return Change::NONE;
+  }
+  
+  // A row whose sort key changed is taken out while the orders can still find it
+  bool moved = CompareKeys(stored, row) != 0;
+  bool wasVisible = Matches(stored);
+  long position = -1;
+  if (moved) {
+    Erase(m_sorted, &stored);
+    if (wasVisible) {
+      position = Erase(m_view, &stored);
+    }
+  }
+  
+  if (stored.host != row.host) {
+    RemoveHost(stored.host);
+    AddHost(row.host);
+  }
+  stored = row;
+  bool visible = Matches(stored);
+  
+  if (moved) {
+    Insert(m_sorted, &stored);
+    if (!visible) {
+      return wasVisible ? Change::LAYOUT : Change::NONE;
+    }
+    Insert(m_view, &stored);
+    return wasVisible && Find(m_view, &stored) == position ? Change::ROWS : Change::LAYOUT;
+  }
+  
+  // Same place in the order; only the filter can add or drop it
+  if (wasVisible != visible) {
+    if (visible) {
+      Insert(m_view, &stored);
+    } else {
+      Erase(m_view, &stored);
+    }
+    return Change::LAYOUT;
+  }
+  
+  return visible ? Change::ROWS : Change::NONE;
+}
+
+// Order of the view
+void DownloadListModel::SetSort(DownloadSortKey key, bool ascending)
+{
+  if (key == m_sortKey && ascending == m_ascending) {
+    return;
+  }
+  
+  m_sortKey = key;
+  m_ascending = ascending;
+  Sort();
+}
+
+// Filter of the view
+void DownloadListModel::SetFilter(const DownloadFilter& filter)
+{
+  m_filter = filter;
+  Filter();
+}
+
+// Row at a position of the view
+const DownloadRow* DownloadListModel::GetRow(long position) const
+{
+  if (position < 0 || position >= static_cast<long>(m_view.size())) {
+    return nullptr;
+  }
+  return m_view[position];
+}
+
+// Position of a download in the view
+long DownloadListModel::FindPosition(int id) const
+{
+  const DownloadRow* row = FindRow(id);
+  if (!row || !Matches(*row)) {
+    return -1;
+  }
+  return Find(m_view, row);
+}
+
+// Row of a download
+const DownloadRow* DownloadListModel::FindRow(int id) const
+{
+  auto it = m_rows.find(id);
+  return it == m_rows.end() ? nullptr : &it->second;
+}
+
+// Hosts of all rows
+std::vector<wxString> DownloadListModel::GetHosts() const
+{
+  std::vector<wxString> hosts;
+  hosts.reserve(m_hosts.size());
+  for (const auto& entry : m_hosts) {
+    hosts.push_back(entry.first);
+  }
+  return hosts;
+}
+
+// Compare two rows by the sort key alone
+int DownloadListModel::CompareKeys(const DownloadRow& a, const DownloadRow& b) const
+{
+  switch (m_sortKey) {
+    case DownloadSortKey::NAME:
+      return Compare(a.name.CmpNoCase(b.name), 0);
+    case DownloadSortKey::STATUS:
+      return Compare(static_cast<int>(a.status), static_cast<int>(b.status));
+    case DownloadSortKey::PROGRESS:
+      return Compare(a.progress, b.progress);
+    case DownloadSortKey::SIZE:
+      return Compare(a.size, b.size);
+    case DownloadSortKey::SPEED:
+      return Compare(a.speed, b.speed);
+    case DownloadSortKey::ETA:
+      // Unknown times left go last
+      return Compare(a.eta < 0 ? LLONG_MAX : a.eta, b.eta < 0 ? LLONG_MAX : b.eta);
+    case DownloadSortKey::HOST: {
+      int result = Compare(a.host.Cmp(b.host), 0);
+      return result != 0 ? result : Compare(a.url.Cmp(b.url), 0);
+    }
+    case DownloadSortKey::DATE_ADDED:
+      return Compare(a.dateAdded.Cmp(b.dateAdded), 0);
+    case DownloadSortKey::PRIORITY:
+      return Compare(static_cast<int>(a.priority), static_cast<int>(b.priority));
+    default:
+      return Compare(a.id, b.id);
+  }
+}
+
+// Strict order of the view; equal keys keep the order the downloads were added in
+bool DownloadListModel::Less(const DownloadRow* a, const DownloadRow* b) const
+{
+  int result = CompareKeys(*a, *b);
+  if (result != 0) {
+    return m_ascending ? result < 0 : result > 0;
+  }
+  return a->id < b->id;
+}
+
+// Whether a row passes the filter
+bool DownloadListModel::Matches(const DownloadRow& row) const
+{
+  if (!m_filter.host.IsEmpty() && row.host != m_filter.host) {
+    return false;
+  }
+  if (m_filter.searching && !std::binary_search(m_filter.ids.begin(), m_filter.ids.end(), row.id)) {
+    return false;
+  }
+  
+  switch (m_filter.status) {
+    case DownloadFilter::Status::ACTIVE:
+      return row.status == DownloadStatus::DOWNLOADING || row.status == DownloadStatus::QUEUED;
+    case DownloadFilter::Status::PAUSED:
+      return row.status == DownloadStatus::PAUSED;
+    case DownloadFilter::Status::COMPLETED:
+      return row.status == DownloadStatus::COMPLETED;
+    case DownloadFilter::Status::FAILED:
+      return row.status == DownloadStatus::ERROR;
+    default:
+      return true;
+  }
+}
+
+// Put a row at its place in an order
+void DownloadListModel::Insert(Order& order, const DownloadRow* row)
+{
+  auto less = [this](const DownloadRow* a, const DownloadRow* b) { return Less(a, b); };
+  order.insert(std::lower_bound(order.begin(), order.end(), row, less), row);
+}
+
+// Take a row out of an order, found by its current values; returns where it was
+long DownloadListModel::Erase(Order& order, const DownloadRow* row)
+{
+  long position = Find(order, row);
+  if (position != -1) {
+    order.erase(order.begin() + position);
+  }
+  return position;
+}
+
+// Position of a row in an order, found by its current values
+long DownloadListModel::Find(const Order& order, const DownloadRow* row) const
+{
+  auto less = [this](const DownloadRow* a, const DownloadRow* b) { return Less(a, b); };
+  auto it = std::lower_bound(order.begin(), order.end(), row, less);
+  if (it == order.end() || *it != row) {
+    return -1;
+  }
+  return static_cast<long>(it - order.begin());
+}
+
+// Count a row of a host
+void DownloadListModel::AddHost(const wxString& host)
+{
+  m_hosts[host]++;
+}
+
+// Forget a row of a host
+void DownloadListModel::RemoveHost(const wxString& host)
+{
+  auto it = m_hosts.find(host);
+  if (it != m_hosts.end() && --it->second <= 0) {
+    m_hosts.erase(it);
+  }
+}
+
+// Sort every row again and filter the result
+void DownloadListModel::Sort()
+{
+  m_sorted.clear();
+  m_sorted.reserve(m_rows.size());
+  for (const auto& entry : m_rows) {
+    m_sorted.push_back(&entry.second);
+  }
+  
+  auto less = [this](const DownloadRow* a, const DownloadRow* b) { return Less(a, b); };
+  std::sort(m_sorted.begin(), m_sorted.end(), less);
+  Filter();
+}
+
+// Take the rows passing the filter from the sorted order
+void DownloadListModel::Filter()
+{
+  m_view.clear();
+  for (const DownloadRow* row : m_sorted) {
+    if (Matches(*row)) {
+      m_view.push_back(row);
+    }
+  }
+}
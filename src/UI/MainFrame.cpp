@@ -1,4 +1,5 @@
 #include "UI/MainFrame.h"
+#include "UI/DownloadListCtrl.h"
 #include "UI/DownloadDialog.h"
 #include "UI/YouTubeDialog.h"
 #include "UI/SettingsDialog.h"
@@ -17,11 +18,17 @@
 #include <wx/log.h>
 #include <wx/artprov.h>
 #include <wx/textfile.h>
+#include <wx/choice.h>
+#include <wx/stattext.h>
+#include <wx/srchctrl.h>
 #include <mutex>
 
 // Global mutex for UI updates
 std::mutex g_uiMutex;
 
+// Progress columns are refreshed at this rate however often the transfers report
+static const int FRAME_INTERVAL_MS = 250;
+
 // Constructor
 MainFrame::MainFrame(const wxString& title, const wxPoint& pos, const wxSize& size)
 : wxFrame(NULL, wxID_ANY, title, pos, size)
@@ -46,7 +53,7 @@ MainFrame::MainFrame(const wxString& title, const wxPoint& pos, const wxSize& si
 
     // Set up timer for UI updates
     m_timer = new wxTimer(this, ID_Timer);
-    m_timer->Start(1000); // 1 second interval
+    m_timer->Start(FRAME_INTERVAL_MS);
 
     // Connect event handlers
     Bind(wxEVT_COMMAND_MENU_SELECTED, &MainFrame::OnAddDownload, this, ID_AddDownload);
@@ -61,6 +68,7 @@ MainFrame::MainFrame(const wxString& title, const wxPoint& pos, const wxSize& si
     Bind(wxEVT_COMMAND_MENU_SELECTED, &MainFrame::OnCopyURL, this, ID_CopyURL);
     Bind(wxEVT_COMMAND_MENU_SELECTED, &MainFrame::OnSettings, this, ID_Settings);
     Bind(wxEVT_COMMAND_MENU_SELECTED, &MainFrame::OnSpeedLimit, this, ID_SpeedLimit);
+    Bind(wxEVT_COMMAND_MENU_SELECTED, &MainFrame::OnSetPriority, this, ID_PriorityHigh, ID_PriorityLow);
     Bind(wxEVT_COMMAND_MENU_SELECTED, &MainFrame::OnExit, this, wxID_EXIT);
     Bind(wxEVT_COMMAND_MENU_SELECTED, &MainFrame::OnAbout, this, wxID_ABOUT);
     Bind(wxEVT_COMMAND_MENU_SELECTED, &MainFrame::OnUpdateUI, this, ID_UpdateUI);
@@ -121,6 +129,12 @@ void MainFrame::CreateUI()
     downloadMenu->AppendSeparator();
     downloadMenu->Append(ID_DeleteDownload, "&Delete\tDel", "Delete selected download(s)");
     downloadMenu->AppendSeparator();
+    wxMenu* priorityMenu = new wxMenu;
+    priorityMenu->Append(ID_PriorityHigh, "&High", "Give selected download(s) a larger share of the speed limit");
+    priorityMenu->Append(ID_PriorityNormal, "&Normal", "Give selected download(s) the normal share of the speed limit");
+    priorityMenu->Append(ID_PriorityLow, "&Low", "Give selected download(s) a smaller share of the speed limit");
+    downloadMenu->AppendSubMenu(priorityMenu, "P&riority", "Set priority of selected download(s)");
+    downloadMenu->AppendSeparator();
     downloadMenu->Append(ID_OpenFile, "Open &File\tCtrl+O", "Open downloaded file");
     downloadMenu->Append(ID_OpenFolder, "Open F&older\tCtrl+F", "Open containing folder");
     downloadMenu->Append(ID_CopyURL, "&Copy URL\tCtrl+C", "Copy download URL to clipboard");
@@ -149,21 +163,34 @@ void MainFrame::CreateUI()
     toolBar->AddTool(ID_Settings, "Settings", wxArtProvider::GetBitmap(wxART_EXECUTABLE_FILE), "Configure settings");
     toolBar->Realize();
     
+    // Create filter bar
+    wxBoxSizer* filterSizer = new wxBoxSizer(wxHORIZONTAL);
+    filterSizer->Add(new wxStaticText(this, wxID_ANY, "Show:"), 0, wxALIGN_CENTER_VERTICAL | wxRIGHT, 5);
+    m_statusFilter = new wxChoice(this, ID_StatusFilter);
+    m_statusFilter->Append("All");
+    m_statusFilter->Append("Active");
+    m_statusFilter->Append("Paused");
+    m_statusFilter->Append("Completed");
+    m_statusFilter->Append("Failed");
+    m_statusFilter->SetSelection(0);
+    filterSizer->Add(m_statusFilter, 0, wxRIGHT, 10);
+    filterSizer->Add(new wxStaticText(this, wxID_ANY, "Host:"), 0, wxALIGN_CENTER_VERTICAL | wxRIGHT, 5);
+    m_hostFilter = new wxChoice(this, ID_HostFilter);
+    m_hostFilter->Append("All hosts");
+    m_hostFilter->SetSelection(0);
+    filterSizer->Add(m_hostFilter, 0, wxRIGHT, 10);
+    m_searchBox = new wxSearchCtrl(this, ID_SearchBox, wxEmptyString, wxDefaultPosition, wxSize(250, -1));
+    m_searchBox->ShowCancelButton(true);
+    m_searchBox->SetDescriptiveText("Search name or URL");
+    filterSizer->AddStretchSpacer();
+    filterSizer->Add(m_searchBox, 0);
+    
     // Create download list
-    m_downloadList = new wxListCtrl(this, ID_DownloadList, wxDefaultPosition, wxDefaultSize, wxLC_REPORT | wxLC_SINGLE_SEL);
-    
-    // Add columns
-    m_downloadList->InsertColumn(0, "ID", wxLIST_FORMAT_LEFT, 50);
-    m_downloadList->InsertColumn(1, "Name", wxLIST_FORMAT_LEFT, 200);
-    m_downloadList->InsertColumn(2, "Status", wxLIST_FORMAT_LEFT, 100);
-    m_downloadList->InsertColumn(3, "Progress", wxLIST_FORMAT_LEFT, 100);
-    m_downloadList->InsertColumn(4, "Size", wxLIST_FORMAT_LEFT, 100);
-    m_downloadList->InsertColumn(5, "Speed", wxLIST_FORMAT_LEFT, 100);
-    m_downloadList->InsertColumn(6, "URL", wxLIST_FORMAT_LEFT, 300);
-    m_downloadList->InsertColumn(7, "Date Added", wxLIST_FORMAT_LEFT, 150);
+    m_downloadList = new DownloadListCtrl(this, ID_DownloadList, m_downloadManager);
     
     // Create sizer
     wxBoxSizer* sizer = new wxBoxSizer(wxVERTICAL);
+    sizer->Add(filterSizer, 0, wxEXPAND | wxLEFT | wxRIGHT | wxTOP, 5);
     sizer->Add(m_downloadList, 1, wxEXPAND | wxALL, 5);
     
     // Set sizer
@@ -173,6 +200,14 @@ void MainFrame::CreateUI()
     m_downloadList->Bind(wxEVT_LIST_ITEM_ACTIVATED, &MainFrame::OnDownloadListItemActivated, this);
     m_downloadList->Bind(wxEVT_LIST_ITEM_RIGHT_CLICK, &MainFrame::OnDownloadListItemRightClick, this);
     
+    // Connect filter event handlers
+    Bind(wxEVT_CHOICE, &MainFrame::OnFilterChanged, this, ID_StatusFilter);
+    Bind(wxEVT_CHOICE, &MainFrame::OnFilterChanged, this, ID_HostFilter);
+    
+    // Search results follow every keystroke
+    Bind(wxEVT_TEXT, &MainFrame::OnFilterChanged, this, ID_SearchBox);
+    Bind(wxEVT_SEARCHCTRL_CANCEL_BTN, &MainFrame::OnSearchCancel, this, ID_SearchBox);
+    
     // Update UI
     UpdateUI();
 }
@@ -182,104 +217,16 @@ void MainFrame::UpdateUI()
 {
     std::lock_guard<std::mutex> lock(g_uiMutex);
     
-    // Save selected items before clearing the list
-    std::vector<int> selectedIds = GetSelectedDownloadIds();
-    
-    // Remember the focused item if any
-    long focusedItem = m_downloadList->GetNextItem(-1, wxLIST_NEXT_ALL, wxLIST_STATE_FOCUSED);
-    int focusedId = -1;
-    if (focusedItem != -1) {
-        focusedId = wxAtoi(m_downloadList->GetItemText(focusedItem));
-    }
-    
-    // Clear download list
-    m_downloadList->DeleteAllItems();
-    
     // Get downloads
-    const std::vector<DownloadItem>& downloads = m_downloadManager->GetDownloads();
+    std::vector<DownloadItem> downloads = m_downloadManager->GetDownloads();
     
-    // Add downloads to list
-    for (size_t i = 0; i < downloads.size(); i++) {
-        const DownloadItem& item = downloads[i];
-        
-        // Add item
-        long index = m_downloadList->InsertItem(i, wxString::Format("%d", item.id));
-        m_downloadList->SetItem(index, 1, item.name);
-        
-        // Set status
-        wxString status;
-        switch (item.status) {
-            case DownloadStatus::PENDING:
-                status = "Pending";
-                break;
-            case DownloadStatus::DOWNLOADING:
-                status = "Downloading";
-                break;
-            case DownloadStatus::PAUSED:
-                status = "Paused";
-                break;
-            case DownloadStatus::COMPLETED:
-                status = "Completed";
-                break;
-            case DownloadStatus::ERROR:
-                status = "Error";
-                break;
-            default:
-                status = "Unknown";
-                break;
-        }
-        m_downloadList->SetItem(index, 2, status);
-        
-        // Set progress
-        m_downloadList->SetItem(index, 3, wxString::Format("%d%%", item.progress));
-        
-        // Set size
-        wxString size;
-        if (item.size > 0) {
-            if (item.size < 1024) {
-                size = wxString::Format("%lld B", item.size);
-            } else if (item.size < 1024 * 1024) {
-                size = wxString::Format("%.2f KB", item.size / 1024.0);
-            } else if (item.size < 1024 * 1024 * 1024) {
-                size = wxString::Format("%.2f MB", item.size / (1024.0 * 1024.0));
-            } else {
-                size = wxString::Format("%.2f GB", item.size / (1024.0 * 1024.0 * 1024.0));
-            }
-        } else {
-            size = "Unknown";
-        }
-        m_downloadList->SetItem(index, 4, size);
-        
-        // Set speed
-        wxString speed;
-        if (item.status == DownloadStatus::DOWNLOADING && item.speed > 0) {
-            if (item.speed < 1024) {
-                speed = wxString::Format("%lld B/s", item.speed);
-            } else if (item.speed < 1024 * 1024) {
-                speed = wxString::Format("%.2f KB/s", item.speed / 1024.0);
-            } else {
-                speed = wxString::Format("%.2f MB/s", item.speed / (1024.0 * 1024.0));
-            }
-        } else {
-            speed = "-";
-        }
-        m_downloadList->SetItem(index, 5, speed);
-        
-        // Set URL
-        m_downloadList->SetItem(index, 6, item.url);
-        
-        // Set date added
-        m_downloadList->SetItem(index, 7, item.dateAdded);
-        
-        // Restore selection if this item was previously selected
-        if (std::find(selectedIds.begin(), selectedIds.end(), item.id) != selectedIds.end()) {
-            m_downloadList->SetItemState(index, wxLIST_STATE_SELECTED, wxLIST_STATE_SELECTED);
-        }
-        
-        // Restore focus if this was the focused item
-        if (item.id == focusedId) {
-            m_downloadList->SetItemState(index, wxLIST_STATE_FOCUSED, wxLIST_STATE_FOCUSED);
-        }
+    // Only the rows that changed are repainted; selection and scroll position stay as they are
+    m_downloadList->SetDownloads(downloads);
+    UpdateHostFilter();
+    
+    // Downloads added since the search was typed are matched by searching again
+    if (!m_searchBox->GetValue().IsEmpty()) {
+        ApplyFilter();
     }
     
     // Update status bar
@@ -310,14 +257,20 @@ void MainFrame::UpdateUI()
 void MainFrame::OnAddDownload(wxCommandEvent& event)
 {
     // Show download dialog
-    DownloadDialog dialog(this);
+    DownloadDialog dialog(this, m_settings.maxConnectionsPerDownload);
     if (dialog.ShowModal() == wxID_OK) {
         // Add download
-        wxString url = dialog.GetURL();
+        std::vector<wxString> urls = dialog.GetURLs();
         wxString savePath = dialog.GetSavePath();
+        int connections = dialog.GetConnections();
+        wxString checksum = dialog.GetChecksum();
+        std::vector<wxString> mirrors = dialog.GetMirrors();
         
-        if (!url.IsEmpty() && !savePath.IsEmpty()) {
-            m_downloadManager->AddDownload(url, savePath);
+        // Pasted batches are added at once; their sizes and names are probed in the background
+        if (!urls.empty() && !savePath.IsEmpty()) {
+            for (const auto& url : urls) {
+                m_downloadManager->AddDownload(url, savePath, connections, checksum, mirrors);
+            }
             UpdateUI();
         }
     }
@@ -436,7 +389,7 @@ void MainFrame::OnOpenFile(wxCommandEvent& event)
     }
     
     // Get download ID
-    int id = wxAtoi(m_downloadList->GetItemText(selectedIndex));
+    int id = m_downloadList->GetDownloadId(selectedIndex);
     
     // Get download
     DownloadItem* item = m_downloadManager->GetDownloadById(id);
@@ -471,7 +424,7 @@ void MainFrame::OnOpenFolder(wxCommandEvent& event)
     }
     
     // Get download ID
-    int id = wxAtoi(m_downloadList->GetItemText(selectedIndex));
+    int id = m_downloadList->GetDownloadId(selectedIndex);
     
     // Get download
     DownloadItem* item = m_downloadManager->GetDownloadById(id);
@@ -499,7 +452,7 @@ void MainFrame::OnCopyURL(wxCommandEvent& event)
     }
     
     // Get download ID
-    int id = wxAtoi(m_downloadList->GetItemText(selectedIndex));
+    int id = m_downloadList->GetDownloadId(selectedIndex);
     
     // Get download
     DownloadItem* item = m_downloadManager->GetDownloadById(id);
@@ -543,6 +496,29 @@ void MainFrame::OnSpeedLimit(wxCommandEvent& event)
     }
 }
 
+void MainFrame::OnSetPriority(wxCommandEvent& event)
+{
+    // Get selected items
+    std::vector<int> selectedIds = GetSelectedDownloadIds();
+    
+    if (selectedIds.empty()) {
+        wxMessageBox("No downloads selected.", "Error", wxOK | wxICON_ERROR);
+        return;
+    }
+    
+    // Map the menu item to a priority
+    DownloadPriority priority = DownloadPriority::NORMAL;
+    if (event.GetId() == ID_PriorityHigh) {
+        priority = DownloadPriority::HIGH;
+    } else if (event.GetId() == ID_PriorityLow) {
+        priority = DownloadPriority::LOW;
+    }
+    
+    // Set priority
+    m_downloadManager->SetDownloadsPriority(selectedIds, priority);
+    UpdateUI();
+}
+
 void MainFrame::OnExit(wxCommandEvent& event)
 {
     Close();
@@ -570,20 +546,89 @@ void MainFrame::OnUpdateUI(wxCommandEvent& event)
 
 void MainFrame::OnTimer(wxTimerEvent& event)
 {
-    static int updateCounter = 0;
-    
-    // Only update UI every 2 seconds instead of every 1 second
-    // This reduces the frequency of selection resets
-    if (++updateCounter >= 2) {
+    // Rebuild the list only when downloads were added, removed or changed state;
+    // otherwise just sample the progress of the running ones
+    if (m_downloadManager->TakeListChanged()) {
         UpdateUI();
-        updateCounter = 0;
+    } else {
+        std::lock_guard<std::mutex> lock(g_uiMutex);
+        m_downloadList->RefreshProgress();
     }
 }
 
+// Offer the hosts of the current downloads in the host filter
+void MainFrame::UpdateHostFilter()
+{
+    std::vector<wxString> hosts = m_downloadList->GetHosts();
+    if (hosts == m_filterHosts) {
+        return;
+    }
+    
+    // Keep the chosen host while it still has downloads
+    int current = m_hostFilter->GetSelection();
+    bool filtered = current > 0 && current <= static_cast<int>(m_filterHosts.size());
+    wxString selected = filtered ? m_filterHosts[current - 1] : wxString();
+    m_filterHosts = hosts;
+    m_hostFilter->Clear();
+    m_hostFilter->Append("All hosts");
+    int selection = 0;
+    for (size_t i = 0; i < hosts.size(); i++) {
+        m_hostFilter->Append(hosts[i].IsEmpty() ? wxString("(no host)") : hosts[i]);
+        if (filtered && hosts[i] == selected) {
+            selection = static_cast<int>(i) + 1;
+        }
+    }
+    m_hostFilter->SetSelection(selection);
+    
+    if (selection == 0 && filtered) {
+        ApplyFilter();
+    }
+}
+
+// Show the downloads passing the status, host and search filters
+void MainFrame::ApplyFilter()
+{
+    static const DownloadFilter::Status statuses[] = {
+        DownloadFilter::Status::ALL,
+        DownloadFilter::Status::ACTIVE,
+        DownloadFilter::Status::PAUSED,
+        DownloadFilter::Status::COMPLETED,
+        DownloadFilter::Status::FAILED
+    };
+    
+    DownloadFilter filter;
+    int status = m_statusFilter->GetSelection();
+    if (status > 0 && status < static_cast<int>(sizeof(statuses) / sizeof(statuses[0]))) {
+        filter.status = statuses[status];
+    }
+    int host = m_hostFilter->GetSelection();
+    if (host > 0 && host <= static_cast<int>(m_filterHosts.size())) {
+        filter.host = m_filterHosts[host - 1];
+    }
+    wxString search = m_searchBox->GetValue();
+    if (!search.Trim(true).Trim(false).IsEmpty()) {
+        filter.searching = true;
+        filter.ids = m_downloadManager->SearchDownloads(search);
+    }
+    
+    m_downloadList->SetFilter(filter);
+}
+
+void MainFrame::OnFilterChanged(wxCommandEvent& event)
+{
+    ApplyFilter();
+}
+
+void MainFrame::OnSearchCancel(wxCommandEvent& event)
+{
+    m_searchBox->ChangeValue(wxEmptyString);
+    ApplyFilter();
+}
+
 void MainFrame::OnClose(wxCloseEvent& event)
 {
     // Check if there are active downloads
-    const std::vector<DownloadItem>& downloads = m_downloadManager->GetDownloads();
+    std::vector<DownloadItem> downloads = m_downloadManager->GetDownloads();
     bool hasActiveDownloads = false;
     
     for (const auto& item : downloads) {
@@ -609,7 +654,7 @@ void MainFrame::OnClose(wxCloseEvent& event)
 void MainFrame::OnDownloadListItemActivated(wxListEvent& event)
 {
     // Get download ID
-    int id = wxAtoi(m_downloadList->GetItemText(event.GetIndex()));
+    int id = m_downloadList->GetDownloadId(event.GetIndex());
     
     // Get download
     DownloadItem* item = m_downloadManager->GetDownloadById(id);
@@ -623,6 +668,7 @@ void MainFrame::OnDownloadListItemActivated(wxListEvent& event)
             m_downloadManager->StartDownload(id);
             break;
         case DownloadStatus::DOWNLOADING:
+        case DownloadStatus::QUEUED:
             m_downloadManager->PauseDownload(id);
             break;
         case DownloadStatus::PAUSED:
@@ -658,6 +704,12 @@ void MainFrame::OnDownloadListItemRightClick(wxListEvent& event)
     menu.AppendSeparator();
     menu.Append(ID_DeleteDownload, "&Delete");
     menu.AppendSeparator();
+    wxMenu* priorityMenu = new wxMenu;
+    priorityMenu->Append(ID_PriorityHigh, "&High");
+    priorityMenu->Append(ID_PriorityNormal, "&Normal");
+    priorityMenu->Append(ID_PriorityLow, "&Low");
+    menu.AppendSubMenu(priorityMenu, "P&riority");
+    menu.AppendSeparator();
     menu.Append(ID_OpenFile, "Open &File");
     menu.Append(ID_OpenFolder, "Open F&older");
     menu.Append(ID_CopyURL, "&Copy URL");
@@ -688,7 +740,7 @@ std::vector<int> MainFrame::GetSelectedDownloadIds()
             break;
             
         // Get download ID
-        int id = wxAtoi(m_downloadList->GetItemText(item));
+        int id = m_downloadList->GetDownloadId(item);
         ids.push_back(id);
         
         wxLogMessage("Selected download ID: %d", id);
@@ -55,6 +55,38 @@ void SettingsDialog::CreateUI()
   maxDownloadsSizer->Add(m_maxDownloadsCtrl, 0, wxALIGN_CENTER_VERTICAL);
   generalSizer->Add(maxDownloadsSizer, 0, wxEXPAND | wxALL, 10);
   
+  // Connections per download
+  wxBoxSizer* connectionsSizer = new wxBoxSizer(wxHORIZONTAL);
+  connectionsSizer->Add(new wxStaticText(generalPanel, wxID_ANY, "Connections per Download:"), 0, wxALIGN_CENTER_VERTICAL | wxRIGHT, 5);
+  m_connectionsCtrl = new wxSpinCtrl(generalPanel, wxID_ANY, wxEmptyString, wxDefaultPosition, wxDefaultSize, wxSP_ARROW_KEYS, 1, 16, m_settings.maxConnectionsPerDownload);
+  connectionsSizer->Add(m_connectionsCtrl, 0, wxALIGN_CENTER_VERTICAL);
+  generalSizer->Add(connectionsSizer, 0, wxEXPAND | wxALL, 10);
+  
+  // Connections per host
+  wxBoxSizer* hostConnectionsSizer = new wxBoxSizer(wxHORIZONTAL);
+  hostConnectionsSizer->Add(new wxStaticText(generalPanel, wxID_ANY, "Max Connections per Server:"), 0, wxALIGN_CENTER_VERTICAL | wxRIGHT, 5);
+  m_hostConnectionsCtrl = new wxSpinCtrl(generalPanel, wxID_ANY, wxEmptyString, wxDefaultPosition, wxDefaultSize, wxSP_ARROW_KEYS, 1, 32, m_settings.maxConnectionsPerHost);
+  hostConnectionsSizer->Add(m_hostConnectionsCtrl, 0, wxALIGN_CENTER_VERTICAL);
+  generalSizer->Add(hostConnectionsSizer, 0, wxEXPAND | wxALL, 10);
+  
+  // Delay between downloads started on one server
+  wxBoxSizer* hostIntervalSizer = new wxBoxSizer(wxHORIZONTAL);
+  hostIntervalSizer->Add(new wxStaticText(generalPanel, wxID_ANY, "Delay Between Requests to a Server (ms):"), 0, wxALIGN_CENTER_VERTICAL | wxRIGHT, 5);
+  m_hostIntervalCtrl = new wxSpinCtrl(generalPanel, wxID_ANY, wxEmptyString, wxDefaultPosition, wxDefaultSize, wxSP_ARROW_KEYS, 0, 10000, m_settings.hostRequestInterval);
+  hostIntervalSizer->Add(m_hostIntervalCtrl, 0, wxALIGN_CENTER_VERTICAL);
+  generalSizer->Add(hostIntervalSizer, 0, wxEXPAND | wxALL, 10);
+  
+  // Disk write mode
+  wxBoxSizer* writeModeSizer = new wxBoxSizer(wxHORIZONTAL);
+  writeModeSizer->Add(new wxStaticText(generalPanel, wxID_ANY, "Disk Write Mode:"), 0, wxALIGN_CENTER_VERTICAL | wxRIGHT, 5);
+  wxArrayString writeModeChoices;
+  writeModeChoices.Add("Buffered");
+  writeModeChoices.Add("Memory-mapped");
+  m_writeModeCtrl = new wxChoice(generalPanel, wxID_ANY, wxDefaultPosition, wxDefaultSize, writeModeChoices);
+  m_writeModeCtrl->SetSelection(static_cast<int>(m_settings.writeMode));
+  writeModeSizer->Add(m_writeModeCtrl, 0, wxALIGN_CENTER_VERTICAL);
+  generalSizer->Add(writeModeSizer, 0, wxEXPAND | wxALL, 10);
+  
   // Show notifications
   m_showNotificationsCheck = new wxCheckBox(generalPanel, wxID_ANY, "Show Notifications");
   m_showNotificationsCheck->SetValue(m_settings.showNotifications);
@@ -73,6 +105,40 @@ void SettingsDialog::CreateUI()
   // Set sizer
   generalPanel->SetSizer(generalSizer);
   
+  // Create bandwidth panel
+  wxPanel* bandwidthPanel = new wxPanel(notebook);
+  wxBoxSizer* bandwidthSizer = new wxBoxSizer(wxVERTICAL);
+  bandwidthSizer->Add(new wxStaticText(bandwidthPanel, wxID_ANY, "Share of the speed limit per download priority (0 = no minimum or no cap):"), 0, wxEXPAND | wxALL, 10);
+  
+  // One row per priority: weight, guaranteed rate and cap
+  wxFlexGridSizer* prioritySizer = new wxFlexGridSizer(4, 5, 10);
+  prioritySizer->Add(new wxStaticText(bandwidthPanel, wxID_ANY, "Priority"), 0, wxALIGN_CENTER_VERTICAL);
+  prioritySizer->Add(new wxStaticText(bandwidthPanel, wxID_ANY, "Weight"), 0, wxALIGN_CENTER_VERTICAL);
+  prioritySizer->Add(new wxStaticText(bandwidthPanel, wxID_ANY, "Min (KB/s)"), 0, wxALIGN_CENTER_VERTICAL);
+  prioritySizer->Add(new wxStaticText(bandwidthPanel, wxID_ANY, "Max (KB/s)"), 0, wxALIGN_CENTER_VERTICAL);
+  const char* priorityNames[] = { "High", "Normal", "Low" };
+  const PriorityBandwidth* priorities[] = { &m_settings.highPriority, &m_settings.normalPriority, &m_settings.lowPriority };
+  for (int i = 0; i < PRIORITY_ROWS; i++) {
+    prioritySizer->Add(new wxStaticText(bandwidthPanel, wxID_ANY, priorityNames[i]), 0, wxALIGN_CENTER_VERTICAL);
+    m_priorityWeightCtrl[i] = new wxSpinCtrl(bandwidthPanel, wxID_ANY, wxEmptyString, wxDefaultPosition, wxDefaultSize, wxSP_ARROW_KEYS, 1, 100, priorities[i]->weight);
+    prioritySizer->Add(m_priorityWeightCtrl[i], 0, wxALIGN_CENTER_VERTICAL);
+    m_priorityMinRateCtrl[i] = new wxSpinCtrl(bandwidthPanel, wxID_ANY, wxEmptyString, wxDefaultPosition, wxDefaultSize, wxSP_ARROW_KEYS, 0, 100000, priorities[i]->minRate);
+    prioritySizer->Add(m_priorityMinRateCtrl[i], 0, wxALIGN_CENTER_VERTICAL);
+    m_priorityMaxRateCtrl[i] = new wxSpinCtrl(bandwidthPanel, wxID_ANY, wxEmptyString, wxDefaultPosition, wxDefaultSize, wxSP_ARROW_KEYS, 0, 100000, priorities[i]->maxRate);
+    prioritySizer->Add(m_priorityMaxRateCtrl[i], 0, wxALIGN_CENTER_VERTICAL);
+  }
+  bandwidthSizer->Add(prioritySizer, 0, wxALL, 10);
+  
+  // Burst allowed above the speed limit
+  wxBoxSizer* burstSizer = new wxBoxSizer(wxHORIZONTAL);
+  burstSizer->Add(new wxStaticText(bandwidthPanel, wxID_ANY, "Burst Above the Speed Limit (ms of the limit):"), 0, wxALIGN_CENTER_VERTICAL | wxRIGHT, 5);
+  m_speedLimitBurstCtrl = new wxSpinCtrl(bandwidthPanel, wxID_ANY, wxEmptyString, wxDefaultPosition, wxDefaultSize, wxSP_ARROW_KEYS, 10, 10000, m_settings.speedLimitBurst);
+  burstSizer->Add(m_speedLimitBurstCtrl, 0, wxALIGN_CENTER_VERTICAL);
+  bandwidthSizer->Add(burstSizer, 0, wxEXPAND | wxALL, 10);
+  
+  // Set sizer
+  bandwidthPanel->SetSizer(bandwidthSizer);
+  
   // Create YouTube panel
   wxPanel* youtubePanel = new wxPanel(notebook);
   wxBoxSizer* youtubeSizer = new wxBoxSizer(wxVERTICAL);
@@ -105,6 +171,7 @@ void SettingsDialog::CreateUI()
   
   // Add panels to notebook
   notebook->AddPage(generalPanel, "General");
+  notebook->AddPage(bandwidthPanel, "Bandwidth");
   notebook->AddPage(youtubePanel, "YouTube");
   
   // Add notebook to main sizer
@@ -151,10 +218,28 @@ void SettingsDialog::OnOK(wxCommandEvent& event)
       wxMessageBox("Default save path cannot be empty.", "Error", wxOK | wxICON_ERROR);
       return;
   }
+  for (int i = 0; i < PRIORITY_ROWS; i++) {
+      int maxRate = m_priorityMaxRateCtrl[i]->GetValue();
+      if (maxRate > 0 && m_priorityMinRateCtrl[i]->GetValue() > maxRate) {
+          wxMessageBox("A priority's minimum rate cannot be above its maximum rate.", "Error", wxOK | wxICON_ERROR);
+          return;
+      }
+  }
   
   // Update settings
   m_settings.defaultSavePath = m_savePathCtrl->GetValue();
   m_settings.maxSimultaneousDownloads = m_maxDownloadsCtrl->GetValue();
+  m_settings.maxConnectionsPerDownload = m_connectionsCtrl->GetValue();
+  m_settings.maxConnectionsPerHost = m_hostConnectionsCtrl->GetValue();
+  m_settings.hostRequestInterval = m_hostIntervalCtrl->GetValue();
+  m_settings.writeMode = static_cast<WriteMode>(m_writeModeCtrl->GetSelection());
+  m_settings.speedLimitBurst = m_speedLimitBurstCtrl->GetValue();
+  PriorityBandwidth* priorities[] = { &m_settings.highPriority, &m_settings.normalPriority, &m_settings.lowPriority };
+  for (int i = 0; i < PRIORITY_ROWS; i++) {
+      priorities[i]->weight = m_priorityWeightCtrl[i]->GetValue();
+      priorities[i]->minRate = m_priorityMinRateCtrl[i]->GetValue();
+      priorities[i]->maxRate = m_priorityMaxRateCtrl[i]->GetValue();
+  }
   m_settings.showNotifications = m_showNotificationsCheck->GetValue();
   m_settings.startWithWindows = m_startWithWindowsCheck->GetValue();
   m_settings.minimizeToTray = m_minimizeToTrayCheck->GetValue();
@@ -32,11 +32,7 @@ int ProgressCallback(void* clientp, curl_off_t dltotal, curl_off_t dlnow, curl_o
             lastBytes = dlnow;
         }
         
-        // إرسال حدث تحديث واجهة المستخدم إذا كان هناك إشارة إلى MainFrame
-        if (item->mainFrame) {
-            wxCommandEvent event(wxEVT_MENU, ID_UpdateUI);
-            wxPostEvent((wxEvtHandler*)item->mainFrame, event);
-        }
+        // لا يتم إرسال حدث لكل استدعاء؛ واجهة المستخدم تقرأ التقدم بمعدل ثابت
     }
     
     return 0;  // 0 للاستمرار، غير صفر للإلغاء